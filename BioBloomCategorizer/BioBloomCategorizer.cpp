@@ -28,6 +28,14 @@ namespace opt {
 static unsigned threads = 1;
 }
 
+/** long options without a short form */
+enum {
+	OPT_SAMPLE_TOL = 256, OPT_SAMPLE_STRIDE, OPT_MIN_QUAL, OPT_PIPELINE_STATS,
+	OPT_PARSE_THREADS, OPT_KEEP_ORDER, OPT_GZ_LEVEL, OPT_GZ_THREADS,
+	OPT_PAIR_MEM, OPT_INTERLEAVED, OPT_READ_BUFFER,
+	OPT_LABELS, OPT_DUST
+};
+
 void printVersion()
 {
 	const char VERSION_MESSAGE[] = PROGRAM " (" PACKAGE_NAME ") " VERSION "\n"
@@ -74,7 +82,9 @@ void printHelpDialog()
 	"Usage: biobloomcategorizer [OPTION]... -f \"[FILTER1]...\" [FILE]...\n"
 	"biobloomcategorizer [OPTION]... -e -f \"[FILTER1]...\" [FILE1.fq] [FILE2.fq]\n"
 	"Categorize Sequences. The input format may be FASTA, FASTQ, qseq, export, SAM or\n"
-	"BAM format and compressed with gz, bz2 or xz and may be tarred.\n"
+	"BAM format and compressed with gz, bz2 or xz and may be tarred. Gzip input is\n"
+	"decompressed in process (BGZF input in parallel) and BAM is decoded without\n"
+	"samtools. Secondary and supplementary alignments are ignored.\n"
 	"\n"
 	"  -p, --prefix=N         Output prefix to use. Otherwise will output to current\n"
 	"                         directory.\n"
@@ -83,6 +93,9 @@ void printHelpDialog()
 	"  -e, --paired_mode      Uses paired-end information. For BAM or SAM files, if\n"
 	"                         they are poorly ordered, the memory usage will be much\n"
 	"                         larger than normal. Sorting by read name may be needed.\n"
+	"      --interleaved      Paired-end reads are in a single FASTA/FASTQ file, each\n"
+	"                         read followed by its mate. Use - to read from stdin.\n"
+	"                         Implies -e.\n"
 	"  -i, --inclusive        If one paired read matches, both reads will be included\n"
 	"                         in the filter. \n"
 	"  -s, --score=N          Score threshold for matching. Maximum threshold is 1\n"
@@ -92,8 +105,19 @@ void printHelpDialog()
 	"                         threshold and score will appended to the header of the\n"
 	"                         output read.[0.15]\n"
 	"  -w, --with_score       Output multimatches with scores in the order of filter.\n"
-	"  -t, --threads=N        The number of threads to use. [1]\n"
+	"  -t, --threads=N        The number of threads to use. With 3 or more threads\n"
+	"                         one thread parses input, one writes output and the\n"
+	"                         rest classify reads. [1]\n"
 	"  -g, --gz_output        Outputs all output files in compressed gzip.\n"
+	"                         Files are written in blocks (BGZF) that are\n"
+	"                         compressed in parallel.\n"
+	"      --gz_level=N       Compression level of gzip output (1-9). [6]\n"
+	"      --gz_threads=N     Threads compressing gzip output, shared by all of\n"
+	"                         the output files (at most 4 blocks of 64 KB per\n"
+	"                         thread are queued at a time), and threads\n"
+	"                         decompressing each BGZF input file, on top of\n"
+	"                         those set by -t (0 = in the writing or parsing\n"
+	"                         thread). [same as -t]\n"
 	"      --fa               Output categorized reads in Fasta files.\n"
 	"      --fq               Output categorized reads in Fastq files.\n"
 	"      --chastity         Discard and do not evaluate unchaste reads.\n"
@@ -115,9 +139,47 @@ void printHelpDialog()
 	"                         advantage of when k-mer sizes and number of hash\n"
 	"                         functions are the same.\n"
 	"  -d, --stdout_filter=N  Outputs all matching reads to stdout for the specified\n"
-	"                         filter. N is the filter ID without file extension.\n"
+	"                         filter. N is the filter ID without file extension,\n"
+	"                         or noMatch or multiMatch (e.g. -d noMatch to pass the\n"
+	"                         reads left after host depletion on to an aligner).\n"
 	"                         Reads are outputed in fastq, and if paired will output\n"
 	"                         will be interlaced.\n"
+	"      --sample_tol=N     Estimate composition only. Reads are classified in\n"
+	"                         blocks and filtering stops once the 95% confidence\n"
+	"                         interval of every category is within +/-N. Cannot be\n"
+	"                         used with -e, --fa or --fq.\n"
+	"      --sample_stride=N  When sampling, classify one section (about 4 MB) of\n"
+	"                         every N of uncompressed files, skipping the others,\n"
+	"                         or one block of 10000 reads of every N of other\n"
+	"                         input. [1]\n"
+	"      --min_qual=N       K-mers overlapping bases with a phred+33 quality\n"
+	"                         below N are not looked up and count as misses,\n"
+	"                         like k-mers containing Ns. Output reads are not\n"
+	"                         modified. [0]\n"
+	"      --dust=N           Low complexity reads, with at least half of their\n"
+	"                         k-mers scoring above N with DUST (as left out of\n"
+	"                         filters made with biobloommaker --dust=N), are not\n"
+	"                         evaluated and match no filter. [off]\n"
+	"      --pipeline_stats   Print the queue depths and stall times of the\n"
+	"                         parsing, classifying and writing stages.\n"
+	"      --parse_threads=N  Threads used to parse single end input. Uncompressed\n"
+	"                         FASTA and FASTQ files are split into sections that\n"
+	"                         are parsed in parallel. [one per 8 threads]\n"
+	"      --keep_order       Write reads to every output in the same order as the\n"
+	"                         input, keeping mates in step, when using more than\n"
+	"                         one thread. Input is parsed by one thread.\n"
+	"      --labels           Also write the filters each read (or pair) is assigned\n"
+	"                         to as fixed width binary records to\n"
+	"                         [prefix]_labels.bin, with scores if -w is set. Use\n"
+	"                         biobloomlabels to print them.\n"
+	"      --read_buffer=N    Size in KB of the two buffers each input file is read\n"
+	"                         into by a background thread, ahead of parsing. 0 reads\n"
+	"                         in the parsing thread. [4096]\n"
+	"      --pair_mem=N       Memory in MB for reads of a paired SAM/BAM file held\n"
+	"                         until their mate is found. Beyond this reads are\n"
+	"                         spilled to temporary files, which are paired at\n"
+	"                         the end in parts that fit in N. Mates next to each\n"
+	"                         other (name collated input) are never held. [1024]\n"
 	"Report bugs to <cjustin@bcgsc.ca>.";
 
 	cerr << dialog << endl;
@@ -156,6 +218,18 @@ int main(int argc, char *argv[])
 
 	string mainFilter = "";
 
+	double sampleTolerance = 0;
+	unsigned sampleStride = 1;
+	unsigned minQual = 0;
+	double dustThreshold = 0;
+	bool pipelineStats = false;
+	unsigned parseThreads = 0;
+	bool keepOrder = false;
+	bool gzThreadsSet = false;
+	size_t pairMemory = 0;
+	bool interleaved = false;
+	bool labels = false;
+
 	//long form arguments
 	static struct option long_options[] = { {
 		"prefix", optional_argument, NULL, 'p' }, {
@@ -178,6 +252,19 @@ int main(int argc, char *argv[])
 		"ordered", no_argument, NULL, 'c' }, {
 		"stdout_filter", required_argument, NULL, 'd' }, {
 		"with_score", no_argument, NULL, 'w' }, {
+		"sample_tol", required_argument, NULL, OPT_SAMPLE_TOL }, {
+		"sample_stride", required_argument, NULL, OPT_SAMPLE_STRIDE }, {
+		"min_qual", required_argument, NULL, OPT_MIN_QUAL }, {
+		"dust", required_argument, NULL, OPT_DUST }, {
+		"pipeline_stats", no_argument, NULL, OPT_PIPELINE_STATS }, {
+		"parse_threads", required_argument, NULL, OPT_PARSE_THREADS }, {
+		"keep_order", no_argument, NULL, OPT_KEEP_ORDER }, {
+		"gz_level", required_argument, NULL, OPT_GZ_LEVEL }, {
+		"gz_threads", required_argument, NULL, OPT_GZ_THREADS }, {
+		"pair_mem", required_argument, NULL, OPT_PAIR_MEM }, {
+		"interleaved", no_argument, NULL, OPT_INTERLEAVED }, {
+		"read_buffer", required_argument, NULL, OPT_READ_BUFFER }, {
+		"labels", no_argument, NULL, OPT_LABELS }, {
 		NULL, 0, NULL, 0 } };
 
 	//actual checking step
@@ -277,6 +364,110 @@ int main(int argc, char *argv[])
 			withScore = true;
 			break;
 		}
+		case OPT_SAMPLE_TOL: {
+			stringstream convert(optarg);
+			if (!(convert >> sampleTolerance) || sampleTolerance <= 0
+					|| sampleTolerance >= 1)
+			{
+				cerr << "Error - Invalid parameter! sample_tol: " << optarg
+						<< endl;
+				exit(EXIT_FAILURE);
+			}
+			break;
+		}
+		case OPT_SAMPLE_STRIDE: {
+			stringstream convert(optarg);
+			if (!(convert >> sampleStride) || sampleStride == 0) {
+				cerr << "Error - Invalid parameter! sample_stride: " << optarg
+						<< endl;
+				exit(EXIT_FAILURE);
+			}
+			break;
+		}
+		case OPT_MIN_QUAL: {
+			stringstream convert(optarg);
+			if (!(convert >> minQual) || minQual > 93) {
+				cerr << "Error - Invalid parameter! min_qual: " << optarg
+						<< endl;
+				exit(EXIT_FAILURE);
+			}
+			break;
+		}
+		case OPT_DUST: {
+			stringstream convert(optarg);
+			if (!(convert >> dustThreshold) || dustThreshold <= 0) {
+				cerr << "Error - Invalid parameter! dust: " << optarg << endl;
+				exit(EXIT_FAILURE);
+			}
+			break;
+		}
+		case OPT_PIPELINE_STATS: {
+			pipelineStats = true;
+			break;
+		}
+		case OPT_PARSE_THREADS: {
+			stringstream convert(optarg);
+			if (!(convert >> parseThreads) || parseThreads == 0) {
+				cerr << "Error - Invalid parameter! parse_threads: " << optarg
+						<< endl;
+				exit(EXIT_FAILURE);
+			}
+			break;
+		}
+		case OPT_KEEP_ORDER: {
+			keepOrder = true;
+			break;
+		}
+		case OPT_GZ_LEVEL: {
+			stringstream convert(optarg);
+			if (!(convert >> opt::gzipLevel) || opt::gzipLevel < 1
+					|| opt::gzipLevel > 9)
+			{
+				cerr << "Error - Invalid parameter! gz_level: " << optarg
+						<< endl;
+				exit(EXIT_FAILURE);
+			}
+			break;
+		}
+		case OPT_GZ_THREADS: {
+			stringstream convert(optarg);
+			if (!(convert >> opt::gzipThreads)) {
+				cerr << "Error - Invalid parameter! gz_threads: " << optarg
+						<< endl;
+				exit(EXIT_FAILURE);
+			}
+			gzThreadsSet = true;
+			break;
+		}
+		case OPT_INTERLEAVED: {
+			interleaved = true;
+			paired = true;
+			break;
+		}
+		case OPT_LABELS: {
+			labels = true;
+			break;
+		}
+		case OPT_READ_BUFFER: {
+			stringstream convert(optarg);
+			size_t readBuffer;
+			if (!(convert >> readBuffer)) {
+				cerr << "Error - Invalid parameter! read_buffer: " << optarg
+						<< endl;
+				exit(EXIT_FAILURE);
+			}
+			opt::readAheadSize = readBuffer << 10;
+			break;
+		}
+		case OPT_PAIR_MEM: {
+			stringstream convert(optarg);
+			if (!(convert >> pairMemory) || pairMemory == 0) {
+				cerr << "Error - Invalid parameter! pair_mem: " << optarg
+						<< endl;
+				exit(EXIT_FAILURE);
+			}
+			break;
+		}
 		case '?': {
 			die = true;
 			break;
@@ -289,6 +480,10 @@ int main(int argc, char *argv[])
 	omp_set_num_threads(opt::threads);
 #endif
 
+	if (!gzThreadsSet) {
+		opt::gzipThreads = opt::threads;
+	}
+
 	vector<string> filterFilePaths = convertInputString(filtersFile);
 	vector<string> inputFiles = convertInputString(rawInputFiles);
 
@@ -300,7 +495,12 @@ int main(int argc, char *argv[])
 	bool pairedBAMSAM = false;
 
 	//check validity of inputs for paired end mode
-	if (paired) {
+	if (interleaved) {
+		if (inputFiles.size() != 1) {
+			cerr << "Error: --interleaved takes a single input file" << endl;
+			exit(1);
+		}
+	} else if (paired) {
 		if (inputFiles.size() == 1
 				&& (inputFiles[0].substr(inputFiles[0].size() - 4) == ".bam"
 						|| inputFiles[0].substr(inputFiles[0].size() - 4)
@@ -350,11 +550,18 @@ int main(int argc, char *argv[])
 	}
 
 	//-w option cannot be used without output method
-	if (withScore && (outputReadType == "")) {
+	if (withScore && outputReadType == "" && !labels) {
 		cerr << "Error: -w option cannot be used without output method" << endl;
 		exit(1);
 	}
 
+	//sampling only produces a summary
+	if (sampleTolerance > 0 && (paired || outputReadType != "")) {
+		cerr << "Error: --sample_tol cannot be used with -e, --fa or --fq"
+				<< endl;
+		exit(1);
+	}
+
 	//load filters
 	BioBloomClassifier BBC(filterFilePaths, score, outputPrefix, filePostfix,
 			minHit, minHitOnly, withScore);
@@ -370,6 +577,38 @@ int main(int argc, char *argv[])
 		BBC.setMainFilter(mainFilter);
 	}
 
+	if (minQual > 0) {
+		BBC.setMinBaseQuality(minQual);
+	}
+
+	if (dustThreshold > 0) {
+		BBC.setDust(dustThreshold);
+	}
+
+	if (pipelineStats) {
+		BBC.setPipelineStats();
+	}
+
+	if (parseThreads > 0) {
+		BBC.setParseThreads(parseThreads);
+	}
+
+	if (keepOrder) {
+		BBC.setKeepOrder();
+	}
+
+	if (labels) {
+		BBC.setLabels();
+	}
+
+	if (pairMemory > 0) {
+		BBC.setPairMemory(pairMemory << 20);
+	}
+
+	if (sampleTolerance > 0) {
+		BBC.setSampling(sampleTolerance, sampleStride);
+	}
+
 	//filtering step
 	//create directory structure if it does not exist
 	if (paired) {
@@ -377,14 +616,18 @@ int main(int argc, char *argv[])
 			BBC.setInclusive();
 		}
 		if (outputReadType != "") {
-			if (pairedBAMSAM) {
+			if (interleaved) {
+				BBC.filterPairInterleavedPrint(inputFiles[0], outputReadType);
+			} else if (pairedBAMSAM) {
 				BBC.filterPairBAMPrint(inputFiles[0], outputReadType);
 			} else {
 				BBC.filterPairPrint(inputFiles[0], inputFiles[1],
 						outputReadType);
 			}
 		} else {
-			if (pairedBAMSAM) {
+			if (interleaved) {
+				BBC.filterPairInterleaved(inputFiles[0]);
+			} else if (pairedBAMSAM) {
 				BBC.filterPairBAM(inputFiles[0]);
 			} else {
 				BBC.filterPair(inputFiles[0], inputFiles[1]);
@@ -10,9 +10,12 @@
 #include <fstream>
 #include <sstream>
 #include <sys/stat.h>
+#include <sched.h>
 #include "ResultsManager.h"
 #include "Common/Options.h"
+#include "Common/BoundedQueue.h"
 #include <map>
+#include <algorithm>
 #if _OPENMP
 # include <omp.h>
 #endif
@@ -22,9 +25,17 @@ BioBloomClassifier::BioBloomClassifier(const vector<string> &filterFilePaths,
 		const string &outputPostFix, unsigned minHit, bool minHitOnly, bool withScore) :
 		m_scoreThreshold(scoreThreshold), m_filterNum(filterFilePaths.size()), m_prefix(
 				prefix), m_postfix(outputPostFix), m_minHit(minHit), m_mode(
-				STD), m_mainFilter(""), m_inclusive(false)
+				STD), m_mainFilter(""), m_inclusive(false), m_minQual(0), m_dustThreshold(0), m_sampleTolerance(
+				0), m_sampleStride(1), m_pipelineStats(false), m_parseThreads(
+				0), m_keepOrder(false), m_pairMemory(PAIR_MEMORY_MB << 20), m_labels(
+				false), m_labelFile(NULL)
 {
 	loadFilters(filterFilePaths);
+	for (unsigned i = 0; i < m_filterOrder.size(); ++i) {
+		m_categoryIndex[m_filterOrder[i]] = i;
+	}
+	m_categoryIndex[MULTI_MATCH] = m_filterOrder.size();
+	m_categoryIndex[NO_MATCH] = m_filterOrder.size() + 1;
 	if (minHitOnly && withScore) {
 		cerr << "minHit, withScore cannot be used together" << endl;
 		exit(1);
@@ -53,51 +64,33 @@ void BioBloomClassifier::filter(const vector<string> &inputFiles)
 	//results summary object
 	ResultsManager resSummary(m_filterOrder, m_inclusive);
 
-	size_t totalReads = 0;
+	unordered_map<string, boost::shared_ptr<Dynamicofstream> > outputFiles;
 
 	//print out header info and initialize variables
 
 	cerr << "Filtering Start" << endl;
 
-	for (vector<string>::const_iterator it = inputFiles.begin();
-			it != inputFiles.end(); ++it)
-	{
-		FastaReader sequence(it->c_str(), FastaReader::NO_FOLD_CASE);
-#pragma omp parallel
-		for (FastqRecord rec;;) {
-			bool good;
-#pragma omp critical(sequence)
-			{
-				good = sequence >> rec;
-				//track read progress
-			}
-			if (good) {
-#pragma omp critical(totalReads)
-				{
-					++totalReads;
-					if (totalReads % 10000000 == 0) {
-						cerr << "Currently Reading Read Number: " << totalReads
-								<< endl;
-					}
-				}
-				unordered_map<string, bool> hits(m_filterNum);
-				double score = 0; //Todo: figure out what happens to this if multiple hashSigs are used
-				vector<double> scores(m_filterNum, 0.0);
-
-				//for each hashSigniture/kmer combo multi, cut up read into kmer sized used
-				for (vector<string>::const_iterator j = m_hashSigs.begin();
-						j != m_hashSigs.end(); ++j)
-				{
-					evaluateRead(rec, *j, hits, score, scores);
-				}
-
-				//Evaluate hit data and record for summary and print if needed
-				printSingle(rec, score, resSummary.updateSummaryData(hits));
-
-			} else
-				break;
+	size_t totalReads = 0;
+	size_t readsScanned = 0;
+	bool stoppedEarly = false;
+	unsigned parsers = getParseThreads();
+	if (m_sampleTolerance == 0 && MappedReadSource::canMap(inputFiles)) {
+		MappedReadSource source(inputFiles, parsers,
+				parsers > 1 ? parsers * SECTIONS_PER_PARSER : 1);
+		totalReads = classifyReads(source, resSummary, outputFiles, "");
+	} else if (parsers > 1 && m_sampleTolerance == 0) {
+		SplitReadSource source(inputFiles, parsers,
+				parsers * SECTIONS_PER_PARSER);
+		totalReads = classifyReads(source, resSummary, outputFiles, "");
+	} else {
+		SingleReadSource source(inputFiles);
+		if (m_sampleTolerance > 0) {
+			source.setSampling(SAMPLE_BLOCK_SIZE, SAMPLE_SECTION_BYTES,
+					m_sampleStride);
 		}
-		assert(sequence.eof());
+		totalReads = classifyReads(source, resSummary, outputFiles, "");
+		readsScanned = source.getReadsScanned();
+		stoppedEarly = source.stopped();
 	}
 
 	cerr << "Total Reads:" << totalReads << endl;
@@ -105,7 +98,17 @@ void BioBloomClassifier::filter(const vector<string> &inputFiles)
 	cerr << "Writing file: " << m_prefix + "_summary.tsv" << endl;
 
 	Dynamicofstream summaryOutput(m_prefix + "_summary.tsv");
-	summaryOutput << resSummary.getResultsSummary(totalReads);
+	if (m_sampleTolerance > 0) {
+		if (stoppedEarly) {
+			cerr << "Sampling tolerance reached after " << totalReads
+					<< " of about " << readsScanned << " reads" << endl;
+		}
+		summaryOutput
+				<< resSummary.getResultsSummary(totalReads, readsScanned,
+						stoppedEarly);
+	} else {
+		summaryOutput << resSummary.getResultsSummary(totalReads);
+	}
 	summaryOutput.close();
 	cout.flush();
 }
@@ -123,8 +126,6 @@ void BioBloomClassifier::filterPrint(const vector<string> &inputFiles,
 	//results summary object
 	ResultsManager resSummary(m_filterOrder, m_inclusive);
 
-	size_t totalReads = 0;
-
 	unordered_map<string, boost::shared_ptr<Dynamicofstream> > outputFiles;
 	boost::shared_ptr<Dynamicofstream> no_match(
 			new Dynamicofstream(
@@ -156,50 +157,22 @@ void BioBloomClassifier::filterPrint(const vector<string> &inputFiles,
 
 	cerr << "Filtering Start" << endl;
 
-	for (vector<string>::const_iterator it = inputFiles.begin();
-			it != inputFiles.end(); ++it)
-	{
-		FastaReader sequence(it->c_str(), FastaReader::NO_FOLD_CASE);
-#pragma omp parallel
-		for (FastqRecord rec;;) {
-			bool good;
-#pragma omp critical(sequence)
-			{
-				good = sequence >> rec;
-			}
-			if (good) {
-#pragma omp critical(totalReads)
-				{
-					++totalReads;
-					if (totalReads % 10000000 == 0) {
-						cerr << "Currently Reading Read Number: " << totalReads
-								<< endl;
-					}
-				}
-				unordered_map<string, bool> hits(m_filterNum);
-				double score = 0.0;
-				vector<double> scores(m_filterNum, 0.0);
-
-				//for each hashSigniture/kmer combo multi, cut up read into kmer sized used
-				for (vector<string>::const_iterator j = m_hashSigs.begin();
-						j != m_hashSigs.end(); ++j)
-				{
-					evaluateRead(rec, *j, hits, score, scores);
-				}
-
-				//Evaluate hit data and record for summary
-				const string &outputFileName = resSummary.updateSummaryData(
-						hits);
-
-				printSingle(rec, score, outputFileName);
-
-				printSingleToFile(outputFileName, rec, outputFiles, outputType,
-						score, scores);
-
-			} else
-				break;
-		}
-		assert(sequence.eof());
+	size_t totalReads = 0;
+	unsigned parsers = getParseThreads();
+	if (MappedReadSource::canMap(inputFiles)) {
+		MappedReadSource source(inputFiles, parsers,
+				parsers > 1 ? parsers * SECTIONS_PER_PARSER : 1);
+		totalReads = classifyReads(source, resSummary, outputFiles,
+				outputType);
+	} else if (parsers > 1) {
+		SplitReadSource source(inputFiles, parsers,
+				parsers * SECTIONS_PER_PARSER);
+		totalReads = classifyReads(source, resSummary, outputFiles,
+				outputType);
+	} else {
+		SingleReadSource source(inputFiles);
+		totalReads = classifyReads(source, resSummary, outputFiles,
+				outputType);
 	}
 
 	//close sorting files
@@ -227,76 +200,86 @@ void BioBloomClassifier::filterPrint(const vector<string> &inputFiles,
  */
 void BioBloomClassifier::filterPair(const string &file1, const string &file2)
 {
+	PairedReadSource source(file1, file2);
+	filterPairSource(source);
+}
 
-	//results summary object
-	ResultsManager resSummary(m_filterOrder, m_inclusive);
+/*
+ * Filters reads -> uses paired end information
+ * Assumes only one hash signature exists (load only filters with same
+ * hash functions)
+ * prints reads
+ */
+void BioBloomClassifier::filterPairPrint(const string &file1,
+		const string &file2, const string &outputType)
+{
+	PairedReadSource source(file1, file2);
+	filterPairSourcePrint(source, outputType);
+}
 
-	size_t totalReads = 0;
+/*
+ * Filters reads -> uses paired end information
+ * Assumes only one hash signature exists (load only filters with same
+ * hash functions)
+ */
+void BioBloomClassifier::filterPairBAM(const string &file)
+{
+	SamPairReadSource source(file, m_pairMemory);
+	filterPairSource(source);
+}
 
-	cerr << "Filtering Start" << "\n";
+/*
+ * Filters reads -> uses paired end information
+ * Assumes only one hash signature exists (load only filters with same
+ * hash functions)
+ * Prints reads into separate files
+ */
+void BioBloomClassifier::filterPairBAMPrint(const string &file,
+		const string &outputType)
+{
+	SamPairReadSource source(file, m_pairMemory);
+	filterPairSourcePrint(source, outputType);
+}
 
-	FastaReader sequence1(file1.c_str(), FastaReader::NO_FOLD_CASE);
-	FastaReader sequence2(file2.c_str(), FastaReader::NO_FOLD_CASE);
-#pragma omp parallel
-	for (FastqRecord rec1;;) {
-		FastqRecord rec2;
-		bool good1;
-		bool good2;
+/*
+ * Filters reads -> uses paired end information
+ * Mates are consecutive records of a single file ("-" for stdin)
+ */
+void BioBloomClassifier::filterPairInterleaved(const string &file)
+{
+	InterleavedReadSource source(file);
+	filterPairSource(source);
+}
 
-#pragma omp critical(sequence1)
-		{
-			good1 = sequence1 >> rec1;
-			good2 = sequence2 >> rec2;
-			//track read progress
-		}
+/*
+ * Filters reads -> uses paired end information
+ * Mates are consecutive records of a single file ("-" for stdin)
+ * Prints reads into separate files
+ */
+void BioBloomClassifier::filterPairInterleavedPrint(const string &file,
+		const string &outputType)
+{
+	InterleavedReadSource source(file);
+	filterPairSourcePrint(source, outputType);
+}
 
-		if (good1 && good2) {
-#pragma omp critical(totalReads)
-			{
-				++totalReads;
-				if (totalReads % 10000000 == 0) {
-					cerr << "Currently Reading Read Number: " << totalReads
-							<< endl;
-				}
-			}
+/*
+ * Classifies the read pairs of a source, writing only the summary (and
+ * the reads of the main filter to stdout)
+ */
+void BioBloomClassifier::filterPairSource(ReadSource &source)
+{
 
-			//hits results stored in hashmap of filter names and hits
-			unordered_map<string, bool> hits1(m_filterNum);
-			unordered_map<string, bool> hits2(m_filterNum);
+	//results summary object
+	ResultsManager resSummary(m_filterOrder, m_inclusive);
 
-			double score1 = 0;
-			double score2 = 0;
+	unordered_map<string, boost::shared_ptr<Dynamicofstream> > outputFiles;
 
-			vector<double> scores1(m_filterNum, 0.0);
-			vector<double> scores2(m_filterNum, 0.0);
+	//print out header info and initialize variables for summary
 
-			//for each hashSigniture/kmer combo multi, cut up read into kmer sized used
-			for (vector<string>::const_iterator j = m_hashSigs.begin();
-					j != m_hashSigs.end(); ++j)
-			{
-				string tempStr1 = rec1.id.substr(0, rec1.id.find_last_of("/"));
-				string tempStr2 = rec2.id.substr(0, rec2.id.find_last_of("/"));
-				if (tempStr1 == tempStr2) {
-					evaluateRead(rec1, *j, hits1, score1, scores1);
-					evaluateRead(rec2, *j, hits2, score2, scores2);
-				} else {
-					cerr << "Read IDs do not match" << "\n" << tempStr1 << "\n"
-							<< tempStr2 << endl;
-					exit(1);
-				}
-			}
+	cerr << "Filtering Start" << "\n";
 
-			//Evaluate hit data and record for summary and print if needed
-			printPair(rec1, rec2, score1, score2,
-					resSummary.updateSummaryData(hits1, hits2));
-		} else
-			break;
-	}
-	if (!sequence1.eof() || !sequence2.eof()) {
-		cerr
-				<< "error: eof bit not flipped. Input files may be different lengths"
-				<< endl;
-	}
+	size_t totalReads = classifyReads(source, resSummary, outputFiles, "");
 
 	cerr << "Total Reads:" << totalReads << endl;
 	cerr << "Writing file: " << m_prefix + "_summary.tsv" << endl;
@@ -308,21 +291,53 @@ void BioBloomClassifier::filterPair(const string &file1, const string &file2)
 }
 
 /*
- * Filters reads -> uses paired end information
- * Assumes only one hash signature exists (load only filters with same
- * hash functions)
- * prints reads
+ * Classifies the read pairs of a source and prints them into a pair of
+ * files per category
  */
-void BioBloomClassifier::filterPairPrint(const string &file1,
-		const string &file2, const string &outputType)
+void BioBloomClassifier::filterPairSourcePrint(ReadSource &source,
+		const string &outputType)
 {
 
 	//results summary object
 	ResultsManager resSummary(m_filterOrder, m_inclusive);
 
-	size_t totalReads = 0;
-
 	unordered_map<string, boost::shared_ptr<Dynamicofstream> > outputFiles;
+	openPairedOutputFiles(outputFiles, outputType);
+
+	//print out header info and initialize variables for summary
+	cerr << "Filtering Start" << "\n";
+
+	size_t totalReads = classifyReads(source, resSummary, outputFiles,
+			outputType);
+
+	//close sorting files
+	for (unordered_map<string, boost::shared_ptr<Dynamicofstream> >::iterator j =
+			outputFiles.begin(); j != outputFiles.end(); ++j)
+	{
+		j->second->close();
+		cerr << "File written to: "
+				<< m_prefix + "_" + j->first + "." + outputType + m_postfix
+				<< endl;
+	}
+
+	cerr << "Total Reads:" << totalReads << endl;
+	cerr << "Writing file: " << m_prefix + "_summary.tsv" << endl;
+
+	Dynamicofstream summaryOutput(m_prefix + "_summary.tsv");
+	summaryOutput << resSummary.getResultsSummary(totalReads);
+	summaryOutput.close();
+	cout.flush();
+}
+
+//helper methods
+
+/*
+ * Opens the _1 and _2 output files of every category for paired reads
+ */
+void BioBloomClassifier::openPairedOutputFiles(
+		unordered_map<string, boost::shared_ptr<Dynamicofstream> > &outputFiles,
+		const string &outputType)
+{
 	boost::shared_ptr<Dynamicofstream> noMatch1(
 			new Dynamicofstream(
 					m_prefix + "_" + NO_MATCH + "_1." + outputType
@@ -364,346 +379,494 @@ void BioBloomClassifier::filterPairPrint(const string &file1,
 			outputFiles[*i + "2"] = temp2;
 		}
 	}
+}
 
-	//for output files in consistent order
+/*
+ * Number of threads used to parse input that can be split into sections
+ * (there must be at least one thread left to classify and one to write)
+ */
+unsigned BioBloomClassifier::getParseThreads() const
+{
+	int threads = 1;
+#if _OPENMP
+	threads = omp_get_max_threads();
+#endif
+	//sections are parsed in any order, so only one parser keeps input order
+	if (threads < 3 || m_keepOrder) {
+		return 1;
+	}
+	unsigned parsers = m_parseThreads;
+	if (parsers == 0) {
+		parsers = (threads + THREADS_PER_PARSER - 1) / THREADS_PER_PARSER;
+	}
+	return min(parsers, unsigned(threads - 2));
+}
 
-	cerr << "Filtering Start" << "\n";
+/*
+ * Prints the usage statistics of a pipeline queue
+ */
+static void printQueueStats(const string &name,
+		const BoundedQueue<ReadBatch*> &queue)
+{
+	cerr << name << "\t" << queue.capacity() << "\t" << queue.getMaxDepth()
+			<< "\t" << queue.getPushStalls() << "\t"
+			<< queue.getPushStallSeconds() << "\t" << queue.getPopStalls()
+			<< "\t" << queue.getPopStallSeconds() << "\n";
+}
 
-	FastaReader sequence1(file1.c_str(), FastaReader::NO_FOLD_CASE);
-	FastaReader sequence2(file2.c_str(), FastaReader::NO_FOLD_CASE);
-#pragma omp parallel
-	for (FastqRecord rec1;;) {
-		FastqRecord rec2;
-		bool good1;
-		bool good2;
+/*
+ * Classifies all reads of a source and prints them
+ * (outputType is empty if reads should not be printed to files)
+ *
+ * With 3 or more threads this runs as a pipeline: one thread (or more, if the
+ * source can be split) parses batches of reads, one writes classified
+ * batches and the rest classify. Stages
+ * pass batches through bounded lock-free queues, and the free list of
+ * batches limits how far the parser can get ahead of the writer.
+ * With fewer threads every thread parses, classifies and writes its own
+ * batches in turn.
+ * If input order is kept, batches are numbered when parsed and written in
+ * that order; batches that finish early wait in a reorder buffer, which is
+ * bounded by the number of batches in flight.
+ *
+ * Returns the number of reads (or pairs) classified
+ */
+size_t BioBloomClassifier::classifyReads(ReadSource &source,
+		ResultsManager &resSummary,
+		unordered_map<string, boost::shared_ptr<Dynamicofstream> > &outputFiles,
+		const string &outputType)
+{
+	size_t totalReads = 0;
+	int threads = 1;
+#if _OPENMP
+	threads = omp_get_max_threads();
+#endif
 
-#pragma omp critical(sequence1)
+	//output files in the order of the buffers of a batch
+	vector<boost::shared_ptr<Dynamicofstream> > outputStreams;
+	if (!outputType.empty()) {
+		vector<string> categories(m_filterOrder);
+		categories.push_back(MULTI_MATCH);
+		categories.push_back(NO_MATCH);
+		for (vector<string>::const_iterator i = categories.begin();
+				i != categories.end(); ++i)
 		{
-			good1 = sequence1 >> rec1;
-			good2 = sequence2 >> rec2;
+			if (source.isPaired()) {
+				outputStreams.push_back(outputFiles[*i + "1"]);
+				outputStreams.push_back(outputFiles[*i + "2"]);
+			} else {
+				outputStreams.push_back(outputFiles[*i]);
+			}
 		}
+	}
 
-		if (good1 && good2) {
-#pragma omp critical(totalReads)
-			{
-				++totalReads;
-				if (totalReads % 10000000 == 0) {
-					cerr << "Currently Reading Read Number: " << totalReads
-							<< endl;
+	if (m_labels) {
+		openLabels(source.isPaired());
+	}
+
+	//sequence number of the next batch parsed and the next one to write
+	size_t parsedSequence = 0;
+	volatile size_t writeSequence = 0;
+	size_t parsedReads = 0;
+
+	if (threads < 3) {
+#pragma omp parallel
+		{
+			ReadBatch batch(READ_BATCH_SIZE, source.isPaired());
+			ResultsManager batchSummary(m_filterOrder, m_inclusive);
+			vector<DustMasker> dust = createDustMaskers();
+			for (;;) {
+#pragma omp critical(source)
+				{
+					source.read(batch);
+					batch.sequence = parsedSequence++;
+					batch.firstRead = parsedReads;
+					parsedReads += batch.count;
+				}
+				if (batch.count == 0) {
+					break;
 				}
+				classifyBatch(batch, source, resSummary, batchSummary, dust,
+						totalReads, outputType);
+				//wait for the batches parsed before this one to be written
+				while (m_keepOrder && writeSequence != batch.sequence) {
+					sched_yield();
+				}
+#pragma omp critical(output)
+				writeBatch(batch, outputStreams);
+				__sync_synchronize();
+				writeSequence = batch.sequence + 1;
 			}
+		}
+		closeLabels();
+		return totalReads;
+	}
 
-			//hits results stored in hashmap of filter names and hits
-			unordered_map<string, bool> hits1(m_filterNum);
-			unordered_map<string, bool> hits2(m_filterNum);
+	int parsers = source.getParserNum();
+	int workers = threads - parsers - 1;
+	assert(workers > 0);
+	size_t batchNum = PIPELINE_BATCHES_PER_THREAD * (parsers + workers);
+	vector<boost::shared_ptr<ReadBatch> > batches;
+	BoundedQueue<ReadBatch*> freeBatches(batchNum);
+	BoundedQueue<ReadBatch*> parsedBatches(batchNum);
+	BoundedQueue<ReadBatch*> classifiedBatches(batchNum);
+	for (size_t i = 0; i < batchNum; ++i) {
+		batches.push_back(
+				boost::shared_ptr<ReadBatch>(
+						new ReadBatch(READ_BATCH_SIZE, source.isPaired())));
+		freeBatches.push(batches.back().get());
+	}
+	int activeParsers = parsers;
+	int activeWorkers = workers;
+
+#pragma omp parallel num_threads(threads)
+	{
+#if _OPENMP
+		int role = omp_get_thread_num();
+		if (omp_get_num_threads() != threads) {
+#pragma omp critical(cerr)
+			cerr << "Error: could only start " << omp_get_num_threads()
+					<< " of " << threads << " threads" << endl;
+			exit(1);
+		}
+#else
+		int role = 0;
+#endif
+		ReadBatch *batch;
+		if (role < parsers) {
+			//parser
+			while (freeBatches.pop(batch)) {
+				if (source.read(*batch) == 0) {
+					freeBatches.push(batch);
+					break;
+				}
+				batch->sequence = __sync_fetch_and_add(&parsedSequence, 1);
+				batch->firstRead = __sync_fetch_and_add(&parsedReads,
+						batch->count);
+				parsedBatches.push(batch);
+			}
+			if (__sync_sub_and_fetch(&activeParsers, 1) == 0) {
+				parsedBatches.close();
+			}
+		} else if (role == parsers) {
+			//writer
+			map<size_t, ReadBatch*> reorderBuffer;
+			while (classifiedBatches.pop(batch)) {
+				if (m_keepOrder) {
+					reorderBuffer[batch->sequence] = batch;
+					while (!reorderBuffer.empty()
+							&& reorderBuffer.begin()->first == writeSequence)
+					{
+						batch = reorderBuffer.begin()->second;
+						reorderBuffer.erase(reorderBuffer.begin());
+						writeBatch(*batch, outputStreams);
+						freeBatches.push(batch);
+						++writeSequence;
+					}
+				} else {
+					writeBatch(*batch, outputStreams);
+					freeBatches.push(batch);
+				}
+			}
+			assert(reorderBuffer.empty());
+		} else {
+			//classifier
+			ResultsManager batchSummary(m_filterOrder, m_inclusive);
+			vector<DustMasker> dust = createDustMaskers();
+			while (parsedBatches.pop(batch)) {
+				classifyBatch(*batch, source, resSummary, batchSummary, dust,
+						totalReads, outputType);
+				classifiedBatches.push(batch);
+			}
+			if (__sync_sub_and_fetch(&activeWorkers, 1) == 0) {
+				classifiedBatches.close();
+			}
+		}
+	}
+
+	if (m_pipelineStats) {
+		cerr << "Pipeline: " << parsers << " parsers, " << workers
+				<< " classifiers, 1 writer, "
+				<< batchNum << " batches of " << READ_BATCH_SIZE << " reads\n"
+				<< "queue\tcapacity\tmax_depth\tpush_stalls\tpush_stall_s"
+				<< "\tpop_stalls\tpop_stall_s\n";
+		printQueueStats("free", freeBatches);
+		printQueueStats("parsed", parsedBatches);
+		printQueueStats("classified", classifiedBatches);
+		cerr.flush();
+	}
+	closeLabels();
+	return totalReads;
+}
+
+/*
+ * Classifies every read (or pair) of a batch, adding the results to the
+ * summary and formatting the reads into the output buffers of the batch
+ */
+void BioBloomClassifier::classifyBatch(ReadBatch &batch, ReadSource &source,
+		ResultsManager &resSummary, ResultsManager &batchSummary,
+		vector<DustMasker> &dust, size_t &totalReads,
+		const string &outputType)
+{
+	bool paired = source.isPaired();
+	batch.outputs.resize(m_categoryIndex.size() * (paired ? 2 : 1));
+	vector<double> scores1(m_filterNum, 0.0);
+	vector<double> scores2(m_filterNum, 0.0);
+	for (size_t i = 0; i < batch.count; ++i) {
+		const ReadView &rec1 = batch.views1[i];
+		scores1.assign(m_filterNum, 0.0);
+
+		//hits results stored in hashmap of filter names and hits
+		unordered_map<string, bool> hits1(m_filterNum);
+		double score1 = 0;
+
+		string maskedSeq1;
+		ReadView masked1;
+		const ReadView &evalRec1 = maskRead(rec1, maskedSeq1, masked1);
+
+		if (paired) {
+			const ReadView &rec2 = batch.views2[i];
+			scores2.assign(m_filterNum, 0.0);
 
-			double score1 = 0;
+			unordered_map<string, bool> hits2(m_filterNum);
 			double score2 = 0;
 
-			vector<double> scores1(m_filterNum, 0.0);
-			vector<double> scores2(m_filterNum, 0.0);
+			string maskedSeq2;
+			ReadView masked2;
+			const ReadView &evalRec2 = maskRead(rec2, maskedSeq2, masked2);
 
 			//for each hashSigniture/kmer combo multi, cut up read into kmer sized used
 			for (vector<string>::const_iterator j = m_hashSigs.begin();
 					j != m_hashSigs.end(); ++j)
 			{
-				string tempStr1 = rec1.id.substr(0, rec1.id.find_last_of("/"));
-				string tempStr2 = rec2.id.substr(0, rec2.id.find_last_of("/"));
-				if (tempStr1 == tempStr2) {
-					evaluateRead(rec1, *j, hits1, score1, scores1);
-					evaluateRead(rec2, *j, hits2, score2, scores2);
-				} else {
-					cerr << "Read IDs do not match" << "\n" << tempStr1 << "\n"
-							<< tempStr2 << endl;
-					exit(1);
-				}
+				evaluatePair(evalRec1, evalRec2, *j, hits1, hits2, score1,
+						score2, scores1, scores2,
+						dust.empty() ? NULL : &dust[j - m_hashSigs.begin()]);
 			}
 
 			//Evaluate hit data and record for summary
-
-			const string &outputFileName = resSummary.updateSummaryData(hits1,
+			const string filterID = batchSummary.updateSummaryData(hits1,
 					hits2);
-			printPair(rec1, rec2, score1, score2, outputFileName);
-			printPairToFile(outputFileName, rec1, rec2, outputFiles, outputType,
-					score1, score2, scores1, scores2 );
-		} else
-			break;
-	}
-	if (!sequence1.eof() || !sequence2.eof()) {
-		cerr
-				<< "error: eof bit not flipped. Input files may be different lengths"
-				<< endl;
-	}
+			if (m_labelFile != NULL) {
+				appendLabel(batch, i, hits1, &hits2, scores1, scores2);
+			}
+			formatBatchRead(batch, outputType, filterID, rec1, score1,
+					scores1, 1);
+			formatBatchRead(batch, outputType, filterID, rec2, score2,
+					scores2, 2);
+		} else {
+			//for each hashSigniture/kmer combo multi, cut up read into kmer sized used
+			for (vector<string>::const_iterator j = m_hashSigs.begin();
+					j != m_hashSigs.end(); ++j)
+			{
+				evaluateRead(evalRec1, *j, hits1, score1, scores1,
+						dust.empty() ? NULL : &dust[j - m_hashSigs.begin()]);
+			}
 
-	//close sorting files
-	for (unordered_map<string, boost::shared_ptr<Dynamicofstream> >::iterator j =
-			outputFiles.begin(); j != outputFiles.end(); ++j)
+			//Evaluate hit data and record for summary
+			const string filterID = batchSummary.updateSummaryData(hits1);
+			if (m_labelFile != NULL) {
+				appendLabel(batch, i, hits1, NULL, scores1, scores1);
+			}
+			formatBatchRead(batch, outputType, filterID, rec1, score1,
+					scores1, 0);
+		}
+	}
+	size_t readNum = addToTotalReads(totalReads, batch.count);
+
+	//check if composition estimate is precise enough after each block,
+	//under the same lock as the counts are added so they are consistent
+	bool checkSample = m_sampleTolerance > 0
+			&& readNum / SAMPLE_BLOCK_SIZE
+					!= (readNum + batch.count) / SAMPLE_BLOCK_SIZE;
+	bool withinTolerance = false;
+#pragma omp critical(summary)
 	{
-		j->second->close();
-		cerr << "File written to: "
-				<< m_prefix + "_" + j->first + "." + outputType + m_postfix
-				<< endl;
+		resSummary.addSummaryData(batchSummary);
+		withinTolerance = checkSample
+				&& resSummary.withinTolerance(m_sampleTolerance);
+	}
+	if (withinTolerance) {
+		source.stop();
 	}
-
-	cerr << "Total Reads:" << totalReads << endl;
-	cerr << "Writing file: " << m_prefix + "_summary.tsv" << endl;
-
-	Dynamicofstream summaryOutput(m_prefix + "_summary.tsv");
-	summaryOutput << resSummary.getResultsSummary(totalReads);
-	summaryOutput.close();
-	cout.flush();
 }
 
 /*
- * Filters reads -> uses paired end information
- * Assumes only one hash signature exists (load only filters with same
- * hash functions)
+ * Returns a DUST masker for the k-mer size of each hash signature (in the
+ * order of m_hashSigs) for a classifier thread to reuse from read to read,
+ * or none if low complexity reads are not skipped
  */
-void BioBloomClassifier::filterPairBAM(const string &file)
+vector<DustMasker> BioBloomClassifier::createDustMaskers() const
 {
-
-	//results summary object
-	ResultsManager resSummary(m_filterOrder, m_inclusive);
-
-	unordered_map<string, FastqRecord> unPairedReads;
-
-	size_t totalReads = 0;
-
-	//print out header info and initialize variables for summary
-
-	cerr << "Filtering Start" << "\n";
-
-	FastaReader sequence(file.c_str(), FastaReader::NO_FOLD_CASE);
-#pragma omp parallel
-	for (FastqRecord rec;;) {
-		bool good;
-		bool pairfound;
-		FastqRecord rec1;
-		FastqRecord rec2;
-#pragma omp critical(unPairedReads)
+	vector<DustMasker> dust;
+	if (m_dustThreshold > 0) {
+		for (vector<string>::const_iterator i = m_hashSigs.begin();
+				i != m_hashSigs.end(); ++i)
 		{
-			good = sequence >> rec;
-			//track read progress
-			if (good) {
-				string readID = rec.id.substr(0, rec.id.length() - 2);
-				if (unPairedReads.find(readID) != unPairedReads.end()) {
-					rec1 = rec.id.at(rec.id.length() - 1) == '1' ?
-							rec : unPairedReads[readID];
-					rec2 = rec.id.at(rec.id.length() - 1) == '2' ?
-							rec : unPairedReads[readID];
-					pairfound = true;
-					unPairedReads.erase(readID);
-				} else {
-					pairfound = false;
-					unPairedReads[readID] = rec;
-				}
-			}
+			dust.push_back(
+					DustMasker(m_infoFiles.at(*i).front()->getKmerSize(),
+							m_dustThreshold));
 		}
-
-		if (good) {
-			if (pairfound) {
-#pragma omp critical(totalReads)
-				{
-					++totalReads;
-					if (totalReads % 10000000 == 0) {
-						cerr << "Currently Reading Read Number: " << totalReads
-								<< endl;
-					}
-				}
-
-				unordered_map<string, bool> hits1(m_filterNum);
-				unordered_map<string, bool> hits2(m_filterNum);
-
-				double score1 = 0;
-				double score2 = 0;
-
-				vector<double> scores1(m_filterNum, 0.0);
-				vector<double> scores2(m_filterNum, 0.0);
-
-				//for each hashSigniture/kmer combo multi, cut up read into kmer sized used
-				for (vector<string>::const_iterator j = m_hashSigs.begin();
-						j != m_hashSigs.end(); ++j)
-				{
-					evaluateRead(rec1, *j, hits1, score1, scores1);
-					evaluateRead(rec2, *j, hits2, score2, scores2);
-				}
-
-				//Evaluate hit data and record for summary
-				printPair(rec1, rec2, score1, score2,
-						resSummary.updateSummaryData(hits1, hits2));
-			}
-		} else
-			break;
 	}
-	assert(sequence.eof());
-
-	cerr << "Total Reads:" << totalReads << endl;
-	cerr << "Writing file: " << m_prefix + "_summary.tsv" << endl;
-
-	Dynamicofstream summaryOutput(m_prefix + "_summary.tsv");
-	summaryOutput << resSummary.getResultsSummary(totalReads);
-	summaryOutput.close();
-	cout.flush();
+	return dust;
 }
 
 /*
- * Filters reads -> uses paired end information
- * Assumes only one hash signature exists (load only filters with same
- * hash functions)
- * Prints reads into separate files
+ * Appends a classified read to the stdout buffer (if it is in the main
+ * filter) and to the buffer of its category
+ * mate is 0 for single end reads, otherwise 1 or 2
  */
-void BioBloomClassifier::filterPairBAMPrint(const string &file,
-		const string &outputType)
+void BioBloomClassifier::formatBatchRead(ReadBatch &batch,
+		const string &outputType, const string &filterID,
+		const ReadView &rec, double score, const vector<double> &scores,
+		unsigned mate)
 {
+	if (m_mainFilter == filterID) {
+		formatMainRead(batch.mainOutput, rec, score);
+	}
+	if (!outputType.empty()) {
+		unsigned index = m_categoryIndex.find(filterID)->second;
+		if (mate > 0) {
+			index = index * 2 + mate - 1;
+		}
+		formatRead(batch.outputs[index], rec, outputType, filterID, score,
+				scores);
+	}
+}
 
-	//results summary object
-	ResultsManager resSummary(m_filterOrder, m_inclusive);
-
-	unordered_map<string, FastqRecord> unPairedReads;
-
-	size_t totalReads = 0;
-
-	unordered_map<string, boost::shared_ptr<Dynamicofstream> > outputFiles;
-	boost::shared_ptr<Dynamicofstream> noMatch1(
-			new Dynamicofstream(
-					m_prefix + "_" + NO_MATCH + "_1." + outputType
-							+ m_postfix));
-	boost::shared_ptr<Dynamicofstream> noMatch2(
-			new Dynamicofstream(
-					m_prefix + "_" + NO_MATCH + "_2." + outputType
-							+ m_postfix));
-	boost::shared_ptr<Dynamicofstream> multiMatch1(
-			new Dynamicofstream(
-					m_prefix + "_" + MULTI_MATCH + "_1." + outputType
-							+ m_postfix));
-	boost::shared_ptr<Dynamicofstream> multiMatch2(
-			new Dynamicofstream(
-					m_prefix + "_" + MULTI_MATCH + "_2." + outputType
-							+ m_postfix));
-	outputFiles[NO_MATCH + "1"] = noMatch1;
-	outputFiles[NO_MATCH + "2"] = noMatch2;
-	outputFiles[MULTI_MATCH + "1"] = multiMatch1;
-	outputFiles[MULTI_MATCH + "2"] = multiMatch2;
-
-	//initialize variables and print filter ids
-	for (vector<string>::const_iterator j = m_hashSigs.begin();
-			j != m_hashSigs.end(); ++j)
-	{
-		const vector<string> idsInFilter = (*m_filters[*j]).getFilterIds();
-		for (vector<string>::const_iterator i = idsInFilter.begin();
-				i != idsInFilter.end(); ++i)
+/*
+ * Writes the output buffers of a classified batch to stdout and the output
+ * files, one block per file, and empties them
+ * Only one thread may write at a time
+ */
+void BioBloomClassifier::writeBatch(ReadBatch &batch,
+		const vector<boost::shared_ptr<Dynamicofstream> > &outputStreams)
+{
+	if (!batch.mainOutput.empty()) {
+		cout.write(batch.mainOutput.data(), batch.mainOutput.size());
+		batch.mainOutput.clear();
+	}
+	for (size_t i = 0; i < outputStreams.size(); ++i) {
+		if (!batch.outputs[i].empty()) {
+			outputStreams[i]->write(batch.outputs[i]);
+			batch.outputs[i].clear();
+		}
+	}
+	if (!batch.labels.empty()) {
+		if (fwrite(batch.labels.data(), 1, batch.labels.size(), m_labelFile)
+				!= batch.labels.size())
 		{
-			boost::shared_ptr<Dynamicofstream> temp1(
-					new Dynamicofstream(
-							m_prefix + "_" + *i + "_1." + outputType
-									+ m_postfix));
-			boost::shared_ptr<Dynamicofstream> temp2(
-					new Dynamicofstream(
-							m_prefix + "_" + *i + "_2." + outputType
-									+ m_postfix));
-			outputFiles[*i + "1"] = temp1;
-			outputFiles[*i + "2"] = temp2;
+			cerr << "Error: could not write " << m_prefix << "_labels.bin"
+					<< endl;
+			exit(1);
 		}
+		batch.labels.clear();
 	}
+}
 
-	//print out header info and initialize variables for summary
-	cerr << "Filtering Start" << "\n";
-
-	FastaReader sequence(file.c_str(), FastaReader::NO_FOLD_CASE);
-#pragma omp parallel
-	for (FastqRecord rec;;) {
-		bool good;
-		bool pairfound = false;
-		FastqRecord rec1;
-		FastqRecord rec2;
-#pragma omp critical(unPairedReads)
+/*
+ * Creates the label file and writes its header
+ * Scores are stored in scores mode (-w) with a single set of hash functions
+ */
+void BioBloomClassifier::openLabels(bool paired)
+{
+	string path = m_prefix + "_labels.bin";
+	m_labelFile = fopen(path.c_str(), "wb");
+	if (m_labelFile == NULL) {
+		cerr << "Error: could not open " << path << endl;
+		exit(1);
+	}
+	setvbuf(m_labelFile, NULL, _IOFBF, LABEL_BUFFER_SIZE);
+
+	m_labelHeader.filterIDs = m_filterOrder;
+	m_labelHeader.mates = paired ? 2 : 1;
+	m_labelHeader.scores = m_mode == SCORES && m_hashSigs.size() == 1;
+	if (m_labelHeader.scores) {
+		const vector<string> &idsInFilter =
+				m_filters[m_hashSigs.front()]->getFilterIds();
+		m_scoreIndex.clear();
+		for (vector<string>::const_iterator i = m_filterOrder.begin();
+				i != m_filterOrder.end(); ++i)
 		{
-			good = sequence >> rec;
-			//track read progress
-			if (good) {
-				string readID = rec.id.substr(0, rec.id.length() - 2);
-				if (unPairedReads.find(readID) != unPairedReads.end()) {
-					rec1 = rec.id.at(rec.id.length() - 1) == '1' ?
-							rec : unPairedReads[readID];
-					rec2 = rec.id.at(rec.id.length() - 1) == '2' ?
-							rec : unPairedReads[readID];
-					pairfound = true;
-					unPairedReads.erase(readID);
-				} else {
-					unPairedReads[readID] = rec;
-				}
-			}
+			m_scoreIndex.push_back(
+					find(idsInFilter.begin(), idsInFilter.end(), *i)
+							- idsInFilter.begin());
 		}
-		if (good) {
-			if (pairfound) {
-#pragma omp critical(totalReads)
-				{
-					++totalReads;
-					if (totalReads % 10000000 == 0) {
-						cerr << "Currently Reading Read Number: " << totalReads
-								<< endl;
-					}
-				}
-
-				unordered_map<string, bool> hits1(m_filterNum);
-				unordered_map<string, bool> hits2(m_filterNum);
-
-				double score1 = 0;
-				double score2 = 0;
-
-				vector<double> scores1(m_filterNum, 0.0);
-				vector<double> scores2(m_filterNum, 0.0);
-
-				//for each hashSigniture/kmer combo multi, cut up read into kmer sized used
-				for (vector<string>::const_iterator j = m_hashSigs.begin();
-						j != m_hashSigs.end(); ++j)
-				{
-					string tempStr1 = rec1.id.substr(0,
-							rec1.id.find_last_of("/"));
-					string tempStr2 = rec2.id.substr(0,
-							rec2.id.find_last_of("/"));
-					if (tempStr1 == tempStr2) {
-						evaluateRead(rec1, *j, hits1, score1, scores1);
-						evaluateRead(rec2, *j, hits2, score2, scores2);
-					} else {
-						cerr << "Read IDs do not match" << "\n" << tempStr1
-								<< "\n" << tempStr2 << endl;
-						exit(1);
-					}
-				}
-
-				//Evaluate hit data and record for summary
-				const string &outputFileName = resSummary.updateSummaryData(
-						hits1, hits2);
-				printPairToFile(outputFileName, rec1, rec2, outputFiles,
-						outputType, score1, score2, scores1, scores2);
-				printPair(rec1, rec2, score1, score2, outputFileName);
-			}
-		} else
-			break;
 	}
-	assert(sequence.eof());
+	if (!m_labelHeader.write(m_labelFile)) {
+		cerr << "Error: could not write " << path << endl;
+		exit(1);
+	}
+}
 
-	//close sorting files
-	for (unordered_map<string, boost::shared_ptr<Dynamicofstream> >::iterator j =
-			outputFiles.begin(); j != outputFiles.end(); ++j)
-	{
-		j->second->close();
-		cerr << "File written to: "
-				<< m_prefix + "_" + j->first + "." + outputType + m_postfix
+void BioBloomClassifier::closeLabels()
+{
+	if (m_labelFile == NULL) {
+		return;
+	}
+	if (fclose(m_labelFile) != 0) {
+		cerr << "Error: could not write " << m_prefix << "_labels.bin"
 				<< endl;
+		exit(1);
 	}
+	m_labelFile = NULL;
+	cerr << "File written to: " << m_prefix << "_labels.bin" << endl;
+}
 
-	cerr << "Total Reads:" << totalReads << endl;
-	cerr << "Writing file: " << m_prefix + "_summary.tsv" << endl;
-
-	Dynamicofstream summaryOutput(m_prefix + "_summary.tsv");
-	summaryOutput << resSummary.getResultsSummary(totalReads);
-	summaryOutput.close();
-	cout.flush();
+/*
+ * Appends the label record of a read (or pair if hits2 is given) to the
+ * batch: its ordinal, the filters it is assigned to and its scores
+ */
+void BioBloomClassifier::appendLabel(ReadBatch &batch, size_t index,
+		const unordered_map<string, bool> &hits1,
+		const unordered_map<string, bool> *hits2,
+		const vector<double> &scores1, const vector<double> &scores2) const
+{
+	uint64_t ordinal = batch.firstRead + index;
+	batch.labels.append(reinterpret_cast<const char*>(&ordinal),
+			sizeof(ordinal));
+	size_t mask = batch.labels.size();
+	batch.labels.append(m_labelHeader.maskBytes(), '\0');
+	for (size_t j = 0; j < m_filterOrder.size(); ++j) {
+		const string &id = m_filterOrder[j];
+		bool hit = hits1.at(id);
+		if (hits2 != NULL) {
+			//same rule as the summary
+			hit = m_inclusive ? hit || hits2->at(id) : hit && hits2->at(id);
+		}
+		if (hit) {
+			batch.labels[mask + j / 8] |= char(1 << (j % 8));
+		}
+	}
+	if (m_labelHeader.scores) {
+		for (size_t j = 0; j < m_scoreIndex.size(); ++j) {
+			batch.labels += char(quantizeScore(scores1[m_scoreIndex[j]]));
+		}
+		if (hits2 != NULL) {
+			for (size_t j = 0; j < m_scoreIndex.size(); ++j) {
+				batch.labels += char(
+						quantizeScore(scores2[m_scoreIndex[j]]));
+			}
+		}
+	}
 }
 
-//helper methods
+/*
+ * Adds a batch of reads to the shared read count, reporting progress every
+ * 10 million reads
+ * Returns the number of reads counted before this batch
+ */
+size_t BioBloomClassifier::addToTotalReads(size_t &totalReads,
+		size_t batchSize) const
+{
+	size_t readNum = __sync_fetch_and_add(&totalReads, batchSize);
+	if (readNum / 10000000 != (readNum + batchSize) / 10000000) {
+#pragma omp critical(cerr)
+		cerr << "Currently Reading Read Number: "
+				<< (readNum + batchSize) / 10000000 * 10000000 << endl;
+	}
+	return readNum;
+}
 
 /*
  * Loads list of filters into memory
@@ -777,7 +940,7 @@ bool BioBloomClassifier::fexists(const string &filename) const
  * Collaborative filtering method
  * Assume filters use the same k-mer size
  */
-void BioBloomClassifier::evaluateReadCollab(const FastqRecord &rec,
+void BioBloomClassifier::evaluateReadCollab(const ReadView &rec,
 		const string &hashSig, unordered_map<string, bool> &hits)
 {
 	//get filterIDs to iterate through has in a consistent order
@@ -799,7 +962,7 @@ void BioBloomClassifier::evaluateReadCollab(const FastqRecord &rec,
 		size_t screeningLoc = rec.seq.length() % kmerSize / 2;
 		//First pass filtering
 		while (rec.seq.length() >= screeningLoc + kmerSize) {
-			const unsigned char* currentKmer = proc.prepSeq(rec.seq,
+			const unsigned char* currentKmer = proc.prepSeq(rec.seq.data(),
 					screeningLoc);
 			if (currentKmer != NULL) {
 				if (m_filtersSingle.at(*i)->contains(currentKmer)) {
@@ -835,12 +998,20 @@ void BioBloomClassifier::evaluateReadCollab(const FastqRecord &rec,
  * Updates hits value to number of hits (hashSig is used to as key)
  * Faster variant that assume there a redundant tile of 0
  */
-void BioBloomClassifier::evaluateReadMin(const FastqRecord &rec,
+void BioBloomClassifier::evaluateReadMin(const ReadView &rec,
 		const string &hashSig, unordered_map<string, bool> &hits)
 {
 	//get filterIDs to iterate through has in a consistent order
-	const vector<string> &idsInFilter = (*m_filters[hashSig]).getFilterIds();
+	evaluateReadMin(rec, hashSig, hits, (*m_filters[hashSig]).getFilterIds());
+}
 
+/*
+ * Variant only evaluating the filters given
+ */
+void BioBloomClassifier::evaluateReadMin(const ReadView &rec,
+		const string &hashSig, unordered_map<string, bool> &hits,
+		const vector<string> &idsInFilter)
+{
 	//get kmersize for set of info files
 	unsigned kmerSize = m_infoFiles.at(hashSig).front()->getKmerSize();
 
@@ -860,14 +1031,14 @@ void BioBloomClassifier::evaluateReadMin(const FastqRecord &rec,
 	//cut read into kmer size given
 	while (rec.seq.length() >= (currentKmerNum + 1) * kmerSize) {
 
-		const unsigned char* currentKmer = proc.prepSeq(rec.seq,
+		const unsigned char* currentKmer = proc.prepSeq(rec.seq.data(),
 				currentKmerNum * kmerSize + startModifier1);
 
 		//check to see if string is invalid
 		if (currentKmer != NULL) {
 
 			const unordered_map<string, bool> &results =
-					m_filters[hashSig]->multiContains(currentKmer);
+					m_filters[hashSig]->multiContains(currentKmer, idsInFilter);
 
 			//record hit number in order
 			for (vector<string>::const_iterator i = idsInFilter.begin();
@@ -891,13 +1062,20 @@ void BioBloomClassifier::evaluateReadMin(const FastqRecord &rec,
  * For a single read evaluate hits for a single hash signature
  * Sections with ambiguity bases are treated as misses
  */
-void BioBloomClassifier::evaluateReadStd(const FastqRecord &rec,
+void BioBloomClassifier::evaluateReadStd(const ReadView &rec,
 		const string &hashSig, unordered_map<string, bool> &hits)
 {
-
 	//get filterIDs to iterate through has in a consistent order
-	const vector<string> &idsInFilter = (*m_filters[hashSig]).getFilterIds();
+	evaluateReadStd(rec, hashSig, hits, (*m_filters[hashSig]).getFilterIds());
+}
 
+/*
+ * Variant only evaluating the filters given
+ */
+void BioBloomClassifier::evaluateReadStd(const ReadView &rec,
+		const string &hashSig, unordered_map<string, bool> &hits,
+		const vector<string> &idsInFilter)
+{
 	unsigned kmerSize = m_infoFiles.at(hashSig).front()->getKmerSize();
 
 	//todo: read proc possibly unneeded, see evalSingle
@@ -917,7 +1095,7 @@ void BioBloomClassifier::evaluateReadStd(const FastqRecord &rec,
 			size_t screeningLoc = rec.seq.length() % kmerSize / 2;
 			//First pass filtering
 			while (rec.seq.length() >= screeningLoc + kmerSize) {
-				const unsigned char* currentKmer = proc.prepSeq(rec.seq,
+				const unsigned char* currentKmer = proc.prepSeq(rec.seq.data(),
 						screeningLoc);
 				if (currentKmer != NULL) {
 					if (m_filtersSingle.at(*i)->contains(currentKmer)) {
@@ -945,7 +1123,7 @@ void BioBloomClassifier::evaluateReadStd(const FastqRecord &rec,
  * Sections with ambiguity bases are treated as misses
  * Reads are assigned to best hit
  */
-double BioBloomClassifier::evaluateReadBestHit(const FastqRecord &rec,
+double BioBloomClassifier::evaluateReadBestHit(const ReadView &rec,
 		const string &hashSig, unordered_map<string, bool> &hits)
 {
 	//get filterIDs to iterate through has in a consistent order
@@ -966,7 +1144,7 @@ double BioBloomClassifier::evaluateReadBestHit(const FastqRecord &rec,
 			size_t screeningLoc = rec.seq.length() % kmerSize / 2;
 			//First pass filtering
 			while (rec.seq.length() >= screeningLoc + kmerSize) {
-				const unsigned char* currentKmer = proc.prepSeq(rec.seq,
+				const unsigned char* currentKmer = proc.prepSeq(rec.seq.data(),
 						screeningLoc);
 				if (currentKmer != NULL) {
 					if (m_filtersSingle.at(idsInFilter[i])->contains(
@@ -1010,7 +1188,7 @@ double BioBloomClassifier::evaluateReadBestHit(const FastqRecord &rec,
  * Will return scores in vector
  * Will return partial score if threshold is not met
  */
-void BioBloomClassifier::evaluateReadScore(const FastqRecord &rec,
+void BioBloomClassifier::evaluateReadScore(const ReadView &rec,
 		const string &hashSig, unordered_map<string, bool> &hits, vector<double> &scores)
 {
 	//get filterIDs to iterate through has in a consistent order
@@ -1042,7 +1220,7 @@ void BioBloomClassifier::evaluateReadScore(const FastqRecord &rec,
 			size_t screeningLoc = rec.seq.length() % kmerSize / 2;
 			//First pass filtering
 			while (rec.seq.length() >= screeningLoc + kmerSize) {
-				const unsigned char* currentKmer = proc.prepSeq(rec.seq,
+				const unsigned char* currentKmer = proc.prepSeq(rec.seq.data(),
 						screeningLoc);
 				if (currentKmer != NULL) {
 					if (m_filtersSingle.at(idsInFilter[i])->contains(
@@ -1087,7 +1265,9 @@ void BioBloomClassifier::evaluateReadScore(const FastqRecord &rec,
 
 void BioBloomClassifier::setMainFilter(const string &filtername)
 {
-	if (m_filtersSingle.find(filtername) == m_filtersSingle.end()) {
+	if (m_filtersSingle.find(filtername) == m_filtersSingle.end()
+			&& filtername != NO_MATCH && filtername != MULTI_MATCH)
+	{
 		cerr << "Filter with this name \"" << filtername
 				<< "\" does not exist\n";
 		cerr << "Valid filter Names:\n";
@@ -1096,6 +1276,7 @@ void BioBloomClassifier::setMainFilter(const string &filtername)
 		{
 			cerr << *itr << endl;
 		}
+		cerr << NO_MATCH << "\n" << MULTI_MATCH << endl;
 		exit(1);
 	}
 	m_mainFilter = filtername;
@@ -9,6 +9,7 @@
 #define BIOBLOOMCLASSIFIER_H_
 #include <vector>
 #include <string>
+#include <cstdio>
 #include "boost/unordered/unordered_map.hpp"
 #include "boost/shared_ptr.hpp"
 #include "Common/BloomFilterInfo.h"
@@ -20,6 +21,9 @@
 #include "ResultsManager.h"
 #include "Common/Dynamicofstream.h"
 #include "Common/SeqEval.h"
+#include "Common/DustMasker.h"
+#include "ReadSource.h"
+#include "LabelFile.h"
 
 using namespace std;
 using namespace boost;
@@ -27,6 +31,32 @@ using namespace boost;
 static const string NO_MATCH = "noMatch";
 static const string MULTI_MATCH = "multiMatch";
 
+/** number of reads (or pairs) each thread takes from the input at once */
+static const size_t READ_BATCH_SIZE = 4096;
+
+/** batches in flight per parser or classifier thread when pipelined */
+static const size_t PIPELINE_BATCHES_PER_THREAD = 4;
+
+/** threads per parser thread when input can be split, unless set */
+static const unsigned THREADS_PER_PARSER = 8;
+
+/** sections each file is split into per parser thread (for load balance) */
+static const unsigned SECTIONS_PER_PARSER = 4;
+
+/** memory for reads of a SAM/BAM file waiting for their mate, unless set
+ * (in MB) */
+static const size_t PAIR_MEMORY_MB = 1024;
+
+/** size of the write buffer of the label file */
+static const size_t LABEL_BUFFER_SIZE = 4 << 20;
+
+/** number of consecutive reads classified per block when sampling */
+static const size_t SAMPLE_BLOCK_SIZE = 10000;
+
+/** bytes per section of an uncompressed file when sampling, which holds
+ * about SAMPLE_BLOCK_SIZE short reads */
+static const size_t SAMPLE_SECTION_BYTES = 4 << 20;
+
 /** for modes of filtering */
 enum mode { COLLAB, MINHITONLY, BESTHIT, STD, SCORES };
 
@@ -48,6 +78,9 @@ public:
 			const string &outputType);
 	void filterPairBAM(const string &file);
 	void filterPairBAMPrint(const string &file, const string &outputType);
+	void filterPairInterleaved(const string &file);
+	void filterPairInterleavedPrint(const string &file,
+			const string &outputType);
 
 	void setCollabFilter()
 	{
@@ -67,6 +100,76 @@ public:
 
 	void setMainFilter(const string &filtername);
 
+	/*
+	 * K-mers overlapping bases below this quality are treated as ambiguous
+	 */
+	void setMinBaseQuality(unsigned minQual)
+	{
+		m_minQual = minQual;
+	}
+
+	/*
+	 * Reads with at least half of their k-mers scoring above threshold with
+	 * DUST are not evaluated
+	 */
+	void setDust(double threshold)
+	{
+		m_dustThreshold = threshold;
+	}
+
+	/*
+	 * Only classify one block of reads every stride blocks and stop
+	 * once the confidence interval of every category is below tolerance
+	 */
+	void setSampling(double tolerance, unsigned stride)
+	{
+		m_sampleTolerance = tolerance;
+		m_sampleStride = stride;
+	}
+
+	/*
+	 * Report queue depths and stall times of the pipeline stages
+	 */
+	void setPipelineStats()
+	{
+		m_pipelineStats = true;
+	}
+
+	/*
+	 * Threads used to parse single end input that can be split into sections
+	 * (0 = one per THREADS_PER_PARSER threads)
+	 */
+	void setParseThreads(unsigned parseThreads)
+	{
+		m_parseThreads = parseThreads;
+	}
+
+	/*
+	 * Write reads in the same order as the input (single parser)
+	 */
+	void setKeepOrder()
+	{
+		m_keepOrder = true;
+	}
+
+	/*
+	 * Memory for reads of a paired SAM/BAM file held until their mate is
+	 * found, beyond which they are spilled to temporary files (in bytes)
+	 */
+	void setPairMemory(size_t pairMemory)
+	{
+		m_pairMemory = pairMemory;
+	}
+
+	/*
+	 * Also write the filters hit by every read to a binary label file
+	 * (prefix_labels.bin, see LabelFile.h)
+	 */
+	void setLabels()
+	{
+		m_labels = true;
+	}
+
 	virtual ~BioBloomClassifier();
 
 private:
@@ -75,6 +178,10 @@ private:
 	unordered_map<string, boost::shared_ptr<MultiFilter> > m_filters;
 	unordered_map<string, boost::shared_ptr<BloomFilter> > m_filtersSingle;
 	vector<string> m_filterOrder;
+
+	//index of each category (filter IDs, then multi match and no match)
+	//in the output buffers of a batch
+	unordered_map<string, unsigned> m_categoryIndex;
 	vector<string> m_hashSigs;
 	double m_scoreThreshold;
 	unsigned m_filterNum;
@@ -88,214 +195,213 @@ private:
 	string m_mainFilter;
 	bool m_inclusive;
 
+	// bases under this quality are masked before evaluation (0 = off)
+	unsigned m_minQual;
+
+	// low complexity reads are not evaluated if set (0 = off)
+	double m_dustThreshold;
+
+	// composition estimation by sampling (0 = classify every read)
+	double m_sampleTolerance;
+	unsigned m_sampleStride;
+
+	bool m_pipelineStats;
+	unsigned m_parseThreads;
+	bool m_keepOrder;
+	size_t m_pairMemory;
+
+	//label file, open while reads are classified
+	bool m_labels;
+	FILE *m_labelFile;
+	LabelHeader m_labelHeader;
+	//index of the score of each filter (in filter order) in the scores
+	//of a read
+	vector<size_t> m_scoreIndex;
+
 	void loadFilters(const vector<string> &filterFilePaths);
+	void filterPairSource(ReadSource &source);
+	void filterPairSourcePrint(ReadSource &source, const string &outputType);
 	bool fexists(const string &filename) const;
-	void evaluateReadStd(const FastqRecord &rec, const string &hashSig,
+	size_t addToTotalReads(size_t &totalReads, size_t batchSize) const;
+	void openPairedOutputFiles(
+			unordered_map<string, boost::shared_ptr<Dynamicofstream> > &outputFiles,
+			const string &outputType);
+	unsigned getParseThreads() const;
+	size_t classifyReads(ReadSource &source, ResultsManager &resSummary,
+			unordered_map<string, boost::shared_ptr<Dynamicofstream> > &outputFiles,
+			const string &outputType);
+	void classifyBatch(ReadBatch &batch, ReadSource &source,
+			ResultsManager &resSummary, ResultsManager &batchSummary,
+			vector<DustMasker> &dust, size_t &totalReads,
+			const string &outputType);
+	vector<DustMasker> createDustMaskers() const;
+	void formatBatchRead(ReadBatch &batch, const string &outputType,
+			const string &filterID, const ReadView &rec, double score,
+			const vector<double> &scores, unsigned mate);
+	void writeBatch(ReadBatch &batch,
+			const vector<boost::shared_ptr<Dynamicofstream> > &outputStreams);
+	void openLabels(bool paired);
+	void closeLabels();
+	void appendLabel(ReadBatch &batch, size_t index,
+			const unordered_map<string, bool> &hits1,
+			const unordered_map<string, bool> *hits2,
+			const vector<double> &scores1, const vector<double> &scores2) const;
+	void evaluateReadStd(const ReadView &rec, const string &hashSig,
 			unordered_map<string, bool> &hits);
-	void evaluateReadMin(const FastqRecord &rec, const string &hashSig,
+	void evaluateReadStd(const ReadView &rec, const string &hashSig,
+			unordered_map<string, bool> &hits,
+			const vector<string> &idsInFilter);
+	void evaluateReadMin(const ReadView &rec, const string &hashSig,
 			unordered_map<string, bool> &hits);
-	void evaluateReadCollab(const FastqRecord &rec, const string &hashSig,
+	void evaluateReadMin(const ReadView &rec, const string &hashSig,
+			unordered_map<string, bool> &hits,
+			const vector<string> &idsInFilter);
+	void evaluateReadCollab(const ReadView &rec, const string &hashSig,
 			unordered_map<string, bool> &hits);
-	double evaluateReadBestHit(const FastqRecord &rec, const string &hashSig,
+	double evaluateReadBestHit(const ReadView &rec, const string &hashSig,
 			unordered_map<string, bool> &hits);
-	void evaluateReadScore(const FastqRecord &rec, const string &hashSig,
+	void evaluateReadScore(const ReadView &rec, const string &hashSig,
 			unordered_map<string, bool> &hits, vector<double> &scores);
 
-	inline void printSingle(const FastqRecord &rec, double score,
-			const string &filterID)
+	/*
+	 * Appends a read to an output buffer in the format of the output files
+	 * (scores are added to the header in scores and best hit modes)
+	 */
+	inline void formatRead(string &buffer, const ReadView &rec,
+			const string &outputType, const string &filterID, double score,
+			const vector<double> &scores) const
 	{
-		if (m_mainFilter == filterID) {
-			if (m_mode == BESTHIT) {
-#pragma omp critical(cout)
-				{
-					cout << "@" << rec.id << " " << score << "\n" << rec.seq
-							<< "\n+\n" << rec.qual << "\n";
-				}
-			} else {
-#pragma omp critical(cout)
-				{
-					cout << rec;
-				}
+		bool withScores = m_mode == BESTHIT
+				|| (m_mode == SCORES && filterID == MULTI_MATCH);
+		//copy the input record as is when it is already in this format
+		if (!withScores && !rec.text.empty()
+				&& rec.text[0] == (outputType == "fa" ? '>' : '@'))
+		{
+			rec.text.appendTo(buffer);
+			return;
+		}
+		buffer += outputType == "fa" ? '>' : '@';
+		rec.id.appendTo(buffer);
+		if (m_mode == SCORES && filterID == MULTI_MATCH) {
+			for (vector<double>::const_iterator i = scores.begin();
+					i != scores.end(); ++i)
+			{
+				buffer += ' ';
+				appendDouble(buffer, *i);
 			}
+		} else if (m_mode == BESTHIT) {
+			buffer += ' ';
+			appendDouble(buffer, score);
+		}
+		buffer += '\n';
+		rec.seq.appendTo(buffer);
+		if (outputType == "fa") {
+			buffer += '\n';
+		} else {
+			buffer += "\n+\n";
+			rec.qual.appendTo(buffer);
+			buffer += '\n';
 		}
 	}
 
-	inline void printSingleToFile(const string &outputFileName,
-			const FastqRecord &rec,
-			unordered_map<string, boost::shared_ptr<Dynamicofstream> > &outputFiles,
-			string const &outputType, double score, vector<double> &scores)
+	/*
+	 * Appends a read to the buffer printed to stdout (for the main filter)
+	 */
+	inline void formatMainRead(string &buffer, const ReadView &rec,
+			double score) const
 	{
-		if (outputType == "fa") {
-			if (m_mode == SCORES && outputFileName == MULTI_MATCH) {
-#pragma omp critical(outputFiles)
-				{
-					(*outputFiles[outputFileName]) << ">" << rec.id;
-					for (vector<double>::iterator i = scores.begin();
-							i != scores.end(); ++i)
-					{
-						(*outputFiles[outputFileName]) << " " << *i;
-					}
-					(*outputFiles[outputFileName]) << "\n" << rec.seq << "\n";
-				}
-			} else if (m_mode == BESTHIT) {
-#pragma omp critical(outputFiles)
-				{
-					(*outputFiles[outputFileName]) << ">" << rec.id << " "
-							<< score << "\n" << rec.seq << "\n";
-				}
-			} else {
-#pragma omp critical(outputFiles)
-				{
-					(*outputFiles[outputFileName]) << ">" << rec.id << "\n"
-							<< rec.seq << "\n";
-				}
-			}
+		if (m_mode == BESTHIT) {
+			buffer += '@';
+			rec.id.appendTo(buffer);
+			buffer += ' ';
+			appendDouble(buffer, score);
+			buffer += '\n';
+			rec.seq.appendTo(buffer);
+			buffer += "\n+\n";
+			rec.qual.appendTo(buffer);
+			buffer += '\n';
+		} else if (!rec.text.empty()) {
+			rec.text.appendTo(buffer);
 		} else {
-			if (m_mode == SCORES && outputFileName == MULTI_MATCH) {
-#pragma omp critical(outputFiles)
-				{
-					(*outputFiles[outputFileName]) << "@" << rec.id;
-					for (vector<double>::iterator i = scores.begin();
-							i != scores.end(); ++i)
-					{
-						(*outputFiles[outputFileName]) << " " << *i;
-					}
-					(*outputFiles[outputFileName]) << "\n" << rec.seq << "\n+\n"
-							<< rec.qual << "\n";
-				}
-			} else if (m_mode == BESTHIT) {
-#pragma omp critical(outputFiles)
-				{
-					(*outputFiles[outputFileName]) << "@" << rec.id << " "
-							<< score << "\n" << rec.seq << "\n+\n" << rec.qual
-							<< "\n";
-				}
+			//same as FastqRecord::operator<<
+			buffer += rec.qual.empty() ? '>' : '@';
+			rec.id.appendTo(buffer);
+			if (!rec.comment.empty()) {
+				buffer += ' ';
+				rec.comment.appendTo(buffer);
+			}
+			buffer += '\n';
+			rec.seq.appendTo(buffer);
+			if (rec.qual.empty()) {
+				buffer += '\n';
 			} else {
-#pragma omp critical(outputFiles)
-				{
-					(*outputFiles[outputFileName]) << "@" << rec.id << "\n"
-							<< rec.seq << "\n+\n" << rec.qual << "\n";
-				}
+				buffer += "\n+\n";
+				rec.qual.appendTo(buffer);
+				buffer += '\n';
 			}
 		}
 	}
 
-	inline void printPair(const FastqRecord &rec1, const FastqRecord &rec2,
-			double score1, double score2, const string &filterID)
+	/*
+	 * Appends a double formatted the same way as ostream does by default
+	 */
+	static inline void appendDouble(string &buffer, double value)
 	{
-		if (m_mainFilter == filterID) {
-			if (m_mode == BESTHIT) {
-#pragma omp critical(cout)
-				{
-					cout << "@" << rec1.id << " " << score1 << "\n" << rec1.seq
-							<< "\n+\n" << rec1.qual << "\n";
-					cout << "@" << rec2.id << " " << score2 << "\n" << rec2.seq
-							<< "\n+\n" << rec2.qual << "\n";
-				}
-			} else {
-#pragma omp critical(cout)
-				{
-					cout << rec1;
-					cout << rec2;
-				}
-			}
+		char str[32];
+		snprintf(str, sizeof(str), "%g", value);
+		buffer += str;
+	}
+
+	/*
+	 * Returns the read to evaluate, which is a view of a copy of its
+	 * sequence with low quality bases masked if quality masking is on
+	 */
+	inline const ReadView &maskRead(const ReadView &rec, string &maskedSeq,
+			ReadView &masked) const
+	{
+		if (m_minQual > 0
+				&& SeqEval::maskLowQuality(rec, maskedSeq, m_minQual))
+		{
+			masked = rec;
+			masked.seq = StringView(maskedSeq);
+			return masked;
 		}
+		return rec;
 	}
 
-	inline void printPairToFile(const string &outputFileName,
-			const FastqRecord &rec1, const FastqRecord &rec2,
-			unordered_map<string, boost::shared_ptr<Dynamicofstream> > &outputFiles,
-			string const &outputType, double score1, double score2, vector<double> &scores1, vector<double> &scores2)
+	/*
+	 * Whether a read is low complexity for the k-mer size of dust (the
+	 * masker of the thread for the hash signature evaluated, NULL if low
+	 * complexity reads are not skipped), in which case it is not evaluated
+	 * and hits none of the filters given
+	 */
+	inline bool skipLowComplexity(const ReadView &rec, DustMasker *dust,
+			unordered_map<string, bool> &hits,
+			const vector<string> &idsInFilter) const
 	{
-		if (outputType == "fa") {
-			if (m_mode == SCORES && outputFileName == MULTI_MATCH) {
-#pragma omp critical(outputFiles)
-				{
-					(*outputFiles[outputFileName]) << ">" << rec1.id;
-					for (vector<double>::iterator i = scores1.begin();
-							i != scores1.end(); ++i)
-					{
-						(*outputFiles[outputFileName]) << " " << *i;
-					}
-					(*outputFiles[outputFileName]) << "\n" << rec1.seq << "\n";
-				}
-#pragma omp critical(outputFiles)
-				{
-					(*outputFiles[outputFileName]) << ">" << rec2.id;
-					for (vector<double>::iterator i = scores2.begin();
-							i != scores2.end(); ++i)
-					{
-						(*outputFiles[outputFileName]) << " " << *i;
-					}
-					(*outputFiles[outputFileName]) << "\n" << rec2.seq << "\n";
-				}
-			} else if (m_mode == BESTHIT) {
-#pragma omp critical(outputFiles)
-				{
-					(*outputFiles[outputFileName + "1"]) << ">" << rec1.id
-							<< " " << score1 << "\n" << rec1.seq << "\n";
-					(*outputFiles[outputFileName + "2"]) << ">" << rec2.id
-							<< " " << score2 << "\n" << rec2.seq << "\n";
-				}
-			}
-			else {
-#pragma omp critical(outputFiles)
-				{
-					(*outputFiles[outputFileName + "1"]) << ">" << rec1.id
-							<< "\n" << rec1.seq << "\n";
-					(*outputFiles[outputFileName + "2"]) << ">" << rec2.id
-							<< "\n" << rec2.seq << "\n";
-				}
-			}
-		} else {
-			if (m_mode == SCORES && outputFileName == MULTI_MATCH) {
-#pragma omp critical(outputFiles)
-				{
-					(*outputFiles[outputFileName]) << "@" << rec1.id;
-					for (vector<double>::iterator i = scores1.begin();
-							i != scores1.end(); ++i)
-					{
-						(*outputFiles[outputFileName]) << " " << *i;
-					}
-					(*outputFiles[outputFileName]) << "\n" << rec1.seq
-							<< "\n+\n" << rec1.qual << "\n";
-				}
-#pragma omp critical(outputFiles)
-				{
-					(*outputFiles[outputFileName]) << "@" << rec2.id;
-					for (vector<double>::iterator i = scores2.begin();
-							i != scores2.end(); ++i)
-					{
-						(*outputFiles[outputFileName]) << " " << *i;
-					}
-					(*outputFiles[outputFileName]) << "\n" << rec2.seq
-							<< "\n+\n" << rec2.qual << "\n";
-				}
-			} else if (m_mode == BESTHIT) {
-#pragma omp critical(outputFiles)
-				{
-					(*outputFiles[outputFileName + "1"]) << "@" << rec1.id
-							<< " " << score1 << "\n" << rec1.seq << "\n+\n"
-							<< rec1.qual << "\n";
-					(*outputFiles[outputFileName + "2"]) << "@" << rec2.id
-							<< " " << score2 << "\n" << rec2.seq << "\n+\n"
-							<< rec2.qual << "\n";
-				}
-			} else {
-#pragma omp critical(outputFiles)
-				{
-					(*outputFiles[outputFileName + "1"]) << "@" << rec1.id
-							<< "\n" << rec1.seq << "\n+\n" << rec1.qual << "\n";
-					(*outputFiles[outputFileName + "2"]) << "@" << rec2.id
-							<< "\n" << rec2.seq << "\n+\n" << rec2.qual << "\n";
-				}
-			}
+		if (dust == NULL) {
+			return false;
+		}
+		if (!dust->isLowComplexity(rec.seq.data(), rec.seq.length())) {
+			return false;
+		}
+		for (vector<string>::const_iterator i = idsInFilter.begin();
+				i != idsInFilter.end(); ++i)
+		{
+			hits[*i] = false;
 		}
+		return true;
 	}
 
-	inline void evaluateRead(const FastqRecord &rec, const string &hashSig,
-			unordered_map<string, bool> &hits, double &score, vector<double> &scores)
+	inline void evaluateRead(const ReadView &rec, const string &hashSig,
+			unordered_map<string, bool> &hits, double &score,
+			vector<double> &scores, DustMasker *dust)
 	{
+		if (skipLowComplexity(rec, dust, hits,
+				m_filters[hashSig]->getFilterIds()))
+		{
+			return;
+		}
 		switch(m_mode) {
 		case COLLAB:{
 			evaluateReadCollab(rec, hashSig, hits);
@@ -319,6 +425,49 @@ private:
 		}
 		}
 	}
+
+	/*
+	 * Evaluates both reads of a pair. A pair is only assigned to a filter if
+	 * both reads hit it (or either read in inclusive mode), so once the first
+	 * read decides the outcome for a filter the second read is not tested
+	 * against it. Only done for modes where the hits of a filter do not
+	 * depend on the other filters and no scores are reported.
+	 */
+	inline void evaluatePair(const ReadView &rec1, const ReadView &rec2,
+			const string &hashSig, unordered_map<string, bool> &hits1,
+			unordered_map<string, bool> &hits2, double &score1, double &score2,
+			vector<double> &scores1, vector<double> &scores2,
+			DustMasker *dust)
+	{
+		evaluateRead(rec1, hashSig, hits1, score1, scores1, dust);
+		if (m_mode != STD && m_mode != MINHITONLY) {
+			evaluateRead(rec2, hashSig, hits2, score2, scores2, dust);
+			return;
+		}
+
+		const vector<string> &idsInFilter = m_filters[hashSig]->getFilterIds();
+		vector<string> undecided;
+		undecided.reserve(idsInFilter.size());
+		for (vector<string>::const_iterator i = idsInFilter.begin();
+				i != idsInFilter.end(); ++i)
+		{
+			if (hits1[*i] == m_inclusive) {
+				hits2[*i] = false;
+			} else {
+				undecided.push_back(*i);
+			}
+		}
+		if (undecided.empty()
+				|| skipLowComplexity(rec2, dust, hits2, undecided))
+		{
+			return;
+		}
+		if (m_mode == MINHITONLY) {
+			evaluateReadMin(rec2, hashSig, hits2, undecided);
+		} else {
+			evaluateReadStd(rec2, hashSig, hits2, undecided);
+		}
+	}
 };
 
 #endif /* BIOBLOOMCLASSIFIER_H_ */
@@ -0,0 +1,136 @@
+/*
+ * BioBloomLabels.cpp
+ *	Prints a label file written by biobloomcategorizer --labels as a
+ *	tab separated table.
+ *
+ *  Created on: Oct 18, 2026
+ */
+#include <string>
+#include <vector>
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <getopt.h>
+#include "LabelFile.h"
+#include "config.h"
+
+using namespace std;
+
+#define PROGRAM "biobloomlabels"
+
+void printHelpDialog()
+{
+	const char dialog[] =
+	"Usage: " PROGRAM " [OPTION]... [FILE]\n"
+	"Print the labels written by biobloomcategorizer --labels as a table with\n"
+	"one row per read (or pair): its ordinal in the input, then 1 or 0 for\n"
+	"each filter it is or is not assigned to. If scores were stored they\n"
+	"follow, one column per filter (and mate), between 0 and 1.\n"
+	"\n"
+	"  -h, --help             Display this dialog.\n"
+	"  -v  --version          Display version information.\n"
+	"\n"
+	"Report bugs to <cjustin@bcgsc.ca>.";
+
+	cerr << dialog << endl;
+	exit(EXIT_SUCCESS);
+}
+
+void printVersion()
+{
+	const char VERSION_MESSAGE[] = PROGRAM " (" PACKAGE_NAME ") " VERSION "\n"
+	"Written by Justin Chu.\n"
+	"\n"
+	"Copyright 2013 Canada's Michael Smith Genome Science Centre\n";
+	cerr << VERSION_MESSAGE << endl;
+	exit(EXIT_SUCCESS);
+}
+
+int main(int argc, char *argv[])
+{
+	static struct option long_options[] = { {
+		"help", no_argument, NULL, 'h' }, {
+		"version", no_argument, NULL, 'v' }, {
+		NULL, 0, NULL, 0 } };
+
+	int c;
+	int option_index = 0;
+	while ((c = getopt_long(argc, argv, "hv", long_options, &option_index))
+			!= -1)
+	{
+		switch (c) {
+		case 'h': {
+			printHelpDialog();
+			break;
+		}
+		case 'v': {
+			printVersion();
+			break;
+		}
+		default: {
+			cerr << "Try '--help' for more information.\n";
+			exit(EXIT_FAILURE);
+		}
+		}
+	}
+	if (argc - optind != 1) {
+		cerr << "Error: Need one label file\n"
+				<< "Try '--help' for more information.\n";
+		exit(EXIT_FAILURE);
+	}
+
+	const char *path = argv[optind];
+	FILE *file = fopen(path, "rb");
+	if (file == NULL) {
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+	LabelHeader header;
+	if (!header.read(file)) {
+		cerr << "Error: " << path << " is not a label file" << endl;
+		exit(EXIT_FAILURE);
+	}
+
+	//column names
+	cout << "read";
+	for (vector<string>::const_iterator it = header.filterIDs.begin();
+			it != header.filterIDs.end(); ++it)
+	{
+		cout << '\t' << *it;
+	}
+	for (unsigned mate = 1; header.scores && mate <= header.mates; ++mate) {
+		for (vector<string>::const_iterator it = header.filterIDs.begin();
+				it != header.filterIDs.end(); ++it)
+		{
+			cout << '\t' << *it << "_score";
+			if (header.mates > 1) {
+				cout << '_' << mate;
+			}
+		}
+	}
+	cout << '\n';
+
+	vector<unsigned char> record(header.recordSize());
+	const size_t filterNum = header.filterIDs.size();
+	size_t count;
+	while ((count = fread(&record[0], 1, record.size(), file)) > 0) {
+		if (count != record.size()) {
+			cerr << "Error: " << path << " ends with a partial record" << endl;
+			exit(EXIT_FAILURE);
+		}
+		uint64_t ordinal;
+		memcpy(&ordinal, &record[0], sizeof(ordinal));
+		cout << ordinal;
+		const unsigned char *mask = &record[sizeof(ordinal)];
+		for (size_t i = 0; i < filterNum; ++i) {
+			cout << '\t' << ((mask[i / 8] >> (i % 8)) & 1);
+		}
+		const unsigned char *scores = mask + header.maskBytes();
+		for (size_t i = 0; i < header.scoreBytes(); ++i) {
+			cout << '\t' << scores[i] / 255.0;
+		}
+		cout << '\n';
+	}
+	fclose(file);
+	return 0;
+}
@@ -0,0 +1,126 @@
+/*
+ * LabelFile.h
+ *	Compact binary table of classification results, one fixed width record
+ *	per read (or pair) instead of a copy of the read:
+ *
+ *	header:	"BBTLABEL", then uint32 version, filter count, mates (1 or 2) and
+ *		whether scores are stored, then each filter ID as a uint32
+ *		length followed by its characters
+ *	record:	uint64 ordinal of the read (or pair) in the input, a bit mask
+ *		of the filters hit (bit i of byte i / 8 for filter i, for pairs
+ *		the filters the pair is assigned to) and, if scores are stored,
+ *		one byte per filter and mate with the score scaled to 0-255
+ *
+ *	Integers are stored in the byte order of the machine that wrote them.
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#ifndef LABELFILE_H_
+#define LABELFILE_H_
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+
+using namespace std;
+
+static const char LABEL_MAGIC[8] = { 'B', 'B', 'T', 'L', 'A', 'B', 'E', 'L' };
+static const uint32_t LABEL_VERSION = 1;
+
+struct LabelHeader {
+	vector<string> filterIDs;
+	uint32_t mates;
+	bool scores;
+
+	size_t maskBytes() const
+	{
+		return (filterIDs.size() + 7) / 8;
+	}
+
+	size_t scoreBytes() const
+	{
+		return scores ? filterIDs.size() * mates : 0;
+	}
+
+	size_t recordSize() const
+	{
+		return sizeof(uint64_t) + maskBytes() + scoreBytes();
+	}
+
+	/*
+	 * Returns false if the header cannot be written
+	 */
+	bool write(FILE *file) const
+	{
+		uint32_t fields[4] = { LABEL_VERSION, uint32_t(filterIDs.size()),
+				mates, scores };
+		if (fwrite(LABEL_MAGIC, 1, sizeof(LABEL_MAGIC), file)
+				!= sizeof(LABEL_MAGIC)
+				|| fwrite(fields, sizeof(uint32_t), 4, file) != 4)
+		{
+			return false;
+		}
+		for (vector<string>::const_iterator it = filterIDs.begin();
+				it != filterIDs.end(); ++it)
+		{
+			uint32_t length = it->length();
+			if (fwrite(&length, sizeof(length), 1, file) != 1
+					|| fwrite(it->data(), 1, length, file) != length)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/*
+	 * Returns false if the file is not a label file of this version
+	 */
+	bool read(FILE *file)
+	{
+		char magic[sizeof(LABEL_MAGIC)];
+		uint32_t fields[4];
+		if (fread(magic, 1, sizeof(magic), file) != sizeof(magic)
+				|| memcmp(magic, LABEL_MAGIC, sizeof(magic)) != 0
+				|| fread(fields, sizeof(uint32_t), 4, file) != 4
+				|| fields[0] != LABEL_VERSION)
+		{
+			return false;
+		}
+		mates = fields[2];
+		scores = fields[3] != 0;
+		filterIDs.resize(fields[1]);
+		for (vector<string>::iterator it = filterIDs.begin();
+				it != filterIDs.end(); ++it)
+		{
+			uint32_t length;
+			if (fread(&length, sizeof(length), 1, file) != 1) {
+				return false;
+			}
+			it->resize(length);
+			if (length > 0 && fread(&(*it)[0], 1, length, file) != length) {
+				return false;
+			}
+		}
+		return true;
+	}
+};
+
+/*
+ * Scales a score between 0 and 1 to a byte
+ */
+static inline uint8_t quantizeScore(double score)
+{
+	if (score <= 0) {
+		return 0;
+	}
+	if (score >= 1) {
+		return 255;
+	}
+	return uint8_t(score * 255 + 0.5);
+}
+
+#endif /* LABELFILE_H_ */
@@ -0,0 +1,909 @@
+/*
+ * ReadSource.cpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#include "ReadSource.h"
+#include "DataLayer/Options.h"
+#include "DataLayer/RecordRules.h"
+#include "Common/StringUtil.h"
+#include <iostream>
+#include <cassert>
+#include <algorithm>
+#include <cstring>
+#include <sched.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+SingleReadSource::SingleReadSource(const vector<string> &inputFiles) :
+		m_inputFiles(inputFiles), m_currentFile(inputFiles.begin()), m_blockSize(
+				1), m_sectionBytes(0), m_stride(1), m_stop(false), m_readsScanned(
+				0), m_nsections(1), m_sectionsOpened(0), m_fileReads(0)
+{
+}
+
+/*
+ * Returns every stride-th section of nsections, ordered so that the first n
+ * of them are spread evenly over the file for any n: by their rank with its
+ * bits reversed
+ */
+static vector<unsigned> spreadSections(unsigned nsections, unsigned stride)
+{
+	unsigned sampled = (nsections + stride - 1) / stride;
+	unsigned bits = 0;
+	while ((1U << bits) < sampled) {
+		++bits;
+	}
+	vector<unsigned> order;
+	order.reserve(sampled);
+	for (unsigned rank = 0; rank < 1U << bits; ++rank) {
+		unsigned reversed = 0;
+		for (unsigned bit = 0; bit < bits; ++bit) {
+			if (rank & 1U << bit) {
+				reversed |= 1U << (bits - 1 - bit);
+			}
+		}
+		if (reversed < sampled) {
+			order.push_back(reversed * stride);
+		}
+	}
+	return order;
+}
+
+/*
+ * Opens the next section to read, of the current file or the next one.
+ * Returns false once every file is done.
+ */
+bool SingleReadSource::openSection()
+{
+	while (m_sectionsOpened >= m_sectionOrder.size()) {
+		m_readsScanned += fileReadsScanned();
+		m_fileReads = 0;
+		if (m_currentFile == m_inputFiles.end()) {
+			m_sectionOrder.clear();
+			m_sectionsOpened = 0;
+			return false;
+		}
+		const string &file = *m_currentFile++;
+		m_nsections = 1;
+		struct stat st;
+		if (m_sectionBytes > 0 && file != "-"
+				&& stat(file.c_str(), &st) == 0 && S_ISREG(st.st_mode))
+		{
+			m_nsections = unsigned(
+					max(off_t(1), st.st_size / off_t(m_sectionBytes)));
+		}
+		m_sectionOrder = spreadSections(m_nsections,
+				m_nsections > 1 ? m_stride : 1);
+		m_sectionsOpened = 0;
+		m_sequence.reset(
+				new FastaReader(file.c_str(), FastaReader::NO_FOLD_CASE));
+		//the first section is 0, if the file cannot be split it is the
+		//whole file and is sampled in blocks of reads instead
+		if (!m_sequence->split(m_sectionOrder.front() + 1, m_nsections)) {
+			m_nsections = 1;
+			m_sectionOrder.assign(1, 0);
+		}
+		++m_sectionsOpened;
+		return true;
+	}
+	m_sequence.reset(
+			new FastaReader((m_currentFile - 1)->c_str(),
+					FastaReader::NO_FOLD_CASE));
+	m_sequence->split(m_sectionOrder[m_sectionsOpened++] + 1, m_nsections);
+	return true;
+}
+
+/*
+ * Reads of the current file, with those of the sections not read estimated
+ * from the sections opened
+ */
+size_t SingleReadSource::fileReadsScanned() const
+{
+	if (m_nsections <= 1 || m_sectionsOpened == 0) {
+		return m_fileReads;
+	}
+	return size_t(
+			double(m_fileReads) * m_nsections / double(m_sectionsOpened)
+					+ 0.5);
+}
+
+size_t SingleReadSource::read(ReadBatch &batch)
+{
+	size_t count = 0;
+	while (count < batch.capacity()) {
+		if (!m_sequence) {
+			if (m_stop || !openSection()) {
+				break;
+			}
+		}
+		if (m_stop) {
+			m_sequence->breakClose();
+		}
+		if (*m_sequence >> batch.reads1[count]) {
+			//skip reads outside of sampled blocks, sections outside of
+			//the sample are not read at all
+			if (m_nsections > 1
+					|| (m_fileReads / m_blockSize) % m_stride == 0)
+			{
+				++count;
+			}
+			++m_fileReads;
+		} else {
+			assert(m_sequence->eof());
+			m_sequence.reset();
+		}
+	}
+	batch.count = count;
+	batch.viewRecords();
+	return count;
+}
+
+SplitReadSource::SplitReadSource(const vector<string> &inputFiles,
+		unsigned parsers, unsigned sectionsPerFile) :
+		m_parsers(parsers), m_remaining(0)
+{
+	for (vector<string>::const_iterator it = inputFiles.begin();
+			it != inputFiles.end(); ++it)
+	{
+		for (unsigned i = 1; i <= sectionsPerFile; ++i) {
+			Section section;
+			section.file = *it;
+			section.index = i;
+			section.nsections = sectionsPerFile;
+			section.state = SECTION_FREE;
+			m_sections.push_back(section);
+		}
+	}
+	m_remaining = m_sections.size();
+}
+
+/*
+ * Thread safe, each call claims a section no other thread is reading
+ */
+size_t SplitReadSource::read(ReadBatch &batch)
+{
+	batch.count = 0;
+	while (m_remaining > 0) {
+		for (vector<Section>::iterator it = m_sections.begin();
+				it != m_sections.end(); ++it)
+		{
+			if (it->state != SECTION_FREE
+					|| !__sync_bool_compare_and_swap(&it->state,
+							SECTION_FREE, SECTION_BUSY))
+			{
+				continue;
+			}
+			if (!it->reader) {
+				//if the file cannot be split the first section reads the
+				//whole file and the others nothing
+				it->reader.reset(
+						new FastaReader(it->file.c_str(),
+								FastaReader::NO_FOLD_CASE));
+				it->reader->split(it->index, it->nsections);
+			}
+			FastaReader &sequence = *it->reader;
+			while (batch.count < batch.capacity()
+					&& sequence >> batch.reads1[batch.count])
+			{
+				++batch.count;
+			}
+			if (batch.count < batch.capacity()) {
+				assert(sequence.eof());
+				it->reader.reset();
+				__sync_synchronize();
+				it->state = SECTION_DONE;
+				__sync_fetch_and_sub(&m_remaining, 1);
+			} else {
+				__sync_synchronize();
+				it->state = SECTION_FREE;
+			}
+			if (batch.count > 0) {
+				batch.viewRecords();
+				return batch.count;
+			}
+		}
+		//every section left is being read by another thread
+		sched_yield();
+	}
+	return batch.count;
+}
+
+/*
+ * Returns the end of the line starting at p (its newline, or the end of the
+ * file)
+ */
+static inline const char *lineEnd(const char *p, const char *end)
+{
+	const char *newline = static_cast<const char*>(memchr(p, '\n', end - p));
+	return newline == NULL ? end : newline;
+}
+
+static inline const char *nextLine(const char *p, const char *end)
+{
+	p = lineEnd(p, end);
+	return p < end ? p + 1 : end;
+}
+
+/*
+ * Returns the line starting at p without its newline or carriage return and
+ * moves p to the next line. exact is cleared if the line is not ended by a
+ * single newline.
+ */
+static inline StringView getLine(const char *&p, const char *end, bool &exact)
+{
+	const char *start = p;
+	const char *stop = lineEnd(p, end);
+	p = stop < end ? stop + 1 : end;
+	if (stop == end) {
+		exact = false;
+	}
+	if (stop > start && stop[-1] == '\r') {
+		--stop;
+		exact = false;
+	}
+	return StringView(start, stop - start);
+}
+
+/*
+ * Same test as FastaReader uses to split FASTQ files: a record starts with
+ * '@', its third line starts with '+' and its second and fourth lines are
+ * the same length
+ */
+static bool isFastqRecordStart(const char *p, const char *end)
+{
+	if (p >= end || *p != '@') {
+		return false;
+	}
+	const char *seq = nextLine(p, end);
+	const char *plus = nextLine(seq, end);
+	const char *qual = nextLine(plus, end);
+	return plus < end && *plus == '+' && qual < end
+			&& lineEnd(seq, end) - seq == lineEnd(qual, end) - qual;
+}
+
+/*
+ * Returns the first record that starts at or after pos
+ */
+static const char *findFastqRecordStart(const char *data, size_t pos,
+		size_t size)
+{
+	const char *end = data + size;
+	if (pos == 0) {
+		return data;
+	}
+	const char *p = nextLine(data + pos - 1, end);
+	while (p < end && !isFastqRecordStart(p, end)) {
+		p = nextLine(p, end);
+	}
+	return p;
+}
+
+/*
+ * Maps a file read only, returns false if it cannot be mapped
+ */
+static bool mapFile(const string &path, const char *&data, size_t &size)
+{
+	if (path == "-") {
+		return false;
+	}
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+		close(fd);
+		return false;
+	}
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		return false;
+	}
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+	data = static_cast<const char*>(map);
+	size = st.st_size;
+	return true;
+}
+
+bool MappedReadSource::canMap(const vector<string> &inputFiles)
+{
+	//trimming rewrites reads while parsing
+	if (opt::trimMasked || opt::qualityThreshold > 0) {
+		return false;
+	}
+	for (vector<string>::const_iterator it = inputFiles.begin();
+			it != inputFiles.end(); ++it)
+	{
+		if (endsWith(*it, ".sam") || endsWith(*it, ".bam")) {
+			return false;
+		}
+		const char *data;
+		size_t size;
+		if (!mapFile(*it, data, size)) {
+			return false;
+		}
+		//compressed, FASTA and SAM files fail this test
+		bool fastq = isFastqRecordStart(data, data + size);
+		munmap(const_cast<char*>(data), size);
+		if (!fastq) {
+			return false;
+		}
+	}
+	return true;
+}
+
+MappedReadSource::MappedReadSource(const vector<string> &inputFiles,
+		unsigned parsers, unsigned sectionsPerFile) :
+		m_parsers(parsers), m_remaining(0)
+{
+	m_files.resize(inputFiles.size());
+	for (size_t i = 0; i < inputFiles.size(); ++i) {
+		MappedFile &file = m_files[i];
+		file.path = inputFiles[i];
+		if (!mapFile(file.path, file.data, file.size)) {
+			cerr << "Error: could not map file " << file.path << endl;
+			exit(1);
+		}
+		const char *end = file.data + file.size;
+		const char *start = file.data;
+		for (unsigned j = 1; j <= sectionsPerFile; ++j) {
+			Section section;
+			section.file = i;
+			section.pos = start;
+			section.end =
+					j == sectionsPerFile ? end :
+							findFastqRecordStart(file.data,
+									file.size * j / sectionsPerFile,
+									file.size);
+			section.state = SECTION_FREE;
+			if (section.pos < section.end) {
+				m_sections.push_back(section);
+			}
+			start = section.end;
+		}
+	}
+	m_remaining = m_sections.size();
+}
+
+MappedReadSource::~MappedReadSource()
+{
+	for (vector<MappedFile>::iterator it = m_files.begin();
+			it != m_files.end(); ++it)
+	{
+		munmap(const_cast<char*>(it->data), it->size);
+	}
+}
+
+/*
+ * Thread safe, each call claims a section no other thread is reading
+ */
+size_t MappedReadSource::read(ReadBatch &batch)
+{
+	batch.count = 0;
+	while (m_remaining > 0) {
+		for (vector<Section>::iterator it = m_sections.begin();
+				it != m_sections.end(); ++it)
+		{
+			if (it->state != SECTION_FREE
+					|| !__sync_bool_compare_and_swap(&it->state,
+							SECTION_FREE, SECTION_BUSY))
+			{
+				continue;
+			}
+			while (batch.count < batch.capacity()
+					&& readRecord(*it, batch.views1[batch.count],
+							batch.reads1[batch.count]))
+			{
+				++batch.count;
+			}
+			if (batch.count < batch.capacity()) {
+				__sync_synchronize();
+				it->state = SECTION_DONE;
+				__sync_fetch_and_sub(&m_remaining, 1);
+			} else {
+				__sync_synchronize();
+				it->state = SECTION_FREE;
+			}
+			if (batch.count > 0) {
+				return batch.count;
+			}
+		}
+		//every section left is being read by another thread
+		sched_yield();
+	}
+	return batch.count;
+}
+
+/*
+ * Parses the next record of a section into view, the same way FastaReader
+ * reads FASTQ. Fields that have to be changed (IDs given a read number,
+ * colour space reads) are copied into rec and viewed there.
+ * Returns false at the end of the section.
+ */
+bool MappedReadSource::readRecord(Section &section, ReadView &view,
+		FastqRecord &rec)
+{
+	const MappedFile &file = m_files[section.file];
+	const char *end = file.data + file.size;
+	const char *&p = section.pos;
+	for (;;) {
+		view = ReadView();
+
+		// Discard comments.
+		while (p < section.end && *p == '#') {
+			p = nextLine(p, end);
+		}
+		if (p >= section.end) {
+			return false;
+		}
+		if (*p != '@') {
+			cerr << file.path << ": error: expected `@' and saw `" << *p
+					<< "' near\n" << string(p, lineEnd(p, end)) << endl;
+			exit(EXIT_FAILURE);
+		}
+
+		const char *record = p;
+		bool exact = true;
+		StringView header = getLine(p, end, exact);
+		RecordHeader parsed;
+		parseRecordHeader(header.data(), header.length(), parsed);
+		view.id = StringView(parsed.id, parsed.idLength);
+		view.comment = StringView(parsed.comment, parsed.commentLength);
+
+		// Ignore SAM headers.
+		if (parsed.samHeader) {
+			continue;
+		}
+		if (parsed.unchaste) {
+			for (unsigned j = 0; j < 3; ++j) {
+				p = nextLine(p, end);
+			}
+			continue;
+		}
+		if (parsed.readNumber != 0) {
+			// Add the read number to the ID.
+			rec.id.assign(parsed.id, parsed.idLength);
+			rec.id += '/';
+			rec.id += parsed.readNumber;
+			view.id = StringView(rec.id);
+		}
+
+		view.seq = getLine(p, end, exact);
+		if (p >= end || *p != '+') {
+			cerr << file.path << ": error: expected `+' near\n"
+					<< header.str() << '\n' << view.seq.str() << endl;
+			exit(EXIT_FAILURE);
+		}
+		StringView plus = getLine(p, end, exact);
+		view.qual = getLine(p, end, exact);
+
+		if (view.seq.empty()) {
+			cerr << file.path << ": error: sequence with ID `"
+					<< view.id.str() << "' is empty" << endl;
+			exit(EXIT_FAILURE);
+		}
+		if (isTooShort(view.seq.length())) {
+			continue;
+		}
+
+		// Colour space reads start with the primer base, which is dropped
+		// with the first colour.
+		if (hasPrimerBase(view.seq.data(), view.seq.length())) {
+			assert(view.seq.length() > 2);
+			rec.seq.assign(view.seq.data() + 2, view.seq.length() - 2);
+			view.seq = StringView(rec.seq);
+			if (!view.qual.empty()) {
+				rec.qual.assign(view.qual.data() + 1, view.qual.length() - 1);
+				view.qual = StringView(rec.qual);
+			}
+			exact = false;
+		}
+
+		if (!view.qual.empty() && view.seq.length() != view.qual.length()) {
+			cerr << file.path
+					<< ": error: sequence and quality must be the same length near\n"
+					<< view.seq.str() << '\n' << view.qual.str() << endl;
+			exit(EXIT_FAILURE);
+		}
+
+		//the record can be copied as is if it is exactly @id, seq, +, qual
+		if (exact && view.id.data() == header.data() + 1
+				&& view.id.length() + 1 == header.length()
+				&& plus.length() == 1)
+		{
+			view.text = StringView(record, p - record);
+		}
+		return true;
+	}
+}
+
+PairedReadSource::PairedReadSource(const string &file1, const string &file2) :
+		m_sequence1(file1.c_str(), FastaReader::NO_FOLD_CASE), m_sequence2(
+				file2.c_str(), FastaReader::NO_FOLD_CASE), m_done(false)
+{
+}
+
+size_t PairedReadSource::read(ReadBatch &batch)
+{
+	size_t count = 0;
+	while (!m_done && count < batch.capacity()) {
+		FastqRecord &rec1 = batch.reads1[count];
+		FastqRecord &rec2 = batch.reads2[count];
+		bool good1 = m_sequence1 >> rec1;
+		bool good2 = m_sequence2 >> rec2;
+		if (!good1 || !good2) {
+			m_done = true;
+			if (!m_sequence1.eof() || !m_sequence2.eof()) {
+				cerr
+						<< "error: eof bit not flipped. Input files may be different lengths"
+						<< endl;
+			}
+			break;
+		}
+		string tempStr1 = rec1.id.substr(0, rec1.id.find_last_of("/"));
+		string tempStr2 = rec2.id.substr(0, rec2.id.find_last_of("/"));
+		if (tempStr1 != tempStr2) {
+			cerr << "Read IDs do not match" << "\n" << tempStr1 << "\n"
+					<< tempStr2 << endl;
+			exit(1);
+		}
+		++count;
+	}
+	batch.count = count;
+	batch.viewRecords();
+	return count;
+}
+
+InterleavedReadSource::InterleavedReadSource(const string &file) :
+		m_sequence(file.c_str(), FastaReader::NO_FOLD_CASE), m_done(false)
+{
+}
+
+size_t InterleavedReadSource::read(ReadBatch &batch)
+{
+	size_t count = 0;
+	while (!m_done && count < batch.capacity()) {
+		FastqRecord &rec1 = batch.reads1[count];
+		FastqRecord &rec2 = batch.reads2[count];
+		if (!(m_sequence >> rec1)) {
+			assert(m_sequence.eof());
+			m_done = true;
+			break;
+		}
+		if (!(m_sequence >> rec2)) {
+			cerr << "error: read " << rec1.id
+					<< " has no mate. Interleaved input must have an even number of reads"
+					<< endl;
+			exit(1);
+		}
+		string tempStr1 = rec1.id.substr(0, rec1.id.find_last_of("/"));
+		string tempStr2 = rec2.id.substr(0, rec2.id.find_last_of("/"));
+		if (tempStr1 != tempStr2) {
+			cerr << "Read IDs do not match" << "\n" << tempStr1 << "\n"
+					<< tempStr2 << endl;
+			exit(1);
+		}
+		++count;
+	}
+	batch.count = count;
+	batch.viewRecords();
+	return count;
+}
+
+//shards of the table of reads waiting for their mate
+static const size_t PAIR_SHARDS = 64;
+
+//times spilled reads are split again to fit in memory before they are
+//paired whatever memory they take (64^3 parts of the input)
+static const unsigned PAIR_SPLIT_LEVELS = 3;
+
+//memory used by a held read besides its strings (hash node, key, headers)
+static const size_t PAIR_RECORD_OVERHEAD = 128;
+
+static inline size_t recordMemory(const string &name, const FastqRecord &rec)
+{
+	return PAIR_RECORD_OVERHEAD + name.length() + rec.id.length()
+			+ rec.comment.length() + rec.seq.length() + rec.qual.length();
+}
+
+static void writeField(FILE *file, const string &field)
+{
+	uint32_t length = field.length();
+	if (fwrite(&length, sizeof(length), 1, file) != 1
+			|| fwrite(field.data(), 1, length, file) != length)
+	{
+		cerr << "Error: could not write to temporary file" << endl;
+		exit(1);
+	}
+}
+
+static bool readField(FILE *file, string &field)
+{
+	uint32_t length;
+	if (fread(&length, sizeof(length), 1, file) != 1) {
+		return false;
+	}
+	field.resize(length);
+	if (length > 0 && fread(&field[0], 1, length, file) != length) {
+		cerr << "Error: could not read temporary file" << endl;
+		exit(1);
+	}
+	return true;
+}
+
+static void writeRecord(FILE *file, const FastqRecord &rec)
+{
+	writeField(file, rec.id);
+	writeField(file, rec.comment);
+	writeField(file, rec.seq);
+	writeField(file, rec.qual);
+}
+
+static bool readRecord(FILE *file, FastqRecord &rec)
+{
+	if (!readField(file, rec.id)) {
+		return false;
+	}
+	if (!readField(file, rec.comment) || !readField(file, rec.seq)
+			|| !readField(file, rec.qual))
+	{
+		cerr << "Error: could not read temporary file" << endl;
+		exit(1);
+	}
+	return true;
+}
+
+static FILE *createSpillFile()
+{
+	FILE *file = tmpfile();
+	if (file == NULL) {
+		cerr << "Error: could not create temporary file" << endl;
+		exit(1);
+	}
+	return file;
+}
+
+/*
+ * Name shared by both mates (the ID without its /1 or /2)
+ */
+static inline string mateName(const FastqRecord &rec)
+{
+	return rec.id.substr(0, rec.id.length() - 2);
+}
+
+SamPairReadSource::SamPairReadSource(const string &file, size_t maxMemory) :
+		m_sequence(file.c_str(), FastaReader::NO_FOLD_CASE), m_inputDone(
+				false), m_hasPrev(false), m_shards(PAIR_SHARDS), m_memory(0), m_maxMemory(
+				maxMemory), m_readyPos(0), m_drainShard(0)
+{
+	for (vector<Shard>::iterator it = m_shards.begin(); it != m_shards.end();
+			++it)
+	{
+		it->memory = 0;
+		it->spill = NULL;
+		it->spilledMemory = 0;
+	}
+}
+
+SamPairReadSource::~SamPairReadSource()
+{
+	for (vector<Shard>::iterator it = m_shards.begin(); it != m_shards.end();
+			++it)
+	{
+		if (it->spill != NULL) {
+			fclose(it->spill);
+		}
+	}
+	for (vector<SpillFile>::iterator it = m_drainFiles.begin();
+			it != m_drainFiles.end(); ++it)
+	{
+		fclose(it->file);
+	}
+}
+
+size_t SamPairReadSource::read(ReadBatch &batch)
+{
+	size_t count = 0;
+	while (count < batch.capacity()) {
+		if (m_readyPos < m_ready.size()) {
+			addPair(batch, count++, m_ready[m_readyPos],
+					m_ready[m_readyPos + 1]);
+			m_readyPos += 2;
+		} else if (!m_inputDone) {
+			if (!(m_sequence >> m_rec)) {
+				assert(m_sequence.eof());
+				m_inputDone = true;
+				if (m_hasPrev) {
+					hold(m_prevName, m_prev);
+					m_hasPrev = false;
+				}
+				continue;
+			}
+			string name = mateName(m_rec);
+			//collated input, the mate is the previous read
+			if (m_hasPrev && name == m_prevName) {
+				addPair(batch, count++, m_prev, m_rec);
+				m_hasPrev = false;
+				continue;
+			}
+			if (m_hasPrev) {
+				hold(m_prevName, m_prev);
+			}
+			Shard &shard = shardOf(name);
+			unordered_map<string, FastqRecord>::iterator mate =
+					shard.reads.find(name);
+			if (mate != shard.reads.end()) {
+				size_t memory = recordMemory(name, mate->second);
+				addPair(batch, count++, m_rec, mate->second);
+				shard.reads.erase(mate);
+				shard.memory -= memory;
+				m_memory -= memory;
+				m_hasPrev = false;
+			} else {
+				m_prev.swap(m_rec);
+				m_prevName.swap(name);
+				m_hasPrev = true;
+			}
+		} else if (!m_drainFiles.empty()) {
+			SpillFile spill = m_drainFiles.back();
+			m_drainFiles.pop_back();
+			if (spill.memory > m_maxMemory && spill.level < PAIR_SPLIT_LEVELS) {
+				splitSpill(spill);
+			} else {
+				pairSpill(spill);
+			}
+		} else if (m_drainShard < m_shards.size()) {
+			drain(m_shards[m_drainShard++]);
+		} else {
+			break;
+		}
+	}
+	batch.count = count;
+	batch.viewRecords();
+	return count;
+}
+
+/*
+ * Puts a pair into the batch, read 1 first
+ */
+void SamPairReadSource::addPair(ReadBatch &batch, size_t count,
+		FastqRecord &rec, FastqRecord &mate) const
+{
+	bool first = rec.id.at(rec.id.length() - 1) == '1';
+	batch.reads1[count].swap(first ? rec : mate);
+	batch.reads2[count].swap(first ? mate : rec);
+}
+
+/*
+ * Holds a read until its mate is found, spilling the largest shard if the
+ * reads held take too much memory
+ */
+void SamPairReadSource::hold(const string &name, FastqRecord &rec)
+{
+	Shard &shard = shardOf(name);
+	size_t memory = recordMemory(name, rec);
+	shard.reads[name].swap(rec);
+	shard.memory += memory;
+	m_memory += memory;
+	if (m_memory > m_maxMemory) {
+		vector<Shard>::iterator largest = m_shards.begin();
+		for (vector<Shard>::iterator it = m_shards.begin();
+				it != m_shards.end(); ++it)
+		{
+			if (it->memory > largest->memory) {
+				largest = it;
+			}
+		}
+		spill(*largest);
+	}
+}
+
+/*
+ * Moves every read held in a shard to its temporary file
+ */
+void SamPairReadSource::spill(Shard &shard)
+{
+	if (shard.spill == NULL) {
+		shard.spill = createSpillFile();
+	}
+	for (unordered_map<string, FastqRecord>::const_iterator it =
+			shard.reads.begin(); it != shard.reads.end(); ++it)
+	{
+		writeRecord(shard.spill, it->second);
+	}
+	m_memory -= shard.memory;
+	shard.spilledMemory += shard.memory;
+	shard.memory = 0;
+	unordered_map<string, FastqRecord>().swap(shard.reads);
+}
+
+/*
+ * Queues the reads of a shard that were spilled, with the reads still held,
+ * to be paired. Reads of a shard that was never spilled have no mate and
+ * are dropped.
+ */
+void SamPairReadSource::drain(Shard &shard)
+{
+	if (shard.spill == NULL) {
+		m_memory -= shard.memory;
+		shard.memory = 0;
+		unordered_map<string, FastqRecord>().swap(shard.reads);
+		return;
+	}
+	spill(shard);
+	SpillFile file = { shard.spill, shard.spilledMemory, 0 };
+	m_drainFiles.push_back(file);
+	shard.spill = NULL;
+	shard.spilledMemory = 0;
+}
+
+/*
+ * Splits spilled reads that would take more than the memory limit to pair
+ * into PAIR_SHARDS files by another hash of their names, to be paired one
+ * at a time
+ */
+void SamPairReadSource::splitSpill(const SpillFile &spill)
+{
+	unsigned level = spill.level + 1;
+	vector<SpillFile> parts(PAIR_SHARDS);
+	for (vector<SpillFile>::iterator it = parts.begin(); it != parts.end();
+			++it)
+	{
+		it->file = NULL;
+		it->memory = 0;
+		it->level = level;
+	}
+	rewind(spill.file);
+	FastqRecord rec;
+	while (readRecord(spill.file, rec)) {
+		string name = mateName(rec);
+		size_t hash = level;
+		boost::hash_combine(hash, name);
+		SpillFile &part = parts[hash % parts.size()];
+		if (part.file == NULL) {
+			part.file = createSpillFile();
+		}
+		writeRecord(part.file, rec);
+		part.memory += recordMemory(name, rec);
+	}
+	fclose(spill.file);
+	for (vector<SpillFile>::iterator it = parts.begin(); it != parts.end();
+			++it)
+	{
+		if (it->file != NULL) {
+			m_drainFiles.push_back(*it);
+		}
+	}
+}
+
+/*
+ * Pairs spilled reads with each other, filling the ready list; reads left
+ * without a mate are dropped
+ */
+void SamPairReadSource::pairSpill(const SpillFile &spill)
+{
+	m_ready.clear();
+	m_readyPos = 0;
+	unordered_map<string, FastqRecord> reads;
+	rewind(spill.file);
+	FastqRecord rec;
+	while (readRecord(spill.file, rec)) {
+		string name = mateName(rec);
+		unordered_map<string, FastqRecord>::iterator mate = reads.find(name);
+		if (mate != reads.end()) {
+			m_ready.push_back(FastqRecord());
+			m_ready.back().swap(rec);
+			m_ready.push_back(FastqRecord());
+			m_ready.back().swap(mate->second);
+			reads.erase(mate);
+		} else {
+			reads[name].swap(rec);
+		}
+	}
+	fclose(spill.file);
+}
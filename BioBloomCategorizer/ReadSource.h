@@ -0,0 +1,395 @@
+/*
+ * ReadSource.h
+ *	Parser stage of the categorizer. A ReadSource fills batches of reads (or
+ *	read pairs) from its input files; batches are then passed between the
+ *	parser, classifier and writer stages.
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#ifndef READSOURCE_H_
+#define READSOURCE_H_
+
+#include <vector>
+#include <string>
+#include <cstdio>
+#include "boost/unordered/unordered_map.hpp"
+#include "boost/shared_ptr.hpp"
+#include "boost/functional/hash.hpp"
+#include "DataLayer/FastaReader.h"
+#include "DataLayer/ReadView.h"
+
+using namespace std;
+using namespace boost;
+
+/*
+ * A block of reads and their classification results
+ */
+struct ReadBatch {
+	//reads, and their mates if the input is paired
+	vector<FastqRecord> reads1;
+	vector<FastqRecord> reads2;
+	size_t count;
+
+	//the reads as classified and written, pointing into the records above
+	//or straight into the input
+	vector<ReadView> views1;
+	vector<ReadView> views2;
+
+	//position of the batch in the input, used to write batches in order
+	size_t sequence;
+
+	//number of reads (or pairs) parsed before this batch
+	size_t firstRead;
+
+	//formatted output filled in by the classifier stage, one buffer per
+	//output file and one for reads printed to stdout
+	vector<string> outputs;
+	string mainOutput;
+
+	//binary label records of the reads, if labels are written
+	string labels;
+
+	ReadBatch(size_t capacity, bool paired) :
+			reads1(capacity), reads2(paired ? capacity : 0), count(0), views1(
+					capacity), views2(paired ? capacity : 0), sequence(0), firstRead(0)
+	{
+	}
+
+	/*
+	 * Points the views at the records read into the batch
+	 */
+	void viewRecords()
+	{
+		for (size_t i = 0; i < count; ++i) {
+			views1[i] = ReadView(reads1[i]);
+		}
+		for (size_t i = 0; i < count && i < reads2.size(); ++i) {
+			views2[i] = ReadView(reads2[i]);
+		}
+	}
+
+	size_t capacity() const
+	{
+		return reads1.size();
+	}
+};
+
+class ReadSource {
+public:
+	/*
+	 * Fills the batch given and returns the number of reads (or pairs) read
+	 * Returns 0 once the input is exhausted
+	 * Not thread safe, only one thread should parse a source at a time
+	 */
+	virtual size_t read(ReadBatch &batch) = 0;
+
+	virtual bool isPaired() const = 0;
+
+	/*
+	 * Number of threads that can call read at the same time
+	 */
+	virtual unsigned getParserNum() const
+	{
+		return 1;
+	}
+
+	/*
+	 * Stops reading early, if the source supports it
+	 * (can be called from any thread)
+	 */
+	virtual void stop()
+	{
+	}
+
+	virtual ~ReadSource()
+	{
+	}
+};
+
+/*
+ * Single end reads from one or more files, read one file after the other
+ * Can be sampled in blocks for composition estimation
+ */
+class SingleReadSource: public ReadSource {
+public:
+	explicit SingleReadSource(const vector<string> &inputFiles);
+	size_t read(ReadBatch &batch);
+
+	bool isPaired() const
+	{
+		return false;
+	}
+
+	/*
+	 * Only return one block of reads every stride blocks. Uncompressed
+	 * FASTA and FASTQ files are split into sections of about sectionBytes
+	 * instead, one section of every stride is read and the others are
+	 * skipped without being parsed. The sections are read in an order that
+	 * spreads any number of them across the file, so a sample stopped early
+	 * is not just the start of the file.
+	 */
+	void setSampling(size_t blockSize, size_t sectionBytes, unsigned stride)
+	{
+		m_blockSize = blockSize;
+		m_sectionBytes = sectionBytes;
+		m_stride = stride;
+	}
+
+	void stop()
+	{
+		m_stop = true;
+	}
+
+	bool stopped() const
+	{
+		return m_stop;
+	}
+
+	/*
+	 * Reads parsed, including those skipped when sampling. The reads of
+	 * the sections of a file that were skipped (or not reached) are
+	 * estimated from the reads of the sections that were read.
+	 */
+	size_t getReadsScanned() const
+	{
+		return m_readsScanned + fileReadsScanned();
+	}
+
+private:
+	const vector<string> &m_inputFiles;
+	//next file to open
+	vector<string>::const_iterator m_currentFile;
+	boost::shared_ptr<FastaReader> m_sequence;
+	size_t m_blockSize;
+	size_t m_sectionBytes;
+	unsigned m_stride;
+	volatile bool m_stop;
+	//reads parsed in the files before the current one
+	size_t m_readsScanned;
+
+	//sections of the current file (1 if it is read whole), the ones to
+	//read in order and the number opened so far
+	unsigned m_nsections;
+	vector<unsigned> m_sectionOrder;
+	size_t m_sectionsOpened;
+	//reads parsed in the current file
+	size_t m_fileReads;
+
+	bool openSection();
+	size_t fileReadsScanned() const;
+};
+
+/*
+ * Single end reads from one or more files, with each uncompressed FASTA or
+ * FASTQ file split into byte ranges (sections) so several threads can
+ * parse it at once. Files that cannot be split are read by one thread.
+ */
+class SplitReadSource: public ReadSource {
+public:
+	SplitReadSource(const vector<string> &inputFiles, unsigned parsers,
+			unsigned sectionsPerFile);
+	size_t read(ReadBatch &batch);
+
+	bool isPaired() const
+	{
+		return false;
+	}
+
+	unsigned getParserNum() const
+	{
+		return m_parsers;
+	}
+
+private:
+	enum SectionState {
+		SECTION_FREE, SECTION_BUSY, SECTION_DONE
+	};
+
+	//section index of nsections of a file, opened when first claimed by
+	//a parser and closed once read
+	struct Section {
+		string file;
+		unsigned index;
+		unsigned nsections;
+		boost::shared_ptr<FastaReader> reader;
+		volatile int state;
+	};
+
+	unsigned m_parsers;
+	vector<Section> m_sections;
+
+	//sections still to be read
+	volatile size_t m_remaining;
+};
+
+/*
+ * Single end reads from uncompressed FASTQ files mapped into memory. Reads
+ * are parsed in place and the views of a batch point into the mapped
+ * files, so a record is only copied when it is written out. Each file is
+ * split into sections at record boundaries so several threads can parse
+ * it at once.
+ */
+class MappedReadSource: public ReadSource {
+public:
+	MappedReadSource(const vector<string> &inputFiles, unsigned parsers,
+			unsigned sectionsPerFile);
+	size_t read(ReadBatch &batch);
+
+	bool isPaired() const
+	{
+		return false;
+	}
+
+	unsigned getParserNum() const
+	{
+		return m_parsers;
+	}
+
+	/*
+	 * Whether every file is an uncompressed FASTQ file that can be mapped
+	 * and the reads do not need trimming while parsing
+	 */
+	static bool canMap(const vector<string> &inputFiles);
+
+	~MappedReadSource();
+
+private:
+	enum SectionState {
+		SECTION_FREE, SECTION_BUSY, SECTION_DONE
+	};
+
+	struct MappedFile {
+		string path;
+		const char *data;
+		size_t size;
+	};
+
+	struct Section {
+		size_t file;
+		//next record to read, and the end of the records of the section
+		//(the last record may extend past it)
+		const char *pos;
+		const char *end;
+		volatile int state;
+	};
+
+	unsigned m_parsers;
+	vector<MappedFile> m_files;
+	vector<Section> m_sections;
+
+	//sections still to be read
+	volatile size_t m_remaining;
+
+	bool readRecord(Section &section, ReadView &view, FastqRecord &rec);
+};
+
+/*
+ * Paired end reads from two files in the same order
+ */
+class PairedReadSource: public ReadSource {
+public:
+	PairedReadSource(const string &file1, const string &file2);
+	size_t read(ReadBatch &batch);
+
+	bool isPaired() const
+	{
+		return true;
+	}
+
+private:
+	FastaReader m_sequence1;
+	FastaReader m_sequence2;
+	bool m_done;
+};
+
+/*
+ * Paired end reads from a single file (or stdin) with each read followed
+ * by its mate
+ */
+class InterleavedReadSource: public ReadSource {
+public:
+	explicit InterleavedReadSource(const string &file);
+	size_t read(ReadBatch &batch);
+
+	bool isPaired() const
+	{
+		return true;
+	}
+
+private:
+	FastaReader m_sequence;
+	bool m_done;
+};
+
+/*
+ * Paired end reads from a single SAM/BAM file in any order
+ * Mates that are next to each other (name collated input) are paired
+ * directly. Other reads are held in a table, split into shards by read
+ * name, until their mate is found. When the reads held take more memory
+ * than allowed, the largest shard is spilled to a temporary file; spilled
+ * reads are paired one shard at a time once the input is exhausted.
+ */
+class SamPairReadSource: public ReadSource {
+public:
+	SamPairReadSource(const string &file, size_t maxMemory);
+	size_t read(ReadBatch &batch);
+
+	bool isPaired() const
+	{
+		return true;
+	}
+
+	~SamPairReadSource();
+
+private:
+	struct Shard {
+		unordered_map<string, FastqRecord> reads;
+		//approximate memory used by the reads held
+		size_t memory;
+		FILE *spill;
+		//approximate memory the reads spilled would take if held
+		size_t spilledMemory;
+	};
+
+	//spilled reads waiting to be paired, split level times by name
+	struct SpillFile {
+		FILE *file;
+		size_t memory;
+		unsigned level;
+	};
+
+	FastaReader m_sequence;
+	FastqRecord m_rec;
+	bool m_inputDone;
+
+	//the previous read, if its mate has not been found yet
+	FastqRecord m_prev;
+	string m_prevName;
+	bool m_hasPrev;
+
+	vector<Shard> m_shards;
+	size_t m_memory;
+	size_t m_maxMemory;
+
+	//pairs found when pairing the spilled reads of a shard
+	vector<FastqRecord> m_ready;
+	size_t m_readyPos;
+	size_t m_drainShard;
+	vector<SpillFile> m_drainFiles;
+
+	void addPair(ReadBatch &batch, size_t count, FastqRecord &rec,
+			FastqRecord &mate) const;
+	void hold(const string &name, FastqRecord &rec);
+	void spill(Shard &shard);
+	void drain(Shard &shard);
+	void splitSpill(const SpillFile &spill);
+	void pairSpill(const SpillFile &spill);
+
+	Shard &shardOf(const string &name)
+	{
+		return m_shards[boost::hash<string>()(name) % m_shards.size()];
+	}
+};
+
+#endif /* READSOURCE_H_ */
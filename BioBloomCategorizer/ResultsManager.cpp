@@ -8,6 +8,8 @@
 #include "ResultsManager.h"
 #include <sstream>
 #include <iostream>
+#include <algorithm>
+#include <math.h>
 #include <BioBloomClassifier.h>
 #if _OPENMP
 # include <omp.h>
@@ -29,6 +31,8 @@ ResultsManager::ResultsManager(const vector<string> &filterOrderRef,
 
 /*
  * Records data for read summary based on thresholds
+ * Not thread safe, each thread should record into its own summary and
+ * add it to the shared one with addSummaryData
  * Returns filter ID that this read equals
  */
 const string ResultsManager::updateSummaryData(
@@ -42,7 +46,6 @@ const string ResultsManager::updateSummaryData(
 			i != m_filterOrder.end(); ++i)
 	{
 		if (hits.at(*i)) {
-#pragma omp atomic
 			++m_aboveThreshold[*i];
 			if (noMatchFlag) {
 				noMatchFlag = false;
@@ -54,16 +57,12 @@ const string ResultsManager::updateSummaryData(
 	}
 	if (noMatchFlag) {
 		filterID = NO_MATCH;
-#pragma omp atomic
 		++m_noMatch;
 	} else {
 		if (multiMatchFlag) {
 			filterID = MULTI_MATCH;
-#pragma omp atomic
 			++m_multiMatch;
 		} else {
-		//TODO : USE LOCKS, # of locks == # of filterIDs
-#pragma omp atomic
 			++m_unique[filterID];
 		}
 	}
@@ -87,7 +86,6 @@ const string ResultsManager::updateSummaryData(
 	{
 		if (m_inclusive) {
 			if (hits1.at(*i) || hits2.at(*i)) {
-#pragma omp atomic
 				++m_aboveThreshold[*i];
 				if (noMatchFlag) {
 					noMatchFlag = false;
@@ -98,7 +96,6 @@ const string ResultsManager::updateSummaryData(
 			}
 		} else {
 			if (hits1.at(*i) && hits2.at(*i)) {
-#pragma omp atomic
 				++m_aboveThreshold[*i];
 				if (noMatchFlag) {
 					noMatchFlag = false;
@@ -111,68 +108,170 @@ const string ResultsManager::updateSummaryData(
 	}
 	if (noMatchFlag) {
 		filterID = NO_MATCH;
-#pragma omp atomic
 		++m_noMatch;
 	} else {
 		if (multiMatchFlag) {
 			filterID = MULTI_MATCH;
-#pragma omp atomic
 			++m_multiMatch;
 		} else {
-#pragma omp atomic
 			++m_unique[filterID];
 		}
 	}
 	return filterID;
 }
 
+/*
+ * Adds the counts recorded by another (thread local) summary to this one and
+ * resets the other summary so it can be reused for the next batch of reads
+ * Not thread safe, callers adding to a shared summary must hold a lock
+ */
+void ResultsManager::addSummaryData(ResultsManager &batchSummary)
+{
+	for (vector<string>::const_iterator i = m_filterOrder.begin();
+			i != m_filterOrder.end(); ++i)
+	{
+		m_aboveThreshold[*i] += batchSummary.m_aboveThreshold[*i];
+		m_unique[*i] += batchSummary.m_unique[*i];
+		batchSummary.m_aboveThreshold[*i] = 0;
+		batchSummary.m_unique[*i] = 0;
+	}
+	m_multiMatch += batchSummary.m_multiMatch;
+	m_noMatch += batchSummary.m_noMatch;
+	batchSummary.m_multiMatch = 0;
+	batchSummary.m_noMatch = 0;
+}
+
 const string ResultsManager::getResultsSummary(size_t readCount) const
 {
+	return getResultsSummary(readCount, false);
+}
 
+/*
+ * Summary for sampled runs. Adds the 95% confidence interval of each hit rate
+ * and the fraction of the scanned reads that were actually classified
+ */
+const string ResultsManager::getResultsSummary(size_t readCount,
+		size_t readsScanned, bool stoppedEarly) const
+{
 	stringstream summaryOutput;
+	summaryOutput << getResultsSummary(readCount, true);
+	summaryOutput << "#sampled_reads\t" << readCount << "\n";
+	summaryOutput << "#scanned_reads\t" << readsScanned << "\n";
+	summaryOutput << "#sampled_fraction\t"
+			<< double(readCount) / double(readsScanned) << "\n";
+	summaryOutput << "#stopped_early\t" << (stoppedEarly ? 1 : 0) << "\n";
+	cerr << summaryOutput.str() << endl;
+	return summaryOutput.str();
+}
 
-	//print header
-	summaryOutput
-			<< "filter_id\thits\tmisses\tshared\trate_hit\trate_miss\trate_shared\n";
+/*
+ * Returns true once the 95% confidence interval of every category has a
+ * half width below the tolerance given (an interval that cannot be
+ * computed is never within it)
+ */
+bool ResultsManager::withinTolerance(double tolerance) const
+{
+	size_t readCount = getReadsCounted();
+	if (readCount == 0) {
+		return false;
+	}
+	double low, high;
+	for (vector<string>::const_iterator i = m_filterOrder.begin();
+			i != m_filterOrder.end(); ++i)
+	{
+		confidenceInterval(m_aboveThreshold.at(*i), readCount, low, high);
+		if (!((high - low) / 2 < tolerance)) {
+			return false;
+		}
+	}
+	confidenceInterval(m_multiMatch, readCount, low, high);
+	if (!((high - low) / 2 < tolerance)) {
+		return false;
+	}
+	confidenceInterval(m_noMatch, readCount, low, high);
+	return (high - low) / 2 < tolerance;
+}
 
+/*
+ * Number of reads recorded so far (every read ends up in exactly one category)
+ */
+size_t ResultsManager::getReadsCounted() const
+{
+	size_t readCount = m_multiMatch + m_noMatch;
 	for (vector<string>::const_iterator i = m_filterOrder.begin();
 			i != m_filterOrder.end(); ++i)
 	{
-		summaryOutput << *i;
-		summaryOutput << "\t" << m_aboveThreshold.at(*i);
-		summaryOutput << "\t" << readCount - m_aboveThreshold.at(*i);
-		summaryOutput << "\t" << (m_aboveThreshold.at(*i) - m_unique.at(*i));
-		summaryOutput << "\t"
-				<< double(m_aboveThreshold.at(*i)) / double(readCount);
-		summaryOutput << "\t"
-				<< double(readCount - m_aboveThreshold.at(*i))
-						/ double(readCount);
-		summaryOutput << "\t"
-				<< double(m_aboveThreshold.at(*i) - m_unique.at(*i))
-						/ double(readCount);
-		summaryOutput << "\n";
+		readCount += m_unique.at(*i);
 	}
+	return readCount;
+}
+
+/*
+ * Wilson score interval (95%) for a proportion
+ */
+void ResultsManager::confidenceInterval(size_t hits, size_t readCount,
+		double &low, double &high) const
+{
+	static const double z = 1.96;
+	double n = double(readCount);
+	double p = min(1.0, double(hits) / n);
+	double denom = 1.0 + z * z / n;
+	double center = (p + z * z / (2.0 * n)) / denom;
+	double halfWidth = z * sqrt(p * (1.0 - p) / n + z * z / (4.0 * n * n))
+			/ denom;
+	low = max(0.0, center - halfWidth);
+	high = min(1.0, center + halfWidth);
+}
 
-	summaryOutput << MULTI_MATCH;
-	summaryOutput << "\t" << m_multiMatch;
-	summaryOutput << "\t" << readCount - m_multiMatch;
-	summaryOutput << "\t" << 0;
-	summaryOutput << "\t" << double(m_multiMatch) / double(readCount);
-	summaryOutput << "\t"
-			<< double(readCount - m_multiMatch) / double(readCount);
-	summaryOutput << "\t" << 0.0;
+void ResultsManager::printSummaryRow(stringstream &summaryOutput,
+		const string &filterID, size_t hits, size_t shared, size_t readCount,
+		bool withInterval) const
+{
+	summaryOutput << filterID;
+	summaryOutput << "\t" << hits;
+	summaryOutput << "\t" << readCount - hits;
+	summaryOutput << "\t" << shared;
+	summaryOutput << "\t" << double(hits) / double(readCount);
+	summaryOutput << "\t" << double(readCount - hits) / double(readCount);
+	summaryOutput << "\t" << double(shared) / double(readCount);
+	if (withInterval) {
+		double low, high;
+		confidenceInterval(hits, readCount, low, high);
+		summaryOutput << "\t" << low << "\t" << high;
+	}
 	summaryOutput << "\n";
+}
+
+const string ResultsManager::getResultsSummary(size_t readCount,
+		bool withInterval) const
+{
+
+	stringstream summaryOutput;
 
-	summaryOutput << NO_MATCH;
-	summaryOutput << "\t" << m_noMatch;
-	summaryOutput << "\t" << readCount - m_noMatch;
-	summaryOutput << "\t" << 0;
-	summaryOutput << "\t" << double(m_noMatch) / double(readCount);
-	summaryOutput << "\t" << double(readCount - m_noMatch) / double(readCount);
-	summaryOutput << "\t" << 0.0;
+	//print header
+	summaryOutput
+			<< "filter_id\thits\tmisses\tshared\trate_hit\trate_miss\trate_shared";
+	if (withInterval) {
+		summaryOutput << "\trate_hit_ci_low\trate_hit_ci_high";
+	}
 	summaryOutput << "\n";
 
-	cerr << summaryOutput.str() << endl;
+	for (vector<string>::const_iterator i = m_filterOrder.begin();
+			i != m_filterOrder.end(); ++i)
+	{
+		printSummaryRow(summaryOutput, *i, m_aboveThreshold.at(*i),
+				m_aboveThreshold.at(*i) - m_unique.at(*i), readCount,
+				withInterval);
+	}
+
+	printSummaryRow(summaryOutput, MULTI_MATCH, m_multiMatch, 0, readCount,
+			withInterval);
+	printSummaryRow(summaryOutput, NO_MATCH, m_noMatch, 0, readCount,
+			withInterval);
+
+	if (!withInterval) {
+		cerr << summaryOutput.str() << endl;
+	}
 	return summaryOutput.str();
 }
 
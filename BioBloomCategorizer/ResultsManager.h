@@ -10,6 +10,7 @@
 
 #include <vector>
 #include <string>
+#include <sstream>
 #include "boost/unordered/unordered_map.hpp"
 #include "boost/shared_ptr.hpp"
 #include "Common/BloomFilterInfo.h"
@@ -26,8 +27,12 @@ public:
 	const string updateSummaryData(const unordered_map<string, bool> &hits);
 	const string updateSummaryData(const unordered_map<string, bool> &hits1,
 			const unordered_map<string, bool> &hits2);
+	void addSummaryData(ResultsManager &batchSummary);
 
 	const string getResultsSummary(size_t readCount) const;
+	const string getResultsSummary(size_t readCount, size_t readsScanned,
+			bool stoppedEarly) const;
+	bool withinTolerance(double tolerance) const;
 	virtual ~ResultsManager();
 private:
 	//Variables copied from biobloomcategorizer
@@ -39,6 +44,14 @@ private:
 	size_t m_noMatch;
 
 	bool m_inclusive;
+
+	size_t getReadsCounted() const;
+	void confidenceInterval(size_t hits, size_t readCount, double &low,
+			double &high) const;
+	void printSummaryRow(stringstream &summaryOutput, const string &filterID,
+			size_t hits, size_t shared, size_t readCount,
+			bool withInterval) const;
+	const string getResultsSummary(size_t readCount, bool withInterval) const;
 };
 
 #endif /* RESULTSMANAGER_H_ */
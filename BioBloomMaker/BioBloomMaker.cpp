@@ -6,9 +6,14 @@
  */
 
 #include <sstream>
+#include <fstream>
 #include <string>
 #include <vector>
 #include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
 #include "BloomFilterGenerator.h"
 #include "Common/BloomFilterInfo.h"
 #include <boost/unordered/unordered_map.hpp>
@@ -27,6 +32,12 @@ namespace opt {
 static unsigned threads = 1;
 }
 
+//long only options
+enum {
+	OPT_SHARD = 256, OPT_MERGE, OPT_UPDATE, OPT_DETERMINISTIC, OPT_MAX_MEM,
+	OPT_DUST, OPT_MAP
+};
+
 void printVersion() {
 	const char VERSION_MESSAGE[] = PROGRAM " (" PACKAGE_NAME ") " VERSION "\n"
 	"Written by Justin Chu.\n"
@@ -42,14 +53,14 @@ void printHelpDialog() {
 		"Usage: biobloommaker -p [FILTERID] -r 0.2 [FILE]... [FASTQ1] [FASTQ2] \n"
 		"Creates a bf and txt file from a list of fasta files. The input sequences are\n"
 		"cut into a k-mers with a sliding window and their hash signatures are inserted\n"
-		"into a bloom filter.\n"
+		"into a bloom filter. Fasta files do not need to be indexed. Compressed files\n"
+		"and - (stdin, which requires -n) are read as a stream.\n"
 		"\n"
 		"  -p, --file_prefix=N    Filter prefix and filter ID. Required option.\n"
 		"  -o, --output_dir=N     Output location of the filter and filter info files.\n"
 		"  -h, --help             Display this dialog.\n"
 		"  -v  --version          Display version information.\n"
-		"  -t, --threads=N        The number of threads to use. Experimental. [1]\n"
-		"                         Currently only active with the (-r) option.\n"
+		"  -t, --threads=N        The number of threads to use. [1]\n"
 		"\nAdvanced options:\n"
 		"  -f, --fal_pos_rate=N   Maximum false positive rate to use in filter. [0.0075]\n"
 		"  -g, --hash_num=N       Set number of hash functions to use in filter instead\n"
@@ -61,18 +72,290 @@ void printHelpDialog() {
 		"                         only use filters with k-mer sizes equal the one you\n"
 		"                         wish to create.\n"
 		"  -n, --num_ele=N        Set the number of expected elements. If set to 0 number\n"
-		"                         is determined from sequences sizes within files. [0]\n"
+		"                         is estimated from the distinct k-mers in the files\n"
+		"                         (with -r, from the sequence sizes). [0]\n"
 		"  -r, --progressive=N    Progressive filter creation. After initial seeding,\n"
 		"                         filter is created by greedly incorporating reads\n"
 		"                         into filter according to score threshold of N.\n"
 		"  -i, --inclusive        If one paired read matches, both reads will be included\n"
 		"                         in the filter. Only active with the (-r) option.\n"
+		"      --deterministic    Make the same progressive filter whatever the number\n"
+		"                         of threads, by scoring reads in batches against the\n"
+		"                         filter as it was before each batch. The sequences\n"
+		"                         the filter is seeded with are then loaded by one\n"
+		"                         thread. Only active with the (-r) option.\n"
+		"      --dust=N           Leave out low complexity k-mers (microsatellites,\n"
+		"                         poly-A), those with a DUST score above N. 2 leaves\n"
+		"                         out repeats of motifs of up to 4 bases with the\n"
+		"                         default k-mer size. [off]\n"
+		"      --max_mem=N        Memory in MB to build the filter in. Filters larger\n"
+		"                         than this are built a stripe at a time, from the\n"
+		"                         k-mer positions of each stripe written to temporary\n"
+		"                         files in the output directory. Needs disk space of\n"
+		"                         about 4 bytes per k-mer per hash function. Cannot be\n"
+		"                         used with -r or -s. [no limit]\n"
+		"      --shard=I/N        Only add the k-mers of part I of N of the input, so a\n"
+		"                         filter can be built by N separate jobs and merged.\n"
+		"                         Each job must be given the same files, -n, -f, -g\n"
+		"                         and -k.\n"
+		"      --merge            Merge partial filters: the files given are .bf files\n"
+		"                         (with their .txt files alongside) built with\n"
+		"                         --shard, or from different files with the same -n,\n"
+		"                         -f, -g and -k. Writes the combined filter and info.\n"
+		"      --update=N         Add the k-mers of the files given to the existing\n"
+		"                         filter N (a .bf file with its .txt file alongside),\n"
+		"                         keeping its size, k-mer size and hash functions. The\n"
+		"                         filter is updated in place unless -p is given.\n"
+		"      --map=N            Make many filters in one pass over the files given.\n"
+		"                         N has a sequence name and the filter ID it goes in\n"
+		"                         on each line; each filter is sized from the lengths\n"
+		"                         of its sequences and written to its ID in the output\n"
+		"                         directory. The files must be uncompressed fasta.\n"
+		"                         Cannot be used with -p, -n, -r, -s or --max_mem.\n"
 		"\n"
 		"Report bugs to <cjustin@bcgsc.ca>.";
 	cerr << dialog << endl;
 	exit(0);
 }
 
+/*
+ * Ors together filters built separately with the same parameters, writing
+ * the result and an info file with their entry counts summed
+ */
+void mergeFilters(const vector<string> &filterFiles, const string &outputDir,
+		const string &filterPrefix) {
+	vector<BloomFilterInfo> infos;
+	vector<string> seqSrcs;
+	size_t totalNum = 0;
+	size_t redundancy = 0;
+	for (vector<string>::const_iterator it = filterFiles.begin();
+			it != filterFiles.end(); ++it) {
+		if (it->length() < 3 || it->substr(it->length() - 3) != ".bf") {
+			cerr << "Error: " << *it << " is not a .bf file" << endl;
+			exit(1);
+		}
+		string infoFileName = it->substr(0, it->length() - 2) + "txt";
+		infos.push_back(BloomFilterInfo(infoFileName));
+		const BloomFilterInfo &info = infos.back();
+		const BloomFilterInfo &first = infos.front();
+		if (info.getKmerSize() != first.getKmerSize()
+				|| info.getHashNum() != first.getHashNum()
+				|| info.getCalcuatedFilterSize()
+						!= first.getCalcuatedFilterSize()) {
+			cerr << "Error: " << *it << " does not have the same k-mer size, "
+					"number of hash functions and size as " << filterFiles[0]
+					<< endl;
+			exit(1);
+		}
+		for (vector<string>::const_iterator src = info.getSeqSrcs().begin();
+				src != info.getSeqSrcs().end(); ++src) {
+			if (find(seqSrcs.begin(), seqSrcs.end(), *src) == seqSrcs.end()) {
+				seqSrcs.push_back(*src);
+			}
+		}
+		totalNum += info.getTotalNum();
+		redundancy += info.getRedundancy();
+	}
+
+	const BloomFilterInfo &first = infos.front();
+	BloomFilterInfo info(filterPrefix, first.getKmerSize(), first.getHashNum(),
+			first.getDesiredFPR(), first.getExpectedNumEntries(), seqSrcs);
+	if (info.getCalcuatedFilterSize() != first.getCalcuatedFilterSize()) {
+		cerr << "Error: " << filterFiles[0]
+				<< " was not built with the size its info file implies" << endl;
+		exit(1);
+	}
+
+	BloomFilter filter(first.getCalcuatedFilterSize(), first.getHashNum(),
+			first.getKmerSize(), filterFiles[0]);
+	for (size_t i = 1; i < filterFiles.size(); ++i) {
+		cerr << "Merging Filter: " << filterFiles[i] << endl;
+		filter.mergeFilter(filterFiles[i]);
+	}
+	filter.storeFilter(outputDir + filterPrefix + ".bf");
+	info.setTotalNum(totalNum);
+	info.setRedundancy(redundancy);
+	info.printInfoFile(outputDir + filterPrefix + ".txt");
+	cerr << "Filter Merge Complete." << endl;
+}
+
+/*
+ * Adds the k-mers of the input files to an existing filter, writing it to
+ * outputDir + filterPrefix (or back to where it was read if there is no
+ * prefix) with its entry counts updated
+ */
+void updateFilters(const string &filterFile, const vector<string> &inputFiles,
+		const string &outputDir, const string &filterPrefix,
+		double dustThreshold) {
+	if (filterFile.length() < 3
+			|| filterFile.substr(filterFile.length() - 3) != ".bf") {
+		cerr << "Error: " << filterFile << " is not a .bf file" << endl;
+		exit(1);
+	}
+	string infoFileName = filterFile.substr(0, filterFile.length() - 2)
+			+ "txt";
+	BloomFilterInfo oldInfo(infoFileName);
+
+	vector<string> seqSrcs = oldInfo.getSeqSrcs();
+	for (vector<string>::const_iterator it = inputFiles.begin();
+			it != inputFiles.end(); ++it) {
+		if (find(seqSrcs.begin(), seqSrcs.end(), *it) == seqSrcs.end()) {
+			seqSrcs.push_back(*it);
+		}
+	}
+	string filterID = filterPrefix.empty() ? oldInfo.getFilterID() : filterPrefix;
+	string outputPrefix =
+			filterPrefix.empty() ?
+					filterFile.substr(0, filterFile.length() - 3) :
+					outputDir + filterPrefix;
+	BloomFilterInfo info(filterID, oldInfo.getKmerSize(),
+			oldInfo.getHashNum(), oldInfo.getDesiredFPR(),
+			oldInfo.getExpectedNumEntries(), seqSrcs);
+	if (info.getCalcuatedFilterSize() != oldInfo.getCalcuatedFilterSize()) {
+		cerr << "Error: " << filterFile
+				<< " was not built with the size its info file implies" << endl;
+		exit(1);
+	}
+
+	BloomFilterGenerator filterGen(inputFiles, oldInfo.getKmerSize(),
+			oldInfo.getHashNum(), oldInfo.getExpectedNumEntries());
+	filterGen.setFilterSize(oldInfo.getCalcuatedFilterSize());
+	if (dustThreshold > 0) {
+		filterGen.setDust(dustThreshold);
+	}
+	//written to temporary files that replace the outputs once complete, so
+	//a failed update leaves the filter being updated as it was
+	string tempPrefix = outputPrefix + ".tmp";
+	size_t redundNum = filterGen.update(tempPrefix + ".bf", filterFile);
+
+	info.setTotalNum(oldInfo.getTotalNum() + filterGen.getTotalEntries());
+	info.setRedundancy(oldInfo.getRedundancy() + redundNum);
+	cerr << "Added " << filterGen.getTotalEntries() << " k-mers ("
+			<< redundNum << " already in the filter)" << endl;
+	if (info.getFPR() > info.getDesiredFPR()) {
+		cerr << "Warning: The approximate false positive rate of the filter ("
+				<< info.getFPR() << ") now exceeds the rate it was made for ("
+				<< info.getDesiredFPR()
+				<< "). Consider making it again from all of its sequences."
+				<< endl;
+	}
+	info.printInfoFile(tempPrefix + ".txt");
+	if (rename((tempPrefix + ".bf").c_str(), (outputPrefix + ".bf").c_str())
+			!= 0
+			|| rename((tempPrefix + ".txt").c_str(),
+					(outputPrefix + ".txt").c_str()) != 0) {
+		cerr << "Error: could not replace " << outputPrefix
+				<< ".bf and .txt: " << strerror(errno) << endl;
+		exit(1);
+	}
+	cerr << "Filter Update Complete." << endl;
+}
+
+/*
+ * Reads a map of sequence names to filter IDs, a name and an ID separated by
+ * whitespace on each line. Filters are numbered in the order their IDs first
+ * appear.
+ */
+void readTargetMap(const string &mapFile,
+		boost::unordered_map<string, unsigned> &targets,
+		vector<string> &filterIDs) {
+	ifstream in(mapFile.c_str());
+	if (!in) {
+		cerr << "Error: could not open " << mapFile << endl;
+		exit(1);
+	}
+	boost::unordered_map<string, unsigned> ids;
+	string line;
+	for (size_t lineNum = 1; getline(in, line); ++lineNum) {
+		stringstream ss(line);
+		string header, filterID;
+		if (!(ss >> header)) {
+			continue;
+		}
+		if (!(ss >> filterID)) {
+			cerr << "Error: " << mapFile << ":" << lineNum
+					<< ": expected a sequence name and a filter ID" << endl;
+			exit(1);
+		}
+		if (filterID.find('/') != string::npos) {
+			cerr << "Error: " << mapFile << ":" << lineNum
+					<< ": filter ID cannot have '/' characters" << endl;
+			exit(1);
+		}
+		boost::unordered_map<string, unsigned>::iterator id = ids.find(
+				filterID);
+		if (id == ids.end()) {
+			id = ids.insert(make_pair(filterID, unsigned(filterIDs.size()))).first;
+			filterIDs.push_back(filterID);
+		}
+		boost::unordered_map<string, unsigned>::iterator target =
+				targets.find(header);
+		if (target != targets.end() && target->second != id->second) {
+			cerr << "Error: " << mapFile << ":" << lineNum << ": " << header
+					<< " is mapped to both " << filterIDs[target->second]
+					<< " and " << filterID << endl;
+			exit(1);
+		}
+		targets[header] = id->second;
+	}
+	if (filterIDs.empty()) {
+		cerr << "Error: " << mapFile << " does not map any sequences" << endl;
+		exit(1);
+	}
+}
+
+/*
+ * Makes a filter for each filter ID of mapFile in one pass over the input
+ * files, each sized from the lengths of the sequences mapped to it
+ */
+void makeMappedFilters(const string &mapFile,
+		const vector<string> &inputFiles, const string &outputDir,
+		unsigned kmerSize, unsigned hashNum, double fpr,
+		double dustThreshold) {
+	boost::unordered_map<string, unsigned> targets;
+	vector<string> filterIDs;
+	readTargetMap(mapFile, targets, filterIDs);
+
+	BloomFilterGenerator filterGen(inputFiles, kmerSize, hashNum, 1);
+	if (dustThreshold > 0) {
+		filterGen.setDust(dustThreshold);
+	}
+	vector<size_t> entries = filterGen.countTargetEntries(targets,
+			filterIDs.size());
+
+	vector<BloomFilterInfo> infos;
+	vector<string> filterFiles;
+	vector<size_t> filterSizes;
+	size_t totalSize = 0;
+	for (size_t i = 0; i < filterIDs.size(); ++i) {
+		if (entries[i] == 0) {
+			cerr << "Error: no k-mers in the input files are mapped to "
+					<< filterIDs[i] << endl;
+			exit(1);
+		}
+		infos.push_back(
+				BloomFilterInfo(filterIDs[i], kmerSize, hashNum, fpr,
+						entries[i], inputFiles));
+		filterFiles.push_back(outputDir + filterIDs[i] + ".bf");
+		filterSizes.push_back(infos.back().getCalcuatedFilterSize());
+		totalSize += filterSizes.back();
+	}
+	cerr << "Allocating " << totalSize << " bits of space for "
+			<< filterIDs.size() << " filters" << endl;
+
+	vector<size_t> totalEntries;
+	vector<size_t> redundancy;
+	filterGen.generateMany(filterFiles, targets, filterSizes, totalEntries,
+			redundancy);
+
+	for (size_t i = 0; i < infos.size(); ++i) {
+		infos[i].setTotalNum(totalEntries[i]);
+		infos[i].setRedundancy(redundancy[i]);
+		infos[i].printInfoFile(outputDir + filterIDs[i] + ".txt");
+	}
+	cerr << "Filter Creation Complete." << endl;
+}
+
 int main(int argc, char *argv[]) {
 
 	bool die = false;
@@ -90,6 +373,14 @@ int main(int argc, char *argv[]) {
 	size_t entryNum = 0;
 	double progressive = -1;
 	bool inclusive = false;
+	bool deterministic = false;
+	unsigned shard = 0;
+	unsigned shards = 1;
+	bool merge = false;
+	string updateFilter = "";
+	size_t maxMemory = 0;
+	double dustThreshold = 0;
+	string mapFile = "";
 
 	//long form arguments
 	static struct option long_options[] = {
@@ -106,6 +397,13 @@ int main(int argc, char *argv[]) {
 					"num_ele", required_argument, NULL, 'n' }, {
 					"help", no_argument, NULL, 'h' }, {
 					"progressive", required_argument, NULL, 'r' }, {
+					"shard", required_argument, NULL, OPT_SHARD }, {
+					"merge", no_argument, NULL, OPT_MERGE }, {
+					"update", required_argument, NULL, OPT_UPDATE }, {
+					"deterministic", no_argument, NULL, OPT_DETERMINISTIC }, {
+					"max_mem", required_argument, NULL, OPT_MAX_MEM }, {
+					"dust", required_argument, NULL, OPT_DUST }, {
+					"map", required_argument, NULL, OPT_MAP }, {
 					NULL, 0, NULL, 0 } };
 
 	//actual checking step
@@ -207,6 +505,51 @@ int main(int argc, char *argv[]) {
 			}
 			break;
 		}
+		case OPT_SHARD: {
+			stringstream convert(optarg);
+			char slash;
+			if (!(convert >> shard >> slash >> shards) || slash != '/'
+					|| shard == 0 || shard > shards) {
+				cerr << "Error - Invalid parameter! shard: " << optarg
+						<< endl;
+				exit(EXIT_FAILURE);
+			}
+			--shard;
+			break;
+		}
+		case OPT_MERGE: {
+			merge = true;
+			break;
+		}
+		case OPT_UPDATE: {
+			updateFilter = optarg;
+			break;
+		}
+		case OPT_DETERMINISTIC: {
+			deterministic = true;
+			break;
+		}
+		case OPT_DUST: {
+			stringstream convert(optarg);
+			if (!(convert >> dustThreshold) || dustThreshold <= 0) {
+				cerr << "Error - Invalid parameter! dust: " << optarg << endl;
+				exit(EXIT_FAILURE);
+			}
+			break;
+		}
+		case OPT_MAP: {
+			mapFile = optarg;
+			break;
+		}
+		case OPT_MAX_MEM: {
+			stringstream convert(optarg);
+			if (!(convert >> maxMemory) || maxMemory == 0) {
+				cerr << "Error - Invalid parameter! max_mem: " << optarg
+						<< endl;
+				exit(EXIT_FAILURE);
+			}
+			break;
+		}
 		default: {
 			die = true;
 			break;
@@ -232,25 +575,67 @@ int main(int argc, char *argv[]) {
 		cerr << "Need Input File" << endl;
 		die = true;
 	}
-	if (filterPrefix.size() == 0) {
+	if (filterPrefix.size() == 0 && updateFilter.empty() && mapFile.empty()) {
 		cerr << "Need Filter Prefix ID" << endl;
 		die = true;
 	}
+	if (!updateFilter.empty()
+			&& (merge || progressive != -1 || !subtractFilter.empty())) {
+		cerr << "--update cannot be used with --merge, -r or -s" << endl;
+		die = true;
+	}
 	if (filterPrefix.find('/') != string::npos) {
 		cerr << "Prefix ID cannot have '/' characters" << endl;
 		die = true;
 	}
+	if (shards > 1 && entryNum == 0) {
+		cerr << "--shard requires the number of elements (-n) so that every "
+				"part is the same size" << endl;
+		die = true;
+	}
+	if (maxMemory > 0 && (progressive != -1 || !subtractFilter.empty())) {
+		cerr << "--max_mem cannot be used with -r or -s" << endl;
+		die = true;
+	}
+	if (shards > 1 && progressive != -1) {
+		cerr << "--shard cannot be used with progressive mode (-r)" << endl;
+		die = true;
+	}
+	if (!mapFile.empty()
+			&& (!filterPrefix.empty() || entryNum != 0 || progressive != -1
+					|| !subtractFilter.empty() || merge
+					|| !updateFilter.empty() || shards > 1 || maxMemory > 0)) {
+		cerr << "--map cannot be used with -p, -n, -r, -s, --merge, --update, "
+				"--shard or --max_mem" << endl;
+		die = true;
+	}
 	if (die) {
 		cerr << "Try '--help' for more information.\n";
 		exit(EXIT_FAILURE);
 	}
 
+	if (merge) {
+		mergeFilters(inputFiles, outputDir, filterPrefix);
+		return 0;
+	}
+	if (!updateFilter.empty()) {
+		updateFilters(updateFilter, inputFiles, outputDir, filterPrefix,
+				dustThreshold);
+		return 0;
+	}
+
 	//set number of hash functions used
 	if (hashNum == 0) {
 		//get optimal number of hash functions
 		hashNum = unsigned(-log(fpr) / log(2));
 	}
 
+	if (!mapFile.empty()) {
+		makeMappedFilters(mapFile, inputFiles, outputDir, kmerSize, hashNum,
+				fpr, dustThreshold);
+		return 0;
+	}
+
 	string file1 = "";
 	string file2 = "";
 
@@ -267,12 +652,27 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
-	//create filter
-	BloomFilterGenerator filterGen(inputFiles, kmerSize, hashNum, entryNum);
+	//create filter, counting the k-mers in the input unless given
+	//progressive filters keep room for k-mers from reads, so are sized from
+	//every k-mer of the input rather than the distinct ones
+	BloomFilterGenerator filterGen =
+			entryNum == 0 && progressive != -1 ?
+					BloomFilterGenerator(inputFiles, kmerSize, hashNum) :
+					BloomFilterGenerator(inputFiles, kmerSize, hashNum,
+							entryNum);
+
+	if (dustThreshold > 0) {
+		filterGen.setDust(dustThreshold);
+	}
 
+	//whether the filter is sized for distinct k-mers, so redundancy does not
+	//make it larger than needed
+	bool estimated = entryNum == 0 && progressive == -1;
 	if (entryNum == 0) {
-		filterGen = BloomFilterGenerator(inputFiles, kmerSize, hashNum);
-		entryNum = filterGen.getExpectedEntries();
+		entryNum =
+				estimated ?
+						filterGen.estimateEntries() :
+						filterGen.getExpectedEntries();
 	}
 
 	BloomFilterInfo info(filterPrefix, kmerSize, hashNum, fpr, entryNum,
@@ -282,6 +682,8 @@ int main(int argc, char *argv[]) {
 	size_t filterSize = info.getCalcuatedFilterSize();
 	cerr << "Allocating " << filterSize << " bits of space for filter and will output filter this size" << endl;
 	filterGen.setFilterSize(filterSize);
+	filterGen.setShard(shard, shards);
+	filterGen.setDeterministic(deterministic);
 
 	size_t redundNum = 0;
 	//output filter
@@ -304,6 +706,9 @@ int main(int argc, char *argv[]) {
 		redundNum = filterGen.generateProgressive(
 				outputDir + filterPrefix + ".bf", progressive, file1, file2,
 				mode);
+	} else if (maxMemory > 0 && filterSize / 8 > maxMemory << 20) {
+		redundNum = filterGen.generateStriped(outputDir + filterPrefix + ".bf",
+				maxMemory << 20);
 	} else {
 		redundNum = filterGen.generate(outputDir + filterPrefix + ".bf");
 	}
@@ -314,7 +719,7 @@ int main(int argc, char *argv[]) {
 	//calculate redundancy rate
 	double redunRate = double(redundNum) / double(filterGen.getTotalEntries())
 			- info.getRedundancyFPR();
-	if (redunRate > 0.25) {
+	if (redunRate > 0.25 && !estimated) {
 		cerr
 				<< "The ratio between redundant k-mers and unique k-mers is approximately: "
 				<< redunRate << endl;
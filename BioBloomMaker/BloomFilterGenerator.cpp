@@ -20,6 +20,55 @@
 #include <cmath>
 #include <FastaReader.h>
 #include "Common/SeqEval.h"
+#include "Common/HyperLogLog.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+//k-mers per section of a sequence loaded by one thread
+static const size_t GENERATE_SECTION_SIZE = 1 << 20;
+
+//read pairs read at a time by a thread building a progressive filter, kept
+//small as pairs read together cannot add each other to the filter
+static const size_t PROGRESSIVE_BATCH_SIZE = 64;
+
+//read pairs scored together in deterministic mode
+static const size_t DETERMINISTIC_BATCH_SIZE = 256;
+
+//largest stripe of a filter built in stripes whose bit positions are
+//stored in 32 bits, larger stripes store them in 64 bits
+static const size_t MAX_STRIPE_BYTES = size_t(1) << 29;
+
+//most temporary files a filter is built through, stripes are made larger
+//(and fewer built at once) rather than open more
+static const size_t MAX_STRIPE_FILES = 256;
+
+//positions buffered per stripe by each thread before they are written out,
+//and read back at a time
+static const size_t MAX_STRIPE_BUFFER = 1 << 16;
+static const size_t MIN_STRIPE_BUFFER = 1 << 8;
+
+static unsigned maxThreads()
+{
+#if _OPENMP
+	return omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+static unsigned threadNum()
+{
+#if _OPENMP
+	return omp_get_thread_num();
+#else
+	return 0;
+#endif
+}
 
 //Todo Refactor to remove repetitive and potentially error prone parts of code
 
@@ -31,19 +80,9 @@
 BloomFilterGenerator::BloomFilterGenerator(vector<string> const &filenames,
 		unsigned kmerSize, unsigned hashNum):
 		m_kmerSize(kmerSize), m_hashNum(hashNum), m_expectedEntries(0), m_filterSize(0), m_totalEntries(
-				0), m_redundancy(0){
-
+				0), m_redundancy(0), m_shard(0), m_shards(1), m_deterministic(false), m_dustThreshold(0){
 	//for each file loop over all headers and obtain max number of elements
-	for (vector<string>::const_iterator i = filenames.begin();
-			i != filenames.end(); ++i) {
-		WindowedFileParser parser(*i, kmerSize);
-		m_fileNamesAndHeaders[*i] = parser.getHeaders();
-		for (vector<string>::iterator j = m_fileNamesAndHeaders[*i].begin();
-				j != m_fileNamesAndHeaders[*i].end(); ++j) {
-			//subtract kmer size for max number of possible kmers
-			m_expectedEntries += parser.getSequenceSize(*j) - kmerSize + 1;
-		}
-	}
+	indexFiles(filenames, true);
 }
 
 /*
@@ -55,12 +94,53 @@ BloomFilterGenerator::BloomFilterGenerator(vector<string> const &filenames,
 BloomFilterGenerator::BloomFilterGenerator(vector<string> const &filenames,
 		unsigned kmerSize, unsigned hashNum, size_t numElements) :
 		m_kmerSize(kmerSize), m_hashNum(hashNum),  m_expectedEntries(numElements), m_filterSize(
-				0), m_totalEntries(0), m_redundancy(0) {
-	//for each file loop over all headers and obtain max number of elements
+				0), m_totalEntries(0), m_redundancy(0), m_shard(0), m_shards(1), m_deterministic(false), m_dustThreshold(0) {
+	indexFiles(filenames, false);
+}
+
+/*
+ * Maps and indexes the uncompressed fasta files. Other files (compressed or
+ * stdin) are streamed when the filter is made; if countEntries is set they
+ * are read once here as well to count their k-mers, except for stdin.
+ */
+void BloomFilterGenerator::indexFiles(vector<string> const &filenames,
+		bool countEntries)
+{
 	for (vector<string>::const_iterator i = filenames.begin();
 			i != filenames.end(); ++i) {
-		WindowedFileParser parser(*i, kmerSize);
-		m_fileNamesAndHeaders[*i] = parser.getHeaders();
+		if (!WindowedFileParser::canMap(*i)) {
+			m_streamedFiles.push_back(*i);
+			if (!countEntries) {
+				continue;
+			}
+			if (*i == "-") {
+				cerr << "Error: The number of elements (-n) must be given "
+						"to read sequences from stdin." << endl;
+				exit(1);
+			}
+			FastaReader reader(i->c_str(), FastaReader::NO_FOLD_CASE);
+			for (FastaRecord rec; reader >> rec;) {
+				if (rec.seq.length() >= m_kmerSize) {
+					m_expectedEntries += rec.seq.length() - m_kmerSize + 1;
+				}
+			}
+			continue;
+		}
+		boost::shared_ptr<WindowedFileParser> parser(
+				new WindowedFileParser(*i, m_kmerSize));
+		m_parsers[*i] = parser;
+		m_fileNamesAndHeaders[*i] = parser->getHeaders();
+		if (!countEntries) {
+			continue;
+		}
+		for (vector<string>::iterator j = m_fileNamesAndHeaders[*i].begin();
+				j != m_fileNamesAndHeaders[*i].end(); ++j) {
+			//subtract kmer size for max number of possible kmers
+			size_t size = parser->getSequenceSize(*j);
+			if (size >= m_kmerSize) {
+				m_expectedEntries += size - m_kmerSize + 1;
+			}
+		}
 	}
 }
 
@@ -82,25 +162,28 @@ size_t BloomFilterGenerator::generate(const string &filename) {
 	//setup bloom filter
 	BloomFilter filter(m_filterSize, m_hashNum, m_kmerSize);
 
-	//for each file loop over all headers and obtain seq
-	//load input file + make filter
-	for (boost::unordered_map<string, vector<string> >::iterator i =
-			m_fileNamesAndHeaders.begin(); i != m_fileNamesAndHeaders.end(); ++i) {
-		//let user know that files are being read
-		cerr << "Processing File: " << i->first << endl;
-		WindowedFileParser parser(i->first, m_kmerSize);
-		for (vector<string>::iterator j = i->second.begin();
-				j != i->second.end(); ++j) {
-			parser.setLocationByHeader(*j);
-			//object to process reads
-			//insert elements into filter
-			//read fasta file line by line and split using sliding window
-			while (parser.notEndOfSeqeunce()) {
-				const unsigned char* currentSeq = parser.getNextSeq();
-				checkAndInsertKmer(currentSeq, filter);
-			}
-		}
-	}
+	//load input files + make filter
+	loadFiles(filter, NULL);
+	filter.storeFilter(filename);
+	return m_redundancy;
+}
+
+/*
+ * Adds the k-mers of the input files to the existing filter stored at
+ * existingFilter (which must be of the size set), outputting it to filename
+ * Returns the m_redundancy of the k-mers added.
+ */
+size_t BloomFilterGenerator::update(const string &filename,
+		const string &existingFilter) {
+
+	//need the number of hash functions used to be greater than 0
+	assert(m_hashNum > 0);
+
+	//load existing bloom filter
+	BloomFilter filter(m_filterSize, m_hashNum, m_kmerSize, existingFilter);
+
+	//load input files into filter
+	loadFiles(filter, NULL);
 	filter.storeFilter(filename);
 	return m_redundancy;
 }
@@ -145,165 +228,9 @@ size_t BloomFilterGenerator::generateProgressive(const string &filename,
 		exit(1);
 	}
 
-	//for each file loop over all headers and obtain seq
-	//load input file + make filter
-	for (boost::unordered_map<string, vector<string> >::iterator i =
-			m_fileNamesAndHeaders.begin(); i != m_fileNamesAndHeaders.end(); ++i) {
-		//let user know that files are being read
-		cerr << "Processing File: " << i->first << endl;
-		WindowedFileParser parser(i->first, m_kmerSize);
-		for (vector<string>::iterator j = i->second.begin();
-				j != i->second.end(); ++j) {
-			parser.setLocationByHeader(*j);
-			//object to process reads
-			//insert elements into filter
-			//read fasta file line by line and split using sliding window
-			while (parser.notEndOfSeqeunce()) {
-				const unsigned char* currentSeq = parser.getNextSeq();
-				checkAndInsertKmer(currentSeq, filter);
-			}
-		}
-	}
-
-	size_t totalReads = 0;
-
-	FastaReader sequence1(file1.c_str(), FastaReader::NO_FOLD_CASE);
-	FastaReader sequence2(file2.c_str(), FastaReader::NO_FOLD_CASE);
-#pragma omp parallel
-	for (FastqRecord rec1;;) {
-		FastqRecord rec2;
-		bool good1;
-		bool good2;
-
-		if (m_totalEntries >= m_expectedEntries) {
-			//so threshold message only printed once
-			if (sequence1.eof() || sequence1.eof()) {
-				break;
-			}
-#pragma omp critical(breakClose)
-			{
-				sequence1.breakClose();
-				sequence2.breakClose();
-				cerr << "K-mer threshold reached at read " << totalReads << endl;
-			}
-		}
-
-#pragma omp critical(sequence)
-		{
-			good1 = sequence1 >> rec1;
-			good2 = sequence2 >> rec2;
-		}
-
-		if (good1 && good2) {
-#pragma omp critical(totalReads)
-			{
-				++totalReads;
-				if (totalReads % 10000000 == 0) {
-					cerr << "Currently Reading Read Number: " << totalReads
-							<< endl;
-				}
-			}
-			ReadsProcessor proc(m_kmerSize);
-			string tempStr1 = rec1.id.substr(0, rec1.id.find_last_of("/"));
-			string tempStr2 = rec2.id.substr(0, rec2.id.find_last_of("/"));
-			if (tempStr1 == tempStr2) {
-				unsigned size1 = rec1.seq.length() - m_kmerSize + 1;
-				unsigned size2 = rec2.seq.length() - m_kmerSize + 1;
-				vector<vector<size_t> > hashValues1(size1);
-				vector<vector<size_t> > hashValues2(size2);
-				switch (mode) {
-				case PROG_INC: {
-					if (SeqEval::evalSingle(rec1, m_kmerSize, filter,
-									score * double(size1),
-									(1.0 - score) * double(size1), m_hashNum,
-									hashValues1, filterSub)) {
-						//load remaining sequences
-						for (unsigned i = 0; i < size1; ++i) {
-							if (hashValues1[i].empty()) {
-								const unsigned char* currentSeq = proc.prepSeq(
-										rec1.seq, i);
-								checkAndInsertKmer(currentSeq, filter);
-							} else {
-								insertKmer(hashValues1[i], filter);
-							}
-						}
-						//load store second read
-						for (unsigned i = 0; i < size2; ++i) {
-							const unsigned char* currentSeq = proc.prepSeq(
-									rec2.seq, i);
-							checkAndInsertKmer(currentSeq, filter);
-						}
-					} else if (SeqEval::evalSingle(rec2, m_kmerSize, filter,
-									score * size2, (1.0 - score) * size2, m_hashNum,
-									hashValues2, filterSub)) {
-						//load remaining sequences
-						for (unsigned i = 0; i < size1; ++i) {
-							if (hashValues1[i].empty()) {
-								const unsigned char* currentSeq = proc.prepSeq(
-										rec1.seq, i);
-								checkAndInsertKmer(currentSeq, filter);
-							} else {
-								insertKmer(hashValues1[i], filter);
-							}
-						}
-						//load store second read
-						for (unsigned i = 0; i < size2; ++i) {
-							if (hashValues2[i].empty()) {
-								const unsigned char* currentSeq = proc.prepSeq(
-										rec2.seq, i);
-								checkAndInsertKmer(currentSeq, filter);
-							} else {
-								insertKmer(hashValues2[i], filter);
-							}
-						}
-					}
-					break;
-				}
-				case PROG_STD: {
-					if (SeqEval::evalSingle(rec1, m_kmerSize, filter,
-							score * double(size1),
-							(1.0 - score) * double(size1), m_hashNum,
-							hashValues1, filterSub)
-							&& SeqEval::evalSingle(rec2, m_kmerSize, filter,
-									score * size2, (1.0 - score) * size2,
-									m_hashNum, hashValues2, filterSub)) {
-						//load remaining sequences
-						for (unsigned i = 0; i < size1; ++i) {
-							if (hashValues1[i].empty()) {
-								const unsigned char* currentSeq = proc.prepSeq(
-										rec1.seq, i);
-								checkAndInsertKmer(currentSeq, filter);
-							} else {
-								insertKmer(hashValues1[i], filter);
-							}
-						}
-						//load store second read
-						for (unsigned i = 0; i < size2; ++i) {
-							if (hashValues2[i].empty()) {
-								const unsigned char* currentSeq = proc.prepSeq(
-										rec2.seq, i);
-								checkAndInsertKmer(currentSeq, filter);
-							} else {
-								insertKmer(hashValues2[i], filter);
-							}
-						}
-					}
-					break;
-				}
-				}
-			} else {
-				cerr << "Read IDs do not match" << "\n" << tempStr1 << "\n"
-						<< tempStr2 << endl;
-				exit(1);
-			}
-		} else
-			break;
-	}
-	if (!sequence1.eof() || !sequence2.eof()) {
-		cerr
-				<< "error: eof bit not flipped. Input files may be different lengths"
-				<< endl;
-	}
+	//load input files + make filter
+	loadSeedFiles(filter);
+	loadReadPairs(filter, score, file1, file2, mode, &filterSub);
 
 	filter.storeFilter(filename);
 	return m_redundancy;
@@ -332,171 +259,261 @@ size_t BloomFilterGenerator::generateProgressive(const string &filename,
 	//setup bloom filter
 	BloomFilter filter(m_filterSize, m_hashNum, m_kmerSize);
 
-	//for each file loop over all headers and obtain seq
-	//load input file + make filter
-	for (boost::unordered_map<string, vector<string> >::iterator i =
-			m_fileNamesAndHeaders.begin(); i != m_fileNamesAndHeaders.end(); ++i) {
-		//let user know that files are being read
-		cerr << "Processing File: " << i->first << endl;
-		WindowedFileParser parser(i->first, m_kmerSize);
-		for (vector<string>::iterator j = i->second.begin();
-				j != i->second.end(); ++j) {
-			parser.setLocationByHeader(*j);
-			//object to process reads
-			//insert elements into filter
-			//read fasta file line by line and split using sliding window
-			while (parser.notEndOfSeqeunce()) {
-				const unsigned char* currentSeq = parser.getNextSeq();
-				checkAndInsertKmer(currentSeq, filter);
-			}
+	//load input files + make filter
+	loadSeedFiles(filter);
+	loadReadPairs(filter, score, file1, file2, mode, NULL);
+
+	filter.storeFilter(filename);
+	return m_redundancy;
+}
+
+/*
+ * Reads the next batch of read pairs (as many as reads1 holds), counting
+ * them in totalReads. Returns the number of pairs read.
+ */
+static size_t readPairs(FastaReader &sequence1, FastaReader &sequence2,
+		vector<FastqRecord> &reads1, vector<FastqRecord> &reads2,
+		size_t &totalReads)
+{
+	size_t count = 0;
+	while (count < reads1.size()) {
+		//read both so each sees its end of file
+		bool good1 = sequence1 >> reads1[count];
+		bool good2 = sequence2 >> reads2[count];
+		if (!good1 || !good2) {
+			break;
+		}
+		++count;
+		if (++totalReads % 10000000 == 0) {
+			cerr << "Currently Reading Read Number: " << totalReads << endl;
 		}
 	}
+	return count;
+}
 
-	size_t totalReads = 0;
+/*
+ * Clears the hash values of the first kmers k-mers of a read, keeping the
+ * memory of each for the next read
+ */
+static void clearHashes(vector<vector<size_t> > &hashValues, size_t kmers)
+{
+	if (hashValues.size() < kmers) {
+		hashValues.resize(kmers);
+	}
+	for (size_t i = 0; i < kmers; ++i) {
+		hashValues[i].clear();
+	}
+}
 
+/*
+ * Whether the pair of reads should be added to the filter, that is, whether
+ * both (or with PROG_INC, either) score at least score against the filter.
+ * The hash values computed along the way are kept in hashes.
+ */
+bool BloomFilterGenerator::evalPair(const BloomFilter &filter, double score,
+		createMode mode, const BloomFilter *filterSub, const FastqRecord &rec1,
+		const FastqRecord &rec2, PairHashes &hashes) const
+{
+	string tempStr1 = rec1.id.substr(0, rec1.id.find_last_of("/"));
+	string tempStr2 = rec2.id.substr(0, rec2.id.find_last_of("/"));
+	if (tempStr1 != tempStr2) {
+		cerr << "Read IDs do not match" << "\n" << tempStr1 << "\n"
+				<< tempStr2 << endl;
+		exit(1);
+	}
+	size_t size1 = rec1.seq.length() < m_kmerSize ?
+			0 : rec1.seq.length() - m_kmerSize + 1;
+	size_t size2 = rec2.seq.length() < m_kmerSize ?
+			0 : rec2.seq.length() - m_kmerSize + 1;
+	clearHashes(hashes.read1, size1);
+	clearHashes(hashes.read2, size2);
+
+	bool pass1 =
+			filterSub == NULL ?
+					SeqEval::evalSingle(rec1, m_kmerSize, filter,
+							score * double(size1),
+							(1.0 - score) * double(size1), m_hashNum,
+							hashes.read1) :
+					SeqEval::evalSingle(rec1, m_kmerSize, filter,
+							score * double(size1),
+							(1.0 - score) * double(size1), m_hashNum,
+							hashes.read1, *filterSub);
+	if (pass1 == (mode == PROG_INC)) {
+		return pass1;
+	}
+	return filterSub == NULL ?
+			SeqEval::evalSingle(rec2, m_kmerSize, filter, score * double(size2),
+					(1.0 - score) * double(size2), m_hashNum, hashes.read2) :
+			SeqEval::evalSingle(rec2, m_kmerSize, filter, score * double(size2),
+					(1.0 - score) * double(size2), m_hashNum, hashes.read2,
+					*filterSub);
+}
+
+/*
+ * Takes one of the m_expectedEntries entries of the filter for a new k-mer.
+ * The count is only ever raised by a compare-and-swap from below the budget,
+ * so it cannot pass it however many threads insert at once.
+ * Returns false if the budget is used up.
+ */
+bool BloomFilterGenerator::reserveEntry()
+{
+	size_t entries = m_totalEntries;
+	while (entries < m_expectedEntries) {
+		size_t seen = __sync_val_compare_and_swap(&m_totalEntries, entries,
+				entries + 1);
+		if (seen == entries) {
+			return true;
+		}
+		entries = seen;
+	}
+	return false;
+}
+
+/*
+ * Inserts the k-mers of a read, using the hash values already computed for
+ * it. Returns false if the filter is full before the read is done.
+ */
+bool BloomFilterGenerator::insertRead(BloomFilter &filter,
+		const FastqRecord &rec, vector<vector<size_t> > &hashValues,
+		PairHashes &hashes)
+{
+	hashes.dust.reset();
+	for (size_t i = 0; i + m_kmerSize <= rec.seq.length(); ++i) {
+		if (m_dustThreshold > 0 && hashes.dust.isMasked(rec.seq.data() + i)) {
+			continue;
+		}
+		vector<size_t> &values = hashValues[i];
+		if (values.empty()) {
+			const unsigned char* currentSeq = hashes.proc.prepSeq(rec.seq, i);
+			if (currentSeq == NULL) {
+				continue;
+			}
+			multiHash(currentSeq, m_hashNum, m_kmerSize, values);
+		}
+		if (filter.contains(values)) {
+			++hashes.redundancy;
+		} else if (reserveEntry()) {
+			filter.insert(values);
+		} else {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Streams the read pairs of file1 and file2 into the filter, adding the pairs
+ * that score at least score against it (leaving out k-mers of filterSub when
+ * scoring) until it holds m_expectedEntries k-mers.
+ *
+ * Threads take batches of pairs and add the ones that pass as they go, so
+ * which pairs are added depends on the timing of the threads. In
+ * deterministic mode every pair of a batch is scored against the filter as
+ * it was before the batch, in parallel, then the pairs that pass are added
+ * in input order, which gives the same filter for any number of threads.
+ */
+void BloomFilterGenerator::loadReadPairs(BloomFilter &filter, double score,
+		const string &file1, const string &file2, createMode mode,
+		const BloomFilter *filterSub)
+{
 	FastaReader sequence1(file1.c_str(), FastaReader::NO_FOLD_CASE);
 	FastaReader sequence2(file2.c_str(), FastaReader::NO_FOLD_CASE);
-#pragma omp parallel
-	for (FastqRecord rec1;;) {
-		FastqRecord rec2;
-		bool good1;
-		bool good2;
-
-		if (m_totalEntries >= m_expectedEntries) {
-			//so threshold message only printed once
-			if (sequence1.eof() || sequence1.eof()) {
+	size_t totalReads = 0;
+	//read at which the filter became full, 0 if it did not
+	size_t fullAt = 0;
+	vector<boost::shared_ptr<PairHashes> > hashes;
+	for (unsigned i = 0; i < maxThreads(); ++i) {
+		hashes.push_back(
+				boost::shared_ptr<PairHashes>(
+						new PairHashes(m_kmerSize, m_dustThreshold)));
+	}
+
+	if (m_deterministic) {
+		vector<FastqRecord> reads1(DETERMINISTIC_BATCH_SIZE);
+		vector<FastqRecord> reads2(DETERMINISTIC_BATCH_SIZE);
+		vector<char> accepted(DETERMINISTIC_BATCH_SIZE);
+		while (fullAt == 0) {
+			size_t firstRead = totalReads;
+			size_t count = readPairs(sequence1, sequence2, reads1, reads2,
+					totalReads);
+			if (count == 0) {
 				break;
 			}
-#pragma omp critical(breakClose)
-			{
-				sequence1.breakClose();
-				sequence2.breakClose();
-				cerr << "K-mer threshold reached at read " << totalReads << endl;
+#pragma omp parallel for schedule(dynamic, 16)
+			for (long i = 0; i < long(count); ++i) {
+				accepted[i] = evalPair(filter, score, mode, filterSub,
+						reads1[i], reads2[i], *hashes[threadNum()]);
 			}
-		}
-
-#pragma omp critical(sequence)
-		{
-			good1 = sequence1 >> rec1;
-			good2 = sequence2 >> rec2;
-		}
-
-		if (good1 && good2) {
-#pragma omp critical(totalReads)
-			{
-				++totalReads;
-				if (totalReads % 10000000 == 0) {
-					cerr << "Currently Reading Read Number: " << totalReads
-							<< endl;
+			PairHashes &pairHashes = *hashes.front();
+			for (size_t i = 0; i < count && fullAt == 0; ++i) {
+				if (!accepted[i]) {
+					continue;
+				}
+				clearHashes(pairHashes.read1, reads1[i].seq.length());
+				clearHashes(pairHashes.read2, reads2[i].seq.length());
+				if (!insertRead(filter, reads1[i], pairHashes.read1,
+						pairHashes)
+						|| !insertRead(filter, reads2[i], pairHashes.read2,
+								pairHashes)) {
+					fullAt = firstRead + i + 1;
+					sequence1.breakClose();
+					sequence2.breakClose();
 				}
 			}
-			ReadsProcessor proc(m_kmerSize);
-			string tempStr1 = rec1.id.substr(0, rec1.id.find_last_of("/"));
-			string tempStr2 = rec2.id.substr(0, rec2.id.find_last_of("/"));
-			if (tempStr1 == tempStr2) {
-				unsigned size1 = rec1.seq.length() - m_kmerSize + 1;
-				unsigned size2 = rec2.seq.length() - m_kmerSize + 1;
-				vector<vector<size_t> > hashValues1(size1);
-				vector<vector<size_t> > hashValues2(size2);
-				switch (mode) {
-				case PROG_INC: {
-					if (SeqEval::evalSingle(rec1, m_kmerSize, filter,
-									score * double(size1),
-									(1.0 - score) * double(size1), m_hashNum,
-									hashValues1)) {
-						//load remaining sequences
-						for (unsigned i = 0; i < size1; ++i) {
-							if (hashValues1[i].empty()) {
-								const unsigned char* currentSeq = proc.prepSeq(
-										rec1.seq, i);
-								checkAndInsertKmer(currentSeq, filter);
-							} else {
-								insertKmer(hashValues1[i], filter);
-							}
-						}
-						//load store second read
-						for (unsigned i = 0; i < size2; ++i) {
-							const unsigned char* currentSeq = proc.prepSeq(
-									rec2.seq, i);
-							checkAndInsertKmer(currentSeq, filter);
-						}
-					} else if (SeqEval::evalSingle(rec2, m_kmerSize, filter,
-									score * size2, (1.0 - score) * size2, m_hashNum,
-									hashValues2)) {
-						//load remaining sequences
-						for (unsigned i = 0; i < size1; ++i) {
-							if (hashValues1[i].empty()) {
-								const unsigned char* currentSeq = proc.prepSeq(
-										rec1.seq, i);
-								checkAndInsertKmer(currentSeq, filter);
-							} else {
-								insertKmer(hashValues1[i], filter);
-							}
-						}
-						//load store second read
-						for (unsigned i = 0; i < size2; ++i) {
-							if (hashValues2[i].empty()) {
-								const unsigned char* currentSeq = proc.prepSeq(
-										rec2.seq, i);
-								checkAndInsertKmer(currentSeq, filter);
-							} else {
-								insertKmer(hashValues2[i], filter);
-							}
-						}
+		}
+	} else {
+#pragma omp parallel
+		{
+			PairHashes &pairHashes = *hashes[threadNum()];
+			vector<FastqRecord> reads1(PROGRESSIVE_BATCH_SIZE);
+			vector<FastqRecord> reads2(PROGRESSIVE_BATCH_SIZE);
+			for (;;) {
+				size_t firstRead;
+				size_t count = 0;
+#pragma omp critical(sequence)
+				{
+					firstRead = totalReads;
+					if (fullAt == 0) {
+						count = readPairs(sequence1, sequence2, reads1, reads2,
+								totalReads);
 					}
+				}
+				if (count == 0) {
 					break;
 				}
-				case PROG_STD: {
-					if (SeqEval::evalSingle(rec1, m_kmerSize, filter,
-							score * double(size1),
-							(1.0 - score) * double(size1), m_hashNum,
-							hashValues1)
-							&& SeqEval::evalSingle(rec2, m_kmerSize, filter,
-									score * size2, (1.0 - score) * size2,
-									m_hashNum, hashValues2)) {
-						//load remaining sequences
-						for (unsigned i = 0; i < size1; ++i) {
-							if (hashValues1[i].empty()) {
-								const unsigned char* currentSeq = proc.prepSeq(
-										rec1.seq, i);
-								checkAndInsertKmer(currentSeq, filter);
-							} else {
-								insertKmer(hashValues1[i], filter);
-							}
-						}
-						//load store second read
-						for (unsigned i = 0; i < size2; ++i) {
-							if (hashValues2[i].empty()) {
-								const unsigned char* currentSeq = proc.prepSeq(
-										rec2.seq, i);
-								checkAndInsertKmer(currentSeq, filter);
-							} else {
-								insertKmer(hashValues2[i], filter);
-							}
+				for (size_t i = 0; i < count; ++i) {
+					if (evalPair(filter, score, mode, filterSub, reads1[i],
+							reads2[i], pairHashes)
+							&& (!insertRead(filter, reads1[i], pairHashes.read1,
+									pairHashes)
+									|| !insertRead(filter, reads2[i],
+											pairHashes.read2, pairHashes))) {
+#pragma omp critical(sequence)
+						if (fullAt == 0 || firstRead + i + 1 < fullAt) {
+							fullAt = firstRead + i + 1;
+							sequence1.breakClose();
+							sequence2.breakClose();
 						}
+						break;
 					}
-					break;
-				}
 				}
-			} else {
-				cerr << "Read IDs do not match" << "\n" << tempStr1 << "\n"
-						<< tempStr2 << endl;
-				exit(1);
 			}
-		} else
-			break;
+		}
+	}
+
+	for (vector<boost::shared_ptr<PairHashes> >::iterator it = hashes.begin();
+			it != hashes.end(); ++it) {
+		m_redundancy += (*it)->redundancy;
 	}
-	if (!sequence1.eof() || !sequence2.eof()) {
+	if (fullAt != 0) {
+		cerr << "K-mer threshold reached at read " << fullAt << endl;
+	} else if (!sequence1.eof() || !sequence2.eof()) {
 		cerr
 				<< "error: eof bit not flipped. Input files may be different lengths"
 				<< endl;
 	}
-
-	filter.storeFilter(filename);
-	return m_redundancy;
 }
 
-
 /*
  * Generates a bloom filter outputting it to a filename
  * Input a filename to use as a subtractive filter
@@ -526,78 +543,657 @@ size_t BloomFilterGenerator::generate(const string &filename,
 	BloomFilter filterSub(subInfo.getCalcuatedFilterSize(),
 			subInfo.getHashNum(), subInfo.getKmerSize(), subtractFilter);
 
-	if (subInfo.getKmerSize() > m_kmerSize) {
+	if (subInfo.getKmerSize() != m_kmerSize) {
 		cerr
-				<< "Error: Subtraction filter's k-mer size is larger than output filter's k-mer size."
+				<< "Error: Subtraction filter's different from current filter's k-mer size."
 				<< endl;
 		exit(1);
 	}
 
-//	//ReadProcessor for subtraction filter
-//	ReadsProcessor subProc(subInfo.getKmerSize());
+	//load input files + make filter, leaving out k-mers in filterSub
+	size_t kmerRemoved = loadFiles(filter, &filterSub);
+
+	cerr << "Total Number of K-mers not added: " << kmerRemoved << endl;
+
+	filter.storeFilter(filename);
+	return m_redundancy;
+}
+
+/*
+ * Base of the visitors of visitKmers, which are told the name of each
+ * sequence (or section of one) before its k-mers. Returning false from
+ * startSequence skips the sequence.
+ */
+struct KmerVisitor {
+	bool startSequence(const string &)
+	{
+		return true;
+	}
+};
+
+/*
+ * Inserts k-mers into a filter unless they are in filterSub, counting them
+ * as left out, new or already in the filter
+ */
+struct KmerInserter : KmerVisitor {
+	BloomFilter *filter;
+	const BloomFilter *filterSub;
+	size_t kmerRemoved;
+	size_t totalEntries;
+	size_t redundancy;
+
+	KmerInserter(BloomFilter &filter, const BloomFilter *filterSub) :
+			filter(&filter), filterSub(filterSub), kmerRemoved(0), totalEntries(
+					0), redundancy(0)
+	{
+	}
+
+	void operator()(const unsigned char* kmer)
+	{
+		if (filterSub != NULL && filterSub->contains(kmer)) {
+			++kmerRemoved;
+		} else if (filter->insertAndCheck(kmer)) {
+			++redundancy;
+		} else {
+			++totalEntries;
+		}
+	}
+};
+
+/*
+ * Estimates the number of distinct k-mers
+ */
+struct KmerEstimator : KmerVisitor {
+	HyperLogLog sketch;
+	size_t kmerSizeInBytes;
+	size_t kmers;
+
+	explicit KmerEstimator(unsigned kmerSize) :
+			kmerSizeInBytes((kmerSize + 4 - 1) / 4), kmers(0)
+	{
+	}
+
+	void operator()(const unsigned char* kmer)
+	{
+		++kmers;
+		sketch.insert(
+				CityHash64(reinterpret_cast<const char*>(kmer),
+						kmerSizeInBytes));
+	}
+};
+
+/*
+ * Inserts the k-mers of every input sequence into filter, leaving out those
+ * in filterSub unless it is NULL. Returns the number of k-mers left out.
+ */
+size_t BloomFilterGenerator::loadFiles(BloomFilter &filter,
+		const BloomFilter *filterSub)
+{
+	vector<KmerInserter> inserters(maxThreads(),
+			KmerInserter(filter, filterSub));
+	visitKmers(inserters);
 
 	size_t kmerRemoved = 0;
+	for (vector<KmerInserter>::iterator it = inserters.begin();
+			it != inserters.end(); ++it) {
+		kmerRemoved += it->kmerRemoved;
+		m_totalEntries += it->totalEntries;
+		m_redundancy += it->redundancy;
+	}
+	return kmerRemoved;
+}
+
+/*
+ * Inserts the k-mers of the input sequences into a progressive filter before
+ * reads are added. Whether a k-mer is counted as new depends on the order the
+ * k-mers are inserted in, and the count decides where the filter fills up, so
+ * in deterministic mode the sequences are loaded in order by one thread.
+ */
+void BloomFilterGenerator::loadSeedFiles(BloomFilter &filter)
+{
+#if _OPENMP
+	unsigned threads = maxThreads();
+	if (m_deterministic) {
+		omp_set_num_threads(1);
+	}
+	loadFiles(filter, NULL);
+	omp_set_num_threads(threads);
+#else
+	loadFiles(filter, NULL);
+#endif
+}
+
+/*
+ * Inserts each k-mer into the filter of the target its sequence is mapped
+ * to, counting new and redundant k-mers per target. Sequences that are not
+ * mapped are skipped.
+ */
+struct KmerRouter : KmerVisitor {
+	const vector<boost::shared_ptr<BloomFilter> > *filters;
+	const boost::unordered_map<string, unsigned> *targets;
+	BloomFilter *filter;
+	unsigned target;
+	vector<size_t> totalEntries;
+	vector<size_t> redundancy;
+
+	KmerRouter(const vector<boost::shared_ptr<BloomFilter> > &filters,
+			const boost::unordered_map<string, unsigned> &targets) :
+			filters(&filters), targets(&targets), filter(NULL), target(0), totalEntries(
+					filters.size(), 0), redundancy(filters.size(), 0)
+	{
+	}
+
+	bool startSequence(const string &header)
+	{
+		boost::unordered_map<string, unsigned>::const_iterator it =
+				targets->find(header);
+		if (it == targets->end()) {
+			return false;
+		}
+		target = it->second;
+		filter = (*filters)[target].get();
+		return true;
+	}
+
+	void operator()(const unsigned char* kmer)
+	{
+		if (filter->insertAndCheck(kmer)) {
+			++redundancy[target];
+		} else {
+			++totalEntries[target];
+		}
+	}
+};
+
+/*
+ * Returns the number of k-mers of the sequences mapped to each of targetNum
+ * targets by targets (sequence name to target index), from the sequence
+ * sizes. Warns about sequences that are not mapped to a target, which are
+ * left out of every filter.
+ */
+vector<size_t> BloomFilterGenerator::countTargetEntries(
+		const boost::unordered_map<string, unsigned> &targets,
+		unsigned targetNum) const
+{
+	if (!m_streamedFiles.empty()) {
+		cerr << "Error: " << m_streamedFiles.front()
+				<< " cannot be used with a target map, the sequences must be "
+						"in uncompressed fasta files to size the filters."
+				<< endl;
+		exit(1);
+	}
+	vector<size_t> entries(targetNum, 0);
+	size_t unmapped = 0;
+	for (boost::unordered_map<string, vector<string> >::const_iterator i =
+			m_fileNamesAndHeaders.begin(); i != m_fileNamesAndHeaders.end(); ++i) {
+		const WindowedFileParser &parser = *m_parsers.at(i->first);
+		for (vector<string>::const_iterator j = i->second.begin();
+				j != i->second.end(); ++j) {
+			boost::unordered_map<string, unsigned>::const_iterator target =
+					targets.find(*j);
+			if (target == targets.end()) {
+				if (unmapped++ == 0) {
+					cerr << "Warning: " << *j << " in " << i->first
+							<< " is not mapped to a filter and is left out"
+							<< endl;
+				}
+				continue;
+			}
+			size_t size = parser.getSequenceSize(*j);
+			if (size >= m_kmerSize) {
+				entries[target->second] += size - m_kmerSize + 1;
+			}
+		}
+	}
+	if (unmapped > 1) {
+		cerr << "Warning: " << unmapped
+				<< " sequences in total are not mapped to a filter" << endl;
+	}
+	return entries;
+}
+
+/*
+ * Generates one filter per target in a single pass over the input, the
+ * k-mers of each sequence going to the filter of the target it is mapped to
+ * by targets. Filter i is filterSizes[i] bits and is output to filenames[i].
+ * The new and redundant k-mers of each filter are added to totalEntries and
+ * redundancy.
+ */
+void BloomFilterGenerator::generateMany(const vector<string> &filenames,
+		const boost::unordered_map<string, unsigned> &targets,
+		const vector<size_t> &filterSizes, vector<size_t> &totalEntries,
+		vector<size_t> &redundancy)
+{
+	assert(m_hashNum > 0);
+	assert(filenames.size() == filterSizes.size());
+
+	vector<boost::shared_ptr<BloomFilter> > filters;
+	for (vector<size_t>::const_iterator it = filterSizes.begin();
+			it != filterSizes.end(); ++it) {
+		filters.push_back(
+				boost::shared_ptr<BloomFilter>(
+						new BloomFilter(*it, m_hashNum, m_kmerSize)));
+	}
+
+	vector<KmerRouter> routers(maxThreads(), KmerRouter(filters, targets));
+	visitKmers(routers);
+
+	totalEntries.assign(filters.size(), 0);
+	redundancy.assign(filters.size(), 0);
+	for (vector<KmerRouter>::iterator it = routers.begin();
+			it != routers.end(); ++it) {
+		for (size_t i = 0; i < filters.size(); ++i) {
+			totalEntries[i] += it->totalEntries[i];
+			redundancy[i] += it->redundancy[i];
+		}
+	}
+	for (size_t i = 0; i < filters.size(); ++i) {
+		m_totalEntries += totalEntries[i];
+		m_redundancy += redundancy[i];
+		filters[i]->storeFilter(filenames[i]);
+	}
+}
+
+/*
+ * Sets the expected number of entries to an estimate of the number of
+ * distinct k-mers in the input, from a HyperLogLog sketch of them. The
+ * estimate is raised by three standard errors so filters are not made
+ * smaller than intended, but is at most the number of k-mers read.
+ * Returns the expected number of entries.
+ */
+size_t BloomFilterGenerator::estimateEntries()
+{
+	for (vector<string>::iterator i = m_streamedFiles.begin();
+			i != m_streamedFiles.end(); ++i) {
+		if (*i == "-") {
+			cerr << "Error: The number of elements (-n) must be given "
+					"to read sequences from stdin." << endl;
+			exit(1);
+		}
+	}
+	cerr << "Estimating the number of distinct k-mers" << endl;
+	vector<KmerEstimator> estimators(maxThreads(), KmerEstimator(m_kmerSize));
+	visitKmers(estimators);
+
+	HyperLogLog &sketch = estimators.front().sketch;
+	size_t kmers = 0;
+	for (vector<KmerEstimator>::iterator it = estimators.begin();
+			it != estimators.end(); ++it) {
+		sketch.merge(it->sketch);
+		kmers += it->kmers;
+	}
+	double estimate = sketch.estimate();
+	m_expectedEntries = min(kmers,
+			size_t(ceil(estimate * (1 + 3 * sketch.standardError()))));
+	cerr << "Approximately " << size_t(estimate) << " distinct k-mers in "
+			<< kmers << " k-mers" << endl;
+	return m_expectedEntries;
+}
+
+/*
+ * Sorts the filter positions of k-mers into the stripes of the filter they
+ * fall in, appending them to the temporary file of the stripe a buffer at a
+ * time. Positions in a stripe are stored as Position, which must hold the
+ * number of bits of a stripe.
+ */
+template<typename Position>
+struct KmerStripeWriter : KmerVisitor {
+	vector<FILE*> *files;
+	vector<pthread_mutex_t> *locks;
+	size_t filterSize;
+	size_t stripeBits;
+	unsigned hashNum;
+	size_t kmerSizeInBytes;
+	size_t bufferSize;
+	vector<vector<Position> > buffers;
+	size_t kmers;
+
+	KmerStripeWriter(vector<FILE*> &files, vector<pthread_mutex_t> &locks,
+			size_t filterSize, size_t stripeBits, unsigned hashNum,
+			unsigned kmerSize, size_t bufferSize) :
+			files(&files), locks(&locks), filterSize(filterSize), stripeBits(
+					stripeBits), hashNum(hashNum), kmerSizeInBytes(
+					(kmerSize + 4 - 1) / 4), bufferSize(bufferSize), buffers(
+					files.size()), kmers(0)
+	{
+	}
+
+	void operator()(const unsigned char* kmer)
+	{
+		++kmers;
+		for (unsigned i = 0; i < hashNum; ++i) {
+			size_t pos = CityHash64WithSeed(reinterpret_cast<const char*>(kmer),
+					kmerSizeInBytes, i) % filterSize;
+			size_t stripe = pos / stripeBits;
+			vector<Position> &buffer = buffers[stripe];
+			buffer.push_back(Position(pos - stripe * stripeBits));
+			if (buffer.size() == bufferSize) {
+				flush(stripe);
+			}
+		}
+	}
 
-	//for each file loop over all headers and obtain seq
-	//load input file + make filter
+	void flush(size_t stripe)
+	{
+		vector<Position> &buffer = buffers[stripe];
+		if (buffer.empty()) {
+			return;
+		}
+		pthread_mutex_lock(&(*locks)[stripe]);
+		size_t written = fwrite(&buffer[0], sizeof(Position), buffer.size(),
+				(*files)[stripe]);
+		pthread_mutex_unlock(&(*locks)[stripe]);
+		if (written != buffer.size()) {
+			cerr << "Error: could not write temporary file: "
+					<< strerror(errno) << endl;
+			exit(1);
+		}
+		buffer.clear();
+	}
+};
+
+/*
+ * Opens a temporary file next to path, which is removed when it is closed
+ */
+static FILE *openTempFile(const string &path)
+{
+	string name = path + ".XXXXXX";
+	vector<char> buffer(name.begin(), name.end());
+	buffer.push_back('\0');
+	int fd = mkstemp(&buffer[0]);
+	if (fd < 0) {
+		cerr << "Error: could not create temporary file " << name << ": "
+				<< strerror(errno) << endl;
+		exit(1);
+	}
+	unlink(&buffer[0]);
+	FILE *file = fdopen(fd, "w+b");
+	if (file == NULL) {
+		cerr << "Error: could not open temporary file " << name << endl;
+		exit(1);
+	}
+	return file;
+}
+
+/*
+ * Generates a bloom filter outputting it to a filename, using at most about
+ * memory bytes for the filter. The filter positions of the k-mers are first
+ * written to temporary files (next to the output), one per stripe of the
+ * filter. Each stripe is then set in memory from its file and written to
+ * its place in the output, as many stripes at once in parallel as fit in
+ * memory. There are at most MAX_STRIPE_FILES stripes; positions are stored
+ * in 32 bits for stripes up to MAX_STRIPE_BYTES and in 64 bits for the
+ * larger stripes of filters over MAX_STRIPE_FILES * MAX_STRIPE_BYTES bytes.
+ *
+ * K-mers already in the filter cannot be told apart this way, so the number
+ * of entries is estimated from the number of bits set.
+ * Returns the m_redundancy of the filter.
+ */
+size_t BloomFilterGenerator::generateStriped(const string &filename,
+		size_t memory)
+{
+	//need the number of hash functions used to be greater than 0
+	assert(m_hashNum > 0);
+
+	size_t filterBytes = m_filterSize / bitsPerChar;
+	unsigned threads = maxThreads();
+
+	//a stripe per thread fits in memory, unless that makes too many files
+	size_t stripeBytes = max(size_t(1), memory / threads);
+	stripeBytes = max(stripeBytes,
+			(filterBytes + MAX_STRIPE_FILES - 1) / MAX_STRIPE_FILES);
+	stripeBytes = min(stripeBytes, filterBytes);
+	size_t stripes = (filterBytes + stripeBytes - 1) / stripeBytes;
+	size_t positionBytes =
+			stripeBytes > MAX_STRIPE_BYTES ? sizeof(uint64_t) : sizeof(uint32_t);
+
+	//every thread buffers positions for every stripe while k-mers are read
+	size_t bufferSize = min(MAX_STRIPE_BUFFER,
+			memory / (threads * stripes * positionBytes));
+	size_t needed = max(stripeBytes + MIN_STRIPE_BUFFER * positionBytes,
+			threads * stripes * MIN_STRIPE_BUFFER * positionBytes);
+	if (memory < needed) {
+		cerr << "Error: --max_mem is too small to build a filter of "
+				<< filterBytes << " bytes in " << stripes << " stripes with "
+				<< threads << " threads, it needs at least "
+				<< (needed + (1 << 20) - 1) / (1 << 20) << " MB" << endl;
+		exit(1);
+	}
+	bufferSize = max(bufferSize, MIN_STRIPE_BUFFER);
+
+	//stripes set in memory at once
+	unsigned parallelStripes = unsigned(
+			max(size_t(1),
+					min(size_t(threads),
+							memory
+									/ (stripeBytes
+											+ bufferSize * positionBytes))));
+	cerr << "Building filter in " << stripes << " stripes of " << stripeBytes
+			<< " bytes, " << parallelStripes << " at a time" << endl;
+
+	size_t kmers = 0;
+	size_t bitsSet =
+			positionBytes == sizeof(uint32_t) ?
+					buildStripes<uint32_t>(filename, stripeBytes, bufferSize,
+							parallelStripes, kmers) :
+					buildStripes<uint64_t>(filename, stripeBytes, bufferSize,
+							parallelStripes, kmers);
+
+	//the number of k-mers that set bitsSet bits of the filter
+	double fill = double(bitsSet) / double(m_filterSize);
+	size_t entries = kmers;
+	if (fill < 1) {
+		entries = min(kmers,
+				size_t(-double(m_filterSize) / m_hashNum * log(1 - fill) + 0.5));
+	}
+	m_totalEntries += entries;
+	m_redundancy += kmers - entries;
+	return m_redundancy;
+}
+
+/*
+ * Writes the positions of every k-mer to a temporary file per stripe of
+ * stripeBytes, then sets parallelStripes stripes at a time from their files
+ * and writes them to filename. Adds the k-mers read to kmers.
+ * Returns the number of bits set.
+ */
+template<typename Position>
+size_t BloomFilterGenerator::buildStripes(const string &filename,
+		size_t stripeBytes, size_t bufferSize, unsigned parallelStripes,
+		size_t &kmers)
+{
+	size_t filterBytes = m_filterSize / bitsPerChar;
+	size_t stripes = (filterBytes + stripeBytes - 1) / stripeBytes;
+	vector<FILE*> files(stripes);
+	vector<pthread_mutex_t> locks(stripes);
+	for (size_t i = 0; i < stripes; ++i) {
+		files[i] = openTempFile(filename);
+		//positions are written and read a whole buffer at a time
+		setvbuf(files[i], NULL, _IONBF, 0);
+		pthread_mutex_init(&locks[i], NULL);
+	}
+
+	//write the positions of every k-mer to the files of their stripes
+	vector<KmerStripeWriter<Position> > writers(maxThreads(),
+			KmerStripeWriter<Position>(files, locks, m_filterSize,
+					stripeBytes * bitsPerChar, m_hashNum, m_kmerSize,
+					bufferSize));
+	visitKmers(writers);
+	for (typename vector<KmerStripeWriter<Position> >::iterator it =
+			writers.begin(); it != writers.end(); ++it) {
+		for (size_t i = 0; i < stripes; ++i) {
+			it->flush(i);
+		}
+		kmers += it->kmers;
+	}
+	writers.clear();
+	for (size_t i = 0; i < stripes; ++i) {
+		pthread_mutex_destroy(&locks[i]);
+	}
+
+	int out = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (out < 0 || ftruncate(out, filterBytes) != 0) {
+		cerr << "Error: could not write " << filename << ": "
+				<< strerror(errno) << endl;
+		exit(1);
+	}
+	cerr << "Storing filter. Filter is " << filterBytes << "bytes." << endl;
+
+	//set each stripe from its positions and write it out
+	size_t bitsSet = 0;
+#pragma omp parallel for schedule(dynamic) reduction(+:bitsSet) num_threads(parallelStripes)
+	for (long i = 0; i < long(stripes); ++i) {
+		size_t offset = i * stripeBytes;
+		vector<unsigned char> stripe(min(stripeBytes, filterBytes - offset));
+		vector<Position> positions(bufferSize);
+		FILE *file = files[i];
+		rewind(file);
+		size_t count;
+		while ((count = fread(&positions[0], sizeof(Position),
+				positions.size(), file)) > 0) {
+			for (size_t j = 0; j < count; ++j) {
+				stripe[positions[j] / bitsPerChar] |=
+						bitMask[positions[j] % bitsPerChar];
+			}
+		}
+		if (ferror(file)) {
+			cerr << "Error: could not read temporary file" << endl;
+			exit(1);
+		}
+		fclose(file);
+
+		for (size_t j = 0; j < stripe.size(); ++j) {
+			bitsSet += __builtin_popcount(stripe[j]);
+		}
+		for (size_t written = 0; written < stripe.size();) {
+			ssize_t n = pwrite(out, &stripe[written], stripe.size() - written,
+					offset + written);
+			if (n <= 0) {
+				cerr << "Error: could not write " << filename << ": "
+						<< strerror(errno) << endl;
+				exit(1);
+			}
+			written += n;
+		}
+	}
+	if (close(out) != 0) {
+		cerr << "Error: could not write " << filename << ": "
+				<< strerror(errno) << endl;
+		exit(1);
+	}
+	return bitsSet;
+}
+
+/*
+ * Calls visitor(kmer) for the k-mers of every input sequence, except those
+ * with bases other than ACGT, using visitors[i] in thread i. Sequences of
+ * mapped files are cut into sections of at most GENERATE_SECTION_SIZE
+ * k-mers (sections of a sequence overlap by k - 1 bases) that are spread
+ * over the threads, each reading its own sections. Streamed files are read
+ * one sequence at a time by whichever thread is free.
+ */
+template<typename Visitor>
+void BloomFilterGenerator::visitKmers(vector<Visitor> &visitors)
+{
+	vector<Section> sections;
 	for (boost::unordered_map<string, vector<string> >::iterator i =
 			m_fileNamesAndHeaders.begin(); i != m_fileNamesAndHeaders.end(); ++i) {
 		//let user know that files are being read
 		cerr << "Processing File: " << i->first << endl;
-		WindowedFileParser parser(i->first, m_kmerSize);
+		const WindowedFileParser &parser = *m_parsers[i->first];
 		for (vector<string>::iterator j = i->second.begin();
 				j != i->second.end(); ++j) {
-			parser.setLocationByHeader(*j);
-			//object to process reads
-			//insert elements into filter
-			//read fasta file line by line and split using sliding window
-			while (parser.notEndOfSeqeunce()) {
-				const unsigned char* currentSeq = parser.getNextSeq();
+			size_t size = parser.getSequenceSize(*j);
+			size_t kmers = size < m_kmerSize ? 0 : size - m_kmerSize + 1;
+			//sequences with uneven lines are read whole
+			size_t sectionSize =
+					parser.isSeekable(*j) ? GENERATE_SECTION_SIZE : kmers;
+			for (size_t start = 0; start < kmers; start += sectionSize) {
+				if (!inShard(*j, start / GENERATE_SECTION_SIZE)) {
+					continue;
+				}
+				Section section = { &parser, &*j, start, min(sectionSize,
+						kmers - start) };
+				sections.push_back(section);
+			}
+		}
+	}
+
+#pragma omp parallel
+	{
+		Visitor &visitor = visitors[threadNum()];
+		//threads keep reading the file of their last section
+		WindowedFileParser *parser = NULL;
+		const WindowedFileParser *source = NULL;
+#pragma omp for schedule(dynamic)
+		for (long i = 0; i < long(sections.size()); ++i) {
+			const Section &section = sections[i];
+			if (source != section.source) {
+				delete parser;
+				parser = new WindowedFileParser(*section.source);
+				source = section.source;
+			}
+			if (!visitor.startSequence(*section.header)) {
+				continue;
+			}
+			parser->setLocationByHeader(*section.header, section.start,
+					section.kmers);
+			//split the sequence using sliding window
+			while (parser->notEndOfSeqeunce()) {
+				const unsigned char* currentSeq = parser->getNextSeq();
 				if (currentSeq != NULL) {
-					//allow kmer into filter?
-					bool allowKmer = false;
-
-					//Check if kmer or subkmers are located in filter
-					if (subInfo.getKmerSize() == m_kmerSize) {
-						//if kmer does not exist set allowance to true
-						allowKmer = !filterSub.contains(currentSeq);
-					} else {
-						//TODO make compatable with smaller kmer sizes
-						cerr
-								<< "ERROR: Must use identical size k-mers in subtractive filter"
-								<< endl;
-//						uint16_t subSections = kmerSize - kmerSize;
-//						for (uint16_t i = 0; i <= subSections; ++i) {
-//							if (!filterSub.contains(subProc.prepSeq(currentSeq, i)))
-//							{
-//								//if any sub kmer does not exists set allowance to true
-//								allowKmer = true;
-//								break;
-//							}
-//						}
-					}
+					visitor(currentSeq);
+				}
+			}
+		}
+		delete parser;
+	}
 
-					if (allowKmer) {
-						const vector<size_t> &tempHash = multiHash(currentSeq,
-								m_hashNum, m_kmerSize);
-						if (filter.contains(tempHash)) {
-							m_redundancy++;
-						} else {
-							filter.insert(tempHash);
-							m_totalEntries++;
-						}
-					} else {
-						++kmerRemoved;
+	for (vector<string>::iterator i = m_streamedFiles.begin();
+			i != m_streamedFiles.end(); ++i) {
+		cerr << "Processing File: " << *i << endl;
+		FastaReader reader(i->c_str(), FastaReader::NO_FOLD_CASE);
+#pragma omp parallel
+		{
+			Visitor &visitor = visitors[threadNum()];
+			ReadsProcessor proc(m_kmerSize);
+			DustMasker dust(m_kmerSize, m_dustThreshold);
+			for (FastaRecord rec;;) {
+				bool good;
+#pragma omp critical(streamedFile)
+				good = reader >> rec;
+				if (!good) {
+					break;
+				}
+				if (!inShard(rec.id, 0) || !visitor.startSequence(rec.id)) {
+					continue;
+				}
+				dust.reset();
+				for (size_t j = 0; j + m_kmerSize <= rec.seq.length(); ++j) {
+					if (m_dustThreshold > 0
+							&& dust.isMasked(rec.seq.data() + j)) {
+						continue;
+					}
+					const unsigned char* currentSeq = proc.prepSeq(rec.seq, j);
+					if (currentSeq != NULL) {
+						visitor(currentSeq);
 					}
 				}
 			}
 		}
 	}
+}
 
-	cerr << "Total Number of K-mers not added: " << kmerRemoved << endl;
-
-	filter.storeFilter(filename);
-	return m_redundancy;
+/*
+ * Whether a section of a sequence belongs to the shard being built. Sections
+ * are assigned by a hash of the sequence name and section number, so every
+ * job building a shard of the same input agrees on the assignment.
+ */
+bool BloomFilterGenerator::inShard(const string &header, size_t section) const
+{
+	return m_shards == 1
+			|| CityHash64WithSeed(header.data(), header.length(), section)
+					% m_shards == m_shard;
 }
 
 //setters
@@ -605,6 +1201,34 @@ void BloomFilterGenerator::setFilterSize(size_t bits) {
 	m_filterSize = bits;
 }
 
+/*
+ * Only load the part of the input in shard index (from 0) of count shards
+ */
+void BloomFilterGenerator::setShard(unsigned index, unsigned count) {
+	assert(index < count);
+	m_shard = index;
+	m_shards = count;
+}
+
+/*
+ * Leaves out k-mers with a DUST score above threshold (0 = off)
+ */
+void BloomFilterGenerator::setDust(double threshold) {
+	m_dustThreshold = threshold;
+	for (boost::unordered_map<string, boost::shared_ptr<WindowedFileParser> >::iterator
+			it = m_parsers.begin(); it != m_parsers.end(); ++it) {
+		it->second->setDust(threshold);
+	}
+}
+
+/*
+ * Sets whether progressive filters are made the same way whatever the
+ * number of threads (see loadReadPairs)
+ */
+void BloomFilterGenerator::setDeterministic(bool deterministic) {
+	m_deterministic = deterministic;
+}
+
 //getters
 
 /*
@@ -10,6 +10,7 @@
 #include <boost/unordered/unordered_map.hpp>
 #include <vector>
 #include "Common/BloomFilter.h"
+#include "WindowedFileParser.h"
 using namespace std;
 
 enum createMode{PROG_STD, PROG_INC};
@@ -22,16 +23,27 @@ public:
 	explicit BloomFilterGenerator(vector<string> const &filenames,
 			unsigned kmerSize, unsigned hashNum);
 
-
-	//TODO: THREAD ME!
 	size_t generate(const string &filename);
 	size_t generate(const string &filename, const string &subtractFilter);
+	size_t update(const string &filename, const string &existingFilter);
+	size_t generateStriped(const string &filename, size_t memory);
+	void generateMany(const vector<string> &filenames,
+			const boost::unordered_map<string, unsigned> &targets,
+			const vector<size_t> &filterSizes, vector<size_t> &totalEntries,
+			vector<size_t> &redundancy);
+	vector<size_t> countTargetEntries(
+			const boost::unordered_map<string, unsigned> &targets,
+			unsigned targetNum) const;
 	size_t generateProgressive(const string &filename, double score,
 			const string &file1, const string &file2, createMode mode);
 	size_t generateProgressive(const string &filename, double score,
 			const string &file1, const string &file2, createMode mode,
 			const string &subtractFilter);
 	void setFilterSize(size_t bits);
+	void setShard(unsigned index, unsigned count);
+	void setDeterministic(bool deterministic);
+	void setDust(double threshold);
+	size_t estimateEntries();
 
 	void setHashFuncs(unsigned numFunc);
 	size_t getTotalEntries() const;
@@ -45,31 +57,57 @@ private:
 	size_t m_filterSize;
 	size_t m_totalEntries;
 	size_t m_redundancy;
+	unsigned m_shard;
+	unsigned m_shards;
+	bool m_deterministic;
+	double m_dustThreshold;
 
 	boost::unordered_map<string, vector<string> > m_fileNamesAndHeaders;
 
-	inline void checkAndInsertKmer(const unsigned char* currentSeq,
-			BloomFilter &filter)
-	{
-		if (currentSeq != NULL) {
-			const vector<size_t> &tempHash = multiHash(currentSeq, m_hashNum,
-					m_kmerSize);
-			insertKmer(tempHash, filter);
-		}
-	}
+	//memory mapped files and files that can only be read in order
+	boost::unordered_map<string, boost::shared_ptr<WindowedFileParser> > m_parsers;
+	vector<string> m_streamedFiles;
+
+	//part of a sequence loaded into the filter by one thread
+	struct Section {
+		const WindowedFileParser *source;
+		const string *header;
+		size_t start;
+		size_t kmers;
+	};
 
-	inline void insertKmer(const vector<size_t> &hashVals,
-			BloomFilter &filter)
-	{
-		if (filter.contains(hashVals)) {
-#pragma omp atomic
-			m_redundancy++;
-		} else {
-			filter.insert(hashVals);
-#pragma omp atomic
-			m_totalEntries++;
+	//hash values of the k-mers of a read pair and the k-mers found already
+	//in the filter, kept by a thread from pair to pair
+	struct PairHashes {
+		vector<vector<size_t> > read1;
+		vector<vector<size_t> > read2;
+		ReadsProcessor proc;
+		DustMasker dust;
+		size_t redundancy;
+
+		PairHashes(unsigned kmerSize, double dustThreshold) :
+				proc(kmerSize), dust(kmerSize, dustThreshold), redundancy(0)
+		{
 		}
-	}
+	};
+
+	void indexFiles(vector<string> const &filenames, bool countEntries);
+	bool inShard(const string &header, size_t section) const;
+	size_t loadFiles(BloomFilter &filter, const BloomFilter *filterSub);
+	void loadSeedFiles(BloomFilter &filter);
+	void loadReadPairs(BloomFilter &filter, double score, const string &file1,
+			const string &file2, createMode mode, const BloomFilter *filterSub);
+	bool evalPair(const BloomFilter &filter, double score, createMode mode,
+			const BloomFilter *filterSub, const FastqRecord &rec1,
+			const FastqRecord &rec2, PairHashes &hashes) const;
+	bool insertRead(BloomFilter &filter, const FastqRecord &rec,
+			vector<vector<size_t> > &hashValues, PairHashes &hashes);
+	bool reserveEntry();
+	template<typename Visitor>
+	void visitKmers(vector<Visitor> &visitors);
+	template<typename Position>
+	size_t buildStripes(const string &filename, size_t stripeBytes,
+			size_t bufferSize, unsigned parallelStripes, size_t &kmers);
 };
 
 #endif /* BLOOMFILTERGENERATOR_H_ */
@@ -1,54 +1,199 @@
 /*
  * WindowedFileParser.cpp
  *
- * Currently for fasta files only and needs fasta index. Parse file line by line.
+ * Currently for uncompressed fasta files only. The file is memory mapped and
+ * indexed with its fasta index if there is one, or by scanning it otherwise.
  *
  *  Created on: Jul 18, 2012
  *      Author: cjustin
  */
 #include "WindowedFileParser.h"
 #include <sstream>
-#include "DataLayer/FastaIndex.h"
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <cassert>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//bases copied out of the file at a time
+static const size_t WINDOW_FILL_SIZE = 1 << 16;
+
+/*
+ * Maps a file read only, returns false if it cannot be mapped
+ */
+static bool mapFile(const string &fileName, const char *&data, size_t &size)
+{
+	if (fileName == "-") {
+		return false;
+	}
+	int fd = open(fileName.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+		close(fd);
+		return false;
+	}
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		return false;
+	}
+	data = static_cast<const char*>(map);
+	size = st.st_size;
+	return true;
+}
+
+WindowedFileParser::FastaFile::~FastaFile()
+{
+	if (data != NULL) {
+		munmap(const_cast<char*>(data), size);
+	}
+}
 
 WindowedFileParser::WindowedFileParser(string const &fileName,
 		unsigned windowSize) :
-		m_windowSize(windowSize), m_proc(ReadsProcessor(windowSize))
+		m_fasta(new FastaFile()), m_windowSize(windowSize), m_proc(
+				ReadsProcessor(windowSize))
 {
-	m_fastaFileHandle.open(fileName.c_str(), ifstream::in);
-	assert(m_fastaFileHandle);
+	if (!mapFile(fileName, m_fasta->data, m_fasta->size)) {
+		cerr << "Error: " << fileName
+				<< " could not be read as an uncompressed fasta file." << endl;
+		exit(1);
+	}
 
 	//create in memory index
 	WindowedFileParser::initializeIndex(fileName);
+	if (m_fasta->headers.empty()) {
+		cerr << "Error: " << fileName << " has no sequences." << endl;
+		exit(1);
+	}
 	m_currentHeader = "";
-	setLocationByHeader(m_headers[0]);
+	setLocationByHeader(m_fasta->headers[0]);
+}
+
+/*
+ * Shares the mapped file and index of another parser, so several threads
+ * can each read their own part of a file indexed once
+ */
+WindowedFileParser::WindowedFileParser(const WindowedFileParser &parser) :
+		m_fasta(parser.m_fasta), m_windowSize(parser.m_windowSize), m_proc(
+				parser.m_windowSize)
+{
+	if (parser.m_dust) {
+		m_dust.reset(new DustMasker(*parser.m_dust));
+	}
+	m_currentHeader = "";
+	setLocationByHeader(m_fasta->headers[0]);
+}
+
+/*
+ * Whether the file can be memory mapped and read by this parser (an
+ * uncompressed fasta file); other files must be streamed
+ */
+bool WindowedFileParser::canMap(const string &fileName)
+{
+	const char *data;
+	size_t size;
+	if (!mapFile(fileName, data, size)) {
+		return false;
+	}
+	//compressed files fail this test
+	bool fasta = data[0] == '>';
+	munmap(const_cast<char*>(data), size);
+	return fasta;
 }
 
 const vector<string> WindowedFileParser::getHeaders() const
 {
-	return m_headers;
+	return m_fasta->headers;
 }
 
 //sets the location in the file to the start of the sequence given a header
 void WindowedFileParser::setLocationByHeader(string const &header)
 {
+	size_t size = m_fasta->index.at(header).size;
+	setLocationByHeader(header, 0,
+			size < m_windowSize ? 0 : size - m_windowSize + 1);
+}
+
+/*
+ * Sets the location in the file to base start of the sequence given a header,
+ * so that the next kmers windows are read from there (fewer if the sequence
+ * ends first). Lets sections of one sequence be read independently.
+ */
+void WindowedFileParser::setLocationByHeader(string const &header,
+		size_t start, size_t kmers)
+{
+	const FastaIndexValue &value = m_fasta->index.at(header);
+	assert(start == 0 || isSeekable(header));
 	m_sequenceNotEnd = true;
 	m_currentHeader = header;
-	m_fastaFileHandle.seekg(m_fastaIndex[header].start, ios::beg);
-	m_currentEndSeqPos = m_windowSize - 1;
-	string bufferString;
-	getline(m_fastaFileHandle, m_currentString);
-	while ((m_currentString.length() < m_windowSize)
-			&& (m_currentEndSeqPos < m_fastaIndex[m_currentHeader].size)
-			&& getline(m_fastaFileHandle, bufferString))
-	{
-		m_currentString += bufferString;
+	size_t sectionEnd = min(value.size, start + kmers + m_windowSize - 1);
+	m_basesLeft = sectionEnd > start ? sectionEnd - start : 0;
+	m_kmersLeft = kmers;
+	size_t offset = value.start;
+	if (value.bpPerLine > 0) {
+		offset += start / value.bpPerLine * value.charsPerLine
+				+ start % value.bpPerLine;
 	}
+	m_pos = m_fasta->data + min(offset, m_fasta->size);
+	m_currentString.clear();
 	m_currentLinePos = 0;
+	if (m_dust) {
+		m_dust->reset();
+	}
 }
 
 size_t WindowedFileParser::getSequenceSize(string const &header) const
 {
-	return m_fastaIndex.at(header).size;
+	return m_fasta->index.at(header).size;
+}
+
+/*
+ * Whether reading can start anywhere in the sequence, which needs all of its
+ * lines to be the same length
+ */
+bool WindowedFileParser::isSeekable(string const &header) const
+{
+	const FastaIndexValue &value = m_fasta->index.at(header);
+	return value.bpPerLine > 0 || value.size == 0;
+}
+
+/*
+ * Appends the next bases of the section to the window, dropping the ones
+ * already passed. Lines are copied whole, so the window only moves once
+ * every WINDOW_FILL_SIZE bases. Returns false if there are no bases left.
+ */
+bool WindowedFileParser::fillWindow()
+{
+	m_currentString.erase(0, m_currentLinePos);
+	m_currentLinePos = 0;
+	const char *end = m_fasta->data + m_fasta->size;
+	bool filled = false;
+	while (m_basesLeft > 0 && m_pos < end
+			&& m_currentString.length() < WINDOW_FILL_SIZE)
+	{
+		const char *newline = static_cast<const char*>(memchr(m_pos, '\n',
+				end - m_pos));
+		const char *lineEnd = newline == NULL ? end : newline;
+		size_t bases = lineEnd - m_pos;
+		if (bases > 0 && lineEnd[-1] == '\r') {
+			--bases;
+		}
+		bases = min(bases, m_basesLeft);
+		m_currentString.append(m_pos, bases);
+		m_basesLeft -= bases;
+		m_pos = newline == NULL ? end : newline + 1;
+		filled = true;
+	}
+	return filled;
 }
 
 //Todo: Optimize to skip sections when finding a non ATCG character
@@ -59,27 +204,25 @@ size_t WindowedFileParser::getSequenceSize(string const &header) const
  */
 const unsigned char* WindowedFileParser::getNextSeq()
 {
-	if (m_currentString.length() < m_windowSize + m_currentLinePos) {
-		m_currentString.erase(0, m_currentLinePos);
-		m_currentEndSeqPos += m_currentLinePos;
-		m_currentLinePos = 0;
-		//grow the sequence to match the correct window size
-		//stop if there are no more lines left in fasta file
-		while (m_fastaFileHandle.is_open()
-				&& (m_currentString.length() < m_windowSize)
-				&& (m_currentEndSeqPos < m_fastaIndex[m_currentHeader].size)
-				&& getline(m_fastaFileHandle, m_bufferString))
-		{
-			m_currentString += m_bufferString;
-		}
-
+	if (m_kmersLeft == 0) {
+		m_sequenceNotEnd = false;
+		return NULL;
+	}
+	//grow the sequence to match the correct window size
+	//stop if there are no more bases left in the sequence
+	while (m_currentString.length() < m_windowSize + m_currentLinePos) {
 		//if there is not enough sequence for a full kmer
-		if (m_currentString.length() < m_windowSize) {
+		if (!fillWindow()) {
 			m_sequenceNotEnd = false;
 			return NULL;
 		}
 	}
-	return m_proc.prepSeq(m_currentString, m_currentLinePos++);
+	--m_kmersLeft;
+	size_t pos = m_currentLinePos++;
+	if (m_dust && m_dust->isMasked(m_currentString.data() + pos)) {
+		return NULL;
+	}
+	return m_proc.prepSeq(m_currentString, pos);
 }
 
 bool WindowedFileParser::notEndOfSeqeunce() const
@@ -87,6 +230,15 @@ bool WindowedFileParser::notEndOfSeqeunce() const
 	return m_sequenceNotEnd;
 }
 
+/*
+ * Skips k-mers with a DUST score above threshold, returning NULL for them
+ * as for k-mers with bases other than ACGT
+ */
+void WindowedFileParser::setDust(double threshold)
+{
+	m_dust.reset(new DustMasker(m_windowSize, threshold));
+}
+
 /*
  * Initializes fasta index in memory.
  * If no index exists derive one from input file
@@ -100,8 +252,8 @@ void WindowedFileParser::initializeIndex(string const &fileName)
 	ifstream indexFile;
 	indexFile.open(faiFile.c_str(), ifstream::in);
 	if (!indexFile) {
-		cerr << "Fasta files must be indexed. Use samtools faidx." << endl;
-		exit(1);
+		scanIndex(fileName);
+		return;
 	}
 
 	string line;
@@ -113,16 +265,94 @@ void WindowedFileParser::initializeIndex(string const &fileName)
 			FastaIndexValue value;
 			ss >> header >> value.size >> value.start >> value.bpPerLine
 					>> value.charsPerLine;
-			value.index = m_headers.size();
-			m_fastaIndex[header] = value;
-			m_headers.push_back(header);
+			value.index = m_fasta->headers.size();
+			addSequence(faiFile, header, value);
 		}
 		indexFile.close();
 	}
 }
 
-WindowedFileParser::~WindowedFileParser()
+/*
+ * Indexes the mapped file the way samtools faidx would, in one pass over
+ * its lines. Sequences whose lines are not all the same length (except the
+ * last) get a bpPerLine of 0 and can only be read from their start.
+ */
+void WindowedFileParser::scanIndex(const string &fileName)
+{
+	const char *p = m_fasta->data;
+	const char *end = p + m_fasta->size;
+	while (p < end) {
+		const char *newline = static_cast<const char*>(memchr(p, '\n',
+				end - p));
+		const char *lineEnd = newline == NULL ? end : newline;
+		if (*p != '>') {
+			//blank lines between sequences are allowed
+			if (lineEnd - p > 1 || (lineEnd - p == 1 && *p != '\r')) {
+				cerr << "Error: fasta file has sequence before its first header."
+						<< endl;
+				exit(1);
+			}
+			p = newline == NULL ? end : newline + 1;
+			continue;
+		}
+		const char *nameEnd = p + 1;
+		while (nameEnd < lineEnd && !isspace(*nameEnd)) {
+			++nameEnd;
+		}
+		string header(p + 1, nameEnd);
+		p = newline == NULL ? end : newline + 1;
+
+		FastaIndexValue value;
+		value.index = m_fasta->headers.size();
+		value.size = 0;
+		value.start = p - m_fasta->data;
+		value.bpPerLine = 0;
+		value.charsPerLine = 0;
+		bool regular = true;
+		bool shortLine = false;
+		while (p < end && *p != '>') {
+			newline = static_cast<const char*>(memchr(p, '\n', end - p));
+			lineEnd = newline == NULL ? end : newline;
+			size_t chars = lineEnd - p + (newline == NULL ? 0 : 1);
+			size_t bases = lineEnd - p;
+			if (bases > 0 && lineEnd[-1] == '\r') {
+				--bases;
+			}
+			if (value.charsPerLine == 0) {
+				value.bpPerLine = bases;
+				value.charsPerLine = chars;
+			} else if (shortLine || bases > value.bpPerLine
+					|| (bases == value.bpPerLine && newline != NULL
+							&& chars != value.charsPerLine))
+			{
+				regular = false;
+			}
+			shortLine = bases < value.bpPerLine;
+			value.size += bases;
+			p = newline == NULL ? end : newline + 1;
+		}
+		if (!regular) {
+			value.bpPerLine = 0;
+		}
+		addSequence(fileName, header, value);
+	}
+}
+
+/*
+ * Adds a sequence to the index, sequence names must be unique (as samtools
+ * faidx requires) for sequences to be found by name
+ */
+void WindowedFileParser::addSequence(const string &fileName,
+		const string &header, const FastaIndexValue &value)
 {
-	m_fastaFileHandle.close();
+	if (!m_fasta->index.insert(make_pair(header, value)).second) {
+		cerr << "Error: " << fileName << " has more than one sequence named "
+				<< header << "." << endl;
+		exit(1);
+	}
+	m_fasta->headers.push_back(header);
 }
 
+WindowedFileParser::~WindowedFileParser()
+{
+}
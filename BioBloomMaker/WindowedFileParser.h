@@ -9,12 +9,12 @@
 #define WINDOWEDFILEPARSER_H_
 #include <vector>
 #include <boost/unordered/unordered_map.hpp>
+#include <boost/shared_ptr.hpp>
 #include <string>
 #include <iostream>
-#include <fstream>
 #include "DataLayer/FastaReader.h"
 #include "Common/ReadsProcessor.h"
-#include <deque>
+#include "Common/DustMasker.h"
 
 using namespace std;
 using namespace boost;
@@ -23,11 +23,17 @@ class WindowedFileParser {
 public:
 	//constructor/destructor
 	explicit WindowedFileParser(const string &fileName, unsigned windowSize);
+	WindowedFileParser(const WindowedFileParser &parser);
 	const vector<string> getHeaders() const;
 	void setLocationByHeader( const string &header);
+	void setLocationByHeader(const string &header, size_t start, size_t kmers);
 	size_t getSequenceSize( const string &header) const;
+	bool isSeekable(const string &header) const;
 	const unsigned char* getNextSeq();
 	bool notEndOfSeqeunce() const;
+	void setDust(double threshold);
+
+	static bool canMap(const string &fileName);
 
 	virtual ~WindowedFileParser();
 
@@ -40,23 +46,46 @@ private:
 		size_t charsPerLine;
 	};
 
-	unordered_map<string, FastaIndexValue> m_fastaIndex;
-	ifstream m_fastaFileHandle;
+	//memory mapped file and its index, shared by copies of a parser
+	struct FastaFile {
+		const char *data;
+		size_t size;
+		boost::unordered_map<string, FastaIndexValue> index;
+		vector<string> headers;
+
+		FastaFile() :
+				data(NULL), size(0)
+		{
+		}
+
+		~FastaFile();
+	};
+
+	boost::shared_ptr<FastaFile> m_fasta;
 	unsigned m_windowSize;
-	vector<string> m_headers;
 	string m_currentHeader;
-	size_t m_currentEndSeqPos;
 	size_t m_currentLinePos;
-	string m_window;
 	string m_currentString;
 	ReadsProcessor m_proc;
 	bool m_sequenceNotEnd;
 
-	string m_bufferString; //so reallocation does not need to occur
+	//skips low complexity k-mers if set
+	boost::shared_ptr<DustMasker> m_dust;
+
+	//next byte of the file to read and the number of bases left to read
+	//from the current section of the sequence
+	const char *m_pos;
+	size_t m_basesLeft;
+	size_t m_kmersLeft;
 
 	//helper methods
 	void initializeIndex(string const &fileName);
+	void scanIndex(const string &fileName);
+	void addSequence(const string &fileName, const string &header,
+			const FastaIndexValue &value);
+	bool fillWindow();
 
+	WindowedFileParser& operator=(const WindowedFileParser &parser);
 };
 
 #endif /* WINDOWEDFILEPARSER_H_ */
@@ -0,0 +1,419 @@
+/*
+ * BgzfStream.cpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#include "BgzfStream.h"
+#include <cstring>
+#include <cstdlib>
+#include <cassert>
+#include <vector>
+#include <pthread.h>
+#include <zlib.h>
+
+using namespace std;
+
+//uncompressed data per block (same as bgzip, so compressed blocks fit in
+//the 16 bit block size of the header)
+static const size_t BGZF_BLOCK_SIZE = 0xff00;
+static const size_t BGZF_MAX_BLOCK_SIZE = 0x10000;
+static const size_t BGZF_HEADER_SIZE = 18;
+static const size_t BGZF_FOOTER_SIZE = 8;
+
+//blocks of all streams in flight per compression thread
+static const size_t BGZF_BLOCKS_PER_THREAD = 4;
+
+//empty block marking the end of a BGZF file
+static const char BGZF_EOF[28] = { 31, char(139), 8, 4, 0, 0, 0, 0, 0,
+		char(255), 6, 0, 'B', 'C', 2, 0, 27, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+
+struct bgzfstreambuf::Block {
+	std::vector<char> data;
+	size_t size;
+	std::vector<char> compressed;
+	size_t compressedSize;
+	int level;
+	volatile bool done;
+
+	Block() :
+			data(BGZF_BLOCK_SIZE), size(0), compressed(BGZF_MAX_BLOCK_SIZE), compressedSize(
+					0), level(Z_DEFAULT_COMPRESSION), done(false)
+	{
+	}
+};
+
+/*
+ * Compression threads shared by all streams, with the blocks not in use by
+ * a stream kept for reuse. Streams reserve one of a fixed number of slots
+ * for each block they hand to the threads, so memory and queued work are
+ * bounded however many files are open.
+ */
+class bgzfstreambuf::Pool {
+public:
+	Pool() :
+			m_slots(0), m_stop(false)
+	{
+		pthread_mutex_init(&m_mutex, NULL);
+		pthread_cond_init(&m_jobReady, NULL);
+		pthread_cond_init(&m_jobDone, NULL);
+	}
+
+	/*
+	 * Starts the threads the first time it is called
+	 */
+	void start(unsigned threads)
+	{
+		pthread_mutex_lock(&m_mutex);
+		if (m_threads.empty()) {
+			m_slots = threads * BGZF_BLOCKS_PER_THREAD;
+			m_threads.resize(threads);
+			for (unsigned i = 0; i < threads; ++i) {
+				if (pthread_create(&m_threads[i], NULL, compressThread, this)
+						!= 0)
+				{
+					cerr << "Error: could not start compression thread"
+							<< endl;
+					exit(1);
+				}
+			}
+		}
+		pthread_mutex_unlock(&m_mutex);
+	}
+
+	/*
+	 * Returns an unused block
+	 */
+	Block *takeBlock()
+	{
+		pthread_mutex_lock(&m_mutex);
+		Block *block = NULL;
+		if (!m_spare.empty()) {
+			block = m_spare.back();
+			m_spare.pop_back();
+		}
+		pthread_mutex_unlock(&m_mutex);
+		return block == NULL ? new Block() : block;
+	}
+
+	/*
+	 * Queues block to be compressed if a slot is free, returns false if not
+	 */
+	bool submit(Block &block)
+	{
+		pthread_mutex_lock(&m_mutex);
+		bool queued = m_slots > 0;
+		if (queued) {
+			--m_slots;
+			block.done = false;
+			m_jobs.push_back(&block);
+			pthread_cond_signal(&m_jobReady);
+		}
+		pthread_mutex_unlock(&m_mutex);
+		return queued;
+	}
+
+	bool isDone(const Block &block)
+	{
+		pthread_mutex_lock(&m_mutex);
+		bool done = block.done;
+		pthread_mutex_unlock(&m_mutex);
+		return done;
+	}
+
+	void waitFor(const Block &block)
+	{
+		pthread_mutex_lock(&m_mutex);
+		while (!block.done) {
+			pthread_cond_wait(&m_jobDone, &m_mutex);
+		}
+		pthread_mutex_unlock(&m_mutex);
+	}
+
+	/*
+	 * Takes back a block that is no longer in use, freeing its slot if it
+	 * was submitted
+	 */
+	void release(Block *block, bool submitted)
+	{
+		pthread_mutex_lock(&m_mutex);
+		if (submitted) {
+			++m_slots;
+		}
+		m_spare.push_back(block);
+		pthread_mutex_unlock(&m_mutex);
+	}
+
+	~Pool()
+	{
+		pthread_mutex_lock(&m_mutex);
+		m_stop = true;
+		pthread_cond_broadcast(&m_jobReady);
+		pthread_mutex_unlock(&m_mutex);
+		for (vector<pthread_t>::iterator it = m_threads.begin();
+				it != m_threads.end(); ++it)
+		{
+			pthread_join(*it, NULL);
+		}
+		for (vector<Block*>::iterator it = m_spare.begin();
+				it != m_spare.end(); ++it)
+		{
+			delete *it;
+		}
+		pthread_mutex_destroy(&m_mutex);
+		pthread_cond_destroy(&m_jobReady);
+		pthread_cond_destroy(&m_jobDone);
+	}
+
+private:
+	vector<pthread_t> m_threads;
+	deque<Block*> m_jobs;
+	vector<Block*> m_spare;
+	size_t m_slots;
+	bool m_stop;
+	pthread_mutex_t m_mutex;
+	pthread_cond_t m_jobReady;
+	pthread_cond_t m_jobDone;
+
+	static void *compressThread(void *arg)
+	{
+		Pool &pool = *static_cast<Pool*>(arg);
+		for (;;) {
+			pthread_mutex_lock(&pool.m_mutex);
+			while (pool.m_jobs.empty() && !pool.m_stop) {
+				pthread_cond_wait(&pool.m_jobReady, &pool.m_mutex);
+			}
+			if (pool.m_jobs.empty()) {
+				pthread_mutex_unlock(&pool.m_mutex);
+				return NULL;
+			}
+			Block &block = *pool.m_jobs.front();
+			pool.m_jobs.pop_front();
+			pthread_mutex_unlock(&pool.m_mutex);
+
+			compress(block);
+
+			pthread_mutex_lock(&pool.m_mutex);
+			block.done = true;
+			pthread_cond_broadcast(&pool.m_jobDone);
+			pthread_mutex_unlock(&pool.m_mutex);
+		}
+	}
+};
+
+bgzfstreambuf::Pool bgzfstreambuf::s_pool;
+
+bgzfstreambuf::bgzfstreambuf() :
+		m_file(NULL), m_level(Z_DEFAULT_COMPRESSION), m_pool(NULL), m_current(
+				NULL)
+{
+}
+
+bgzfstreambuf* bgzfstreambuf::open(const char *name, int level,
+		unsigned threads)
+{
+	if (is_open()) {
+		return NULL;
+	}
+	m_file = fopen(name, "wb");
+	if (m_file == NULL) {
+		return NULL;
+	}
+	m_level = level;
+	if (threads > 0) {
+		m_pool = &s_pool;
+		m_pool->start(threads);
+		m_current = m_pool->takeBlock();
+	} else {
+		m_pool = NULL;
+		m_current = new Block();
+	}
+	setp(&m_current->data[0], &m_current->data[0] + BGZF_BLOCK_SIZE);
+	return this;
+}
+
+bgzfstreambuf* bgzfstreambuf::close()
+{
+	if (!is_open()) {
+		return NULL;
+	}
+	bool good = sync() == 0;
+	if (m_pool != NULL) {
+		m_pool->release(m_current, false);
+	} else {
+		delete m_current;
+	}
+	m_current = NULL;
+
+	good = fwrite(BGZF_EOF, 1, sizeof(BGZF_EOF), m_file) == sizeof(BGZF_EOF)
+			&& good;
+	good = fclose(m_file) == 0 && good;
+	m_file = NULL;
+	setp(NULL, NULL);
+	return good ? this : NULL;
+}
+
+bgzfstreambuf::~bgzfstreambuf()
+{
+	close();
+}
+
+int bgzfstreambuf::overflow(int c)
+{
+	if (!is_open()) {
+		return EOF;
+	}
+	submitBlock();
+	if (c != EOF) {
+		*pptr() = char(c);
+		pbump(1);
+	}
+	return c == EOF ? 0 : c;
+}
+
+/*
+ * Copies large writes straight into blocks
+ */
+streamsize bgzfstreambuf::xsputn(const char *s, streamsize n)
+{
+	if (!is_open()) {
+		return 0;
+	}
+	streamsize written = 0;
+	while (written < n) {
+		streamsize room = epptr() - pptr();
+		if (room == 0) {
+			submitBlock();
+			room = epptr() - pptr();
+		}
+		streamsize len = min(room, n - written);
+		memcpy(pptr(), s + written, len);
+		pbump(int(len));
+		written += len;
+	}
+	return written;
+}
+
+/*
+ * Compresses the data buffered so far and writes every block to the file
+ */
+int bgzfstreambuf::sync()
+{
+	if (!is_open()) {
+		return 0;
+	}
+	if (pptr() > pbase()) {
+		submitBlock();
+	}
+	while (!m_inFlight.empty()) {
+		writeOldest();
+	}
+	return fflush(m_file) == 0 ? 0 : -1;
+}
+
+/*
+ * Hands the block being filled to the compression threads and starts
+ * filling the next one. If all slots of the pool are taken, the oldest
+ * block of this stream is written out to free one, and if the stream has
+ * none in flight the block is compressed in the writing thread.
+ */
+void bgzfstreambuf::submitBlock()
+{
+	Block &block = *m_current;
+	block.size = pptr() - pbase();
+	block.level = m_level;
+	for (;;) {
+		if (m_pool != NULL && m_pool->submit(block)) {
+			m_inFlight.push_back(m_current);
+			m_current = m_pool->takeBlock();
+			break;
+		}
+		if (m_inFlight.empty()) {
+			compress(block);
+			writeBlock(block);
+			break;
+		}
+		writeOldest();
+	}
+
+	//write blocks that are already compressed
+	while (!m_inFlight.empty() && m_pool->isDone(*m_inFlight.front())) {
+		writeOldest();
+	}
+	setp(&m_current->data[0], &m_current->data[0] + BGZF_BLOCK_SIZE);
+}
+
+/*
+ * Waits for the oldest block in flight to be compressed, writes it and
+ * gives it back to the pool
+ */
+void bgzfstreambuf::writeOldest()
+{
+	Block *block = m_inFlight.front();
+	m_inFlight.pop_front();
+	m_pool->waitFor(*block);
+	writeBlock(*block);
+	m_pool->release(block, true);
+}
+
+void bgzfstreambuf::writeBlock(const Block &block)
+{
+	if (fwrite(&block.compressed[0], 1, block.compressedSize, m_file)
+			!= block.compressedSize)
+	{
+		cerr << "Error: could not write compressed output" << endl;
+		exit(1);
+	}
+}
+
+/*
+ * Compresses a block into a gzip member with the BGZF extra field
+ */
+void bgzfstreambuf::compress(Block &block)
+{
+	int level = block.level;
+	for (;;) {
+		z_stream zs;
+		memset(&zs, 0, sizeof(zs));
+		zs.next_in = reinterpret_cast<Bytef*>(&block.data[0]);
+		zs.avail_in = block.size;
+		zs.next_out = reinterpret_cast<Bytef*>(&block.compressed[0]
+				+ BGZF_HEADER_SIZE);
+		zs.avail_out = BGZF_MAX_BLOCK_SIZE - BGZF_HEADER_SIZE
+				- BGZF_FOOTER_SIZE;
+		//raw deflate, the gzip header and footer are written below
+		if (deflateInit2(&zs, level, Z_DEFLATED, -15, 8,
+				Z_DEFAULT_STRATEGY) != Z_OK)
+		{
+			cerr << "Error: could not initialize compression" << endl;
+			exit(1);
+		}
+		int status = deflate(&zs, Z_FINISH);
+		deflateEnd(&zs);
+		if (status == Z_STREAM_END) {
+			block.compressedSize = BGZF_HEADER_SIZE + zs.total_out
+					+ BGZF_FOOTER_SIZE;
+			break;
+		}
+		//incompressible data, store it instead (always fits)
+		assert(level != 0);
+		level = 0;
+	}
+
+	unsigned char *out = reinterpret_cast<unsigned char*>(&block.compressed[0]);
+	static const unsigned char header[16] = { 31, 139, 8, 4, 0, 0, 0, 0, 0,
+			255, 6, 0, 'B', 'C', 2, 0 };
+	memcpy(out, header, sizeof(header));
+	size_t blockSize = block.compressedSize - 1;
+	out[16] = blockSize & 0xff;
+	out[17] = blockSize >> 8;
+
+	unsigned char *footer = out + block.compressedSize - BGZF_FOOTER_SIZE;
+	uLong crc = crc32(0L, Z_NULL, 0);
+	crc = crc32(crc, reinterpret_cast<const Bytef*>(&block.data[0]),
+			block.size);
+	for (unsigned i = 0; i < 4; ++i) {
+		footer[i] = (crc >> (8 * i)) & 0xff;
+		footer[4 + i] = (block.size >> (8 * i)) & 0xff;
+	}
+}
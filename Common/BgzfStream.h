@@ -0,0 +1,103 @@
+/*
+ * BgzfStream.h
+ *	Output stream that writes gzip compressed files in the BGZF format
+ *	(a series of independent gzip members of at most 64 KB each, as used by
+ *	samtools and bgzip). Because blocks are independent they are compressed
+ *	by a pool of threads, shared by all open streams, while the callers keep
+ *	writing; blocks are written to each file in order. The output can be
+ *	read by any gzip reader.
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#ifndef BGZFSTREAM_H_
+#define BGZFSTREAM_H_
+
+#include <iostream>
+#include <deque>
+#include <cstdio>
+
+class bgzfstreambuf: public std::streambuf {
+public:
+	bgzfstreambuf();
+
+	/*
+	 * level is the zlib compression level, threads the number of threads
+	 * compressing blocks (0 = compress in the writing thread). The threads
+	 * are shared by every stream of the process: they are started by the
+	 * first stream opened with threads > 0, later streams use them as they
+	 * are, and at most threads * 4 blocks of all streams are queued or
+	 * waiting to be written at a time.
+	 * Returns NULL if the file cannot be opened
+	 */
+	bgzfstreambuf* open(const char *name, int level, unsigned threads);
+
+	/*
+	 * Writes all pending blocks and the end of file marker
+	 */
+	bgzfstreambuf* close();
+
+	bool is_open() const
+	{
+		return m_file != NULL;
+	}
+
+	~bgzfstreambuf();
+
+protected:
+	int overflow(int c);
+	std::streamsize xsputn(const char *s, std::streamsize n);
+	int sync();
+
+private:
+	struct Block;
+	class Pool;
+
+	//compression threads of the process
+	static Pool s_pool;
+
+	FILE *m_file;
+	int m_level;
+
+	//NULL to compress in the writing thread
+	Pool *m_pool;
+
+	//block being filled and the blocks being compressed or waiting to be
+	//written, oldest first
+	Block *m_current;
+	std::deque<Block*> m_inFlight;
+
+	void submitBlock();
+	void writeOldest();
+	void writeBlock(const Block &block);
+	static void compress(Block &block);
+};
+
+class obgzfstream: public std::ostream {
+public:
+	obgzfstream(const char *name, int level, unsigned threads) :
+			std::ostream(NULL)
+	{
+		rdbuf(&m_buf);
+		if (!m_buf.open(name, level, threads)) {
+			setstate(std::ios::badbit);
+		}
+	}
+
+	void close()
+	{
+		if (m_buf.is_open() && !m_buf.close()) {
+			setstate(std::ios::badbit);
+		}
+	}
+
+	~obgzfstream()
+	{
+		close();
+	}
+
+private:
+	bgzfstreambuf m_buf;
+};
+
+#endif /* BGZFSTREAM_H_ */
@@ -12,6 +12,7 @@
 #include <cstring>
 #include <cassert>
 #include <cstdlib>
+#include <algorithm>
 #include <stdio.h>
 #include <cstring>
 
@@ -109,6 +110,38 @@ void BloomFilter::insert(const unsigned char* kmer)
 	}
 }
 
+/*
+ * Inserts the k-mer and returns true if it was already in the filter (every
+ * bit was set before). Checking and setting each bit in one atomic operation
+ * keeps the answer consistent when several threads insert at once.
+ */
+bool BloomFilter::insertAndCheck(const unsigned char* kmer)
+{
+	bool found = true;
+	//hash in groups so the bytes of a group can be fetched from memory at once
+	size_t positions[16];
+	for (size_t first = 0; first < m_hashNum; first += 16) {
+		size_t count = min(size_t(16), m_hashNum - first);
+		for (size_t i = 0; i < count; ++i) {
+			positions[i] = CityHash64WithSeed(
+					reinterpret_cast<const char*>(kmer), m_kmerSizeInBytes,
+					first + i) % m_size;
+			__builtin_prefetch(&m_filter[positions[i] / bitsPerChar], 1);
+		}
+		for (size_t i = 0; i < count; ++i) {
+			unsigned char &byte = m_filter[positions[i] / bitsPerChar];
+			unsigned char bit = bitMask[positions[i] % bitsPerChar];
+			//bits are never cleared, so set ones need no atomic operation
+			if ((byte & bit) == 0
+					&& (__sync_fetch_and_or(&byte, bit) & bit) == 0)
+			{
+				found = false;
+			}
+		}
+	}
+	return found;
+}
+
 /*
  * Accepts a list of precomputed hash values. Faster than rehashing each time.
  */
@@ -152,12 +185,52 @@ void BloomFilter::storeFilter(string const &filterFilePath) const
 
 	cerr << "Storing filter. Filter is " << m_sizeInBytes << "bytes." << endl;
 
-	assert(myFile);
 	//write out each block
 	myFile.write(reinterpret_cast<char*>(m_filter), m_sizeInBytes);
 
 	myFile.close();
-	assert(myFile);
+	if (!myFile) {
+		cerr << "Error: could not write filter " << filterFilePath << endl;
+		exit(1);
+	}
+}
+
+/*
+ * Adds the entries of the filter stored at the path specified, which must be
+ * the same size and use the same hash functions, by or-ing it into this one
+ * a block at a time
+ */
+void BloomFilter::mergeFilter(string const &filterFilePath)
+{
+	FILE *file = fopen(filterFilePath.c_str(), "rb");
+	if (file == NULL) {
+		cerr << "file \"" << filterFilePath << "\" could not be read." << endl;
+		exit(1);
+	}
+	fseek(file, 0, SEEK_END);
+	size_t fileSize = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	if (fileSize != m_sizeInBytes) {
+		cerr << "Error: " << filterFilePath
+				<< " is not the same size as the filter it is merged into. Size: "
+				<< fileSize << " vs " << m_sizeInBytes << " bytes." << endl;
+		exit(1);
+	}
+
+	const size_t blockSize = 1 << 20;
+	vector<unsigned char> block(min(blockSize, m_sizeInBytes));
+	for (size_t pos = 0; pos < m_sizeInBytes; pos += block.size()) {
+		size_t count = min(block.size(), m_sizeInBytes - pos);
+		if (fread(&block[0], 1, count, file) != count) {
+			cerr << "file \"" << filterFilePath << "\" could not be read."
+					<< endl;
+			exit(1);
+		}
+		for (size_t i = 0; i < count; ++i) {
+			m_filter[pos + i] |= block[i];
+		}
+	}
+	fclose(file);
 }
 
 unsigned BloomFilter::getHashNum() const
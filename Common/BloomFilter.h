@@ -41,12 +41,27 @@ static inline vector<size_t> multiHash(const unsigned char* kmer, size_t num,
 	return tempHashValues;
 }
 
+/*
+ * As above, but into values, so one vector can be reused for many k-mers
+ */
+static inline void multiHash(const unsigned char* kmer, size_t num,
+		unsigned kmerSize, vector<size_t> &values) {
+	values.resize(num);
+	size_t kmerSizeInBytes = (kmerSize + 4 - 1) / 4;
+
+	for (size_t i = 0; i < num; ++i) {
+		values[i] = CityHash64WithSeed(reinterpret_cast<const char*>(kmer),
+				kmerSizeInBytes, i);
+	}
+}
+
 class BloomFilter {
 public:
 	//for generating a new filter
 	explicit BloomFilter(size_t filterSize, unsigned hashNum, unsigned kmerSize);
 	void insert(vector<size_t> const &precomputed);
 	void insert(const unsigned char* kmer);
+	bool insertAndCheck(const unsigned char* kmer);
 	bool contains(vector<size_t> const &precomputed) const;
 	bool contains(const unsigned char* kmer) const;
 
@@ -55,6 +70,7 @@ public:
 
 	//for storing/restoring the filter
 	void storeFilter(string const &filterFilePath) const;
+	void mergeFilter(string const &filterFilePath);
 	explicit BloomFilter(size_t filterSize, unsigned hashNum, unsigned kmerSize,
 			string const &filterFilePath);
 
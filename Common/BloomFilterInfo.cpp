@@ -10,6 +10,7 @@
 #include <fstream>
 #include <sstream>
 #include <assert.h>
+#include <cstdlib>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/ini_parser.hpp>
 
@@ -113,6 +114,10 @@ void BloomFilterInfo::printInfoFile(const string &fileName) const
 	//print out hash functions as a list
 
 	output.close();
+	if (!output) {
+		cerr << "Error: could not write info file " << fileName << endl;
+		exit(1);
+	}
 }
 
 //getters
@@ -147,6 +152,31 @@ double BloomFilterInfo::getFPR() const
 	return m_runInfo.FPR;
 }
 
+double BloomFilterInfo::getDesiredFPR() const
+{
+	return m_desiredFPR;
+}
+
+size_t BloomFilterInfo::getExpectedNumEntries() const
+{
+	return m_expectedNumEntries;
+}
+
+size_t BloomFilterInfo::getTotalNum() const
+{
+	return m_runInfo.numEntries;
+}
+
+size_t BloomFilterInfo::getRedundancy() const
+{
+	return m_runInfo.redundantSequences;
+}
+
+const vector<string> &BloomFilterInfo::getSeqSrcs() const
+{
+	return m_seqSrcs;
+}
+
 const vector<string> BloomFilterInfo::convertSeqSrcString(
 		string const &seqSrcStr) const
 {
@@ -47,6 +47,11 @@ public:
 	const string &getPresetType() const;
 	double getRedundancyFPR() const;
 	double getFPR() const;
+	double getDesiredFPR() const;
+	size_t getExpectedNumEntries() const;
+	size_t getTotalNum() const;
+	size_t getRedundancy() const;
+	const vector<string> &getSeqSrcs() const;
 
 private:
 	//user specified input
@@ -0,0 +1,253 @@
+/*
+ * BoundedQueue.h
+ *	Bounded multi-producer multi-consumer queue used to connect the stages of
+ *	a pipeline. Each slot of the ring carries a sequence number so producers
+ *	and consumers only contend on a compare-and-swap of their position
+ *	(no locks are taken). Blocking calls wait with a spin then yield backoff,
+ *	which gives backpressure when a downstream stage falls behind.
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#ifndef BOUNDEDQUEUE_H_
+#define BOUNDEDQUEUE_H_
+
+#include <vector>
+#include <cassert>
+#include <stddef.h>
+#include <stdint.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/time.h>
+
+using namespace std;
+
+template<typename T>
+class BoundedQueue {
+public:
+	/*
+	 * Capacity is rounded up to the next power of 2
+	 */
+	explicit BoundedQueue(size_t capacity) :
+			m_enqueuePos(0), m_dequeuePos(0), m_closed(false), m_maxDepth(0), m_pushStalls(
+					0), m_popStalls(0), m_pushStallUsec(0), m_popStallUsec(0)
+	{
+		size_t size = 2;
+		while (size < capacity) {
+			size <<= 1;
+		}
+		m_buffer = vector<Cell>(size);
+		m_mask = size - 1;
+		for (size_t i = 0; i < size; ++i) {
+			m_buffer[i].sequence = i;
+		}
+	}
+
+	/*
+	 * Returns false if the queue is full
+	 */
+	bool tryPush(const T &item)
+	{
+		size_t pos = m_enqueuePos;
+		for (;;) {
+			Cell &cell = m_buffer[pos & m_mask];
+			intptr_t diff = intptr_t(cell.sequence) - intptr_t(pos);
+			__sync_synchronize();
+			if (diff == 0) {
+				if (__sync_bool_compare_and_swap(&m_enqueuePos, pos, pos + 1)) {
+					cell.data = item;
+					__sync_synchronize();
+					cell.sequence = pos + 1;
+					updateMaxDepth(pos + 1);
+					return true;
+				}
+			} else if (diff < 0) {
+				return false;
+			}
+			pos = m_enqueuePos;
+		}
+	}
+
+	/*
+	 * Returns false if the queue is empty
+	 */
+	bool tryPop(T &item)
+	{
+		size_t pos = m_dequeuePos;
+		for (;;) {
+			Cell &cell = m_buffer[pos & m_mask];
+			intptr_t diff = intptr_t(cell.sequence) - intptr_t(pos + 1);
+			__sync_synchronize();
+			if (diff == 0) {
+				if (__sync_bool_compare_and_swap(&m_dequeuePos, pos, pos + 1)) {
+					item = cell.data;
+					__sync_synchronize();
+					cell.sequence = pos + m_mask + 1;
+					return true;
+				}
+			} else if (diff < 0) {
+				return false;
+			}
+			pos = m_dequeuePos;
+		}
+	}
+
+	/*
+	 * Waits until there is room in the queue
+	 */
+	void push(const T &item)
+	{
+		assert(!m_closed);
+		if (tryPush(item)) {
+			return;
+		}
+		uint64_t start = now();
+		for (unsigned attempt = 0; !tryPush(item); ++attempt) {
+			backoff(attempt);
+		}
+		__sync_fetch_and_add(&m_pushStalls, 1);
+		__sync_fetch_and_add(&m_pushStallUsec, now() - start);
+	}
+
+	/*
+	 * Waits until an item is available
+	 * Returns false once the queue is closed and drained
+	 */
+	bool pop(T &item)
+	{
+		if (tryPop(item)) {
+			return true;
+		}
+		uint64_t start = now();
+		bool found = false;
+		for (unsigned attempt = 0;; ++attempt) {
+			//check closed first, so a failed pop after it means drained
+			bool closed = m_closed;
+			__sync_synchronize();
+			if (tryPop(item)) {
+				found = true;
+				break;
+			}
+			if (closed) {
+				break;
+			}
+			backoff(attempt);
+		}
+		__sync_fetch_and_add(&m_popStalls, 1);
+		__sync_fetch_and_add(&m_popStallUsec, now() - start);
+		return found;
+	}
+
+	/*
+	 * Signals consumers that nothing more will be pushed
+	 */
+	void close()
+	{
+		__sync_synchronize();
+		m_closed = true;
+	}
+
+	/*
+	 * Approximate number of items in the queue
+	 */
+	size_t size() const
+	{
+		size_t dequeuePos = m_dequeuePos;
+		size_t enqueuePos = m_enqueuePos;
+		return enqueuePos > dequeuePos ? enqueuePos - dequeuePos : 0;
+	}
+
+	size_t capacity() const
+	{
+		return m_mask + 1;
+	}
+
+	size_t getMaxDepth() const
+	{
+		return m_maxDepth;
+	}
+
+	/*
+	 * Number of times a push had to wait for space and total time waited
+	 */
+	size_t getPushStalls() const
+	{
+		return m_pushStalls;
+	}
+
+	double getPushStallSeconds() const
+	{
+		return double(m_pushStallUsec) / 1000000.0;
+	}
+
+	/*
+	 * Number of times a pop had to wait for an item and total time waited
+	 */
+	size_t getPopStalls() const
+	{
+		return m_popStalls;
+	}
+
+	double getPopStallSeconds() const
+	{
+		return double(m_popStallUsec) / 1000000.0;
+	}
+
+private:
+	struct Cell {
+		volatile size_t sequence;
+		T data;
+	};
+
+	vector<Cell> m_buffer;
+	size_t m_mask;
+
+	//keep the positions on separate cache lines
+	char m_pad0[64];
+	volatile size_t m_enqueuePos;
+	char m_pad1[64];
+	volatile size_t m_dequeuePos;
+	char m_pad2[64];
+
+	volatile bool m_closed;
+
+	//statistics for tuning
+	size_t m_maxDepth;
+	size_t m_pushStalls;
+	size_t m_popStalls;
+	uint64_t m_pushStallUsec;
+	uint64_t m_popStallUsec;
+
+	void updateMaxDepth(size_t enqueuePos)
+	{
+		size_t dequeuePos = m_dequeuePos;
+		size_t depth = enqueuePos > dequeuePos ? enqueuePos - dequeuePos : 0;
+		size_t maxDepth = m_maxDepth;
+		while (depth > maxDepth
+				&& !__sync_bool_compare_and_swap(&m_maxDepth, maxDepth, depth))
+		{
+			maxDepth = m_maxDepth;
+		}
+	}
+
+	static void backoff(unsigned attempt)
+	{
+		if (attempt < 64) {
+			return;
+		} else if (attempt < 1024) {
+			sched_yield();
+		} else {
+			timespec wait = { 0, 50000 };
+			nanosleep(&wait, NULL);
+		}
+	}
+
+	static uint64_t now()
+	{
+		timeval tv;
+		gettimeofday(&tv, NULL);
+		return uint64_t(tv.tv_sec) * 1000000 + tv.tv_usec;
+	}
+};
+
+#endif /* BOUNDEDQUEUE_H_ */
@@ -0,0 +1,68 @@
+/*
+ * DustMasker.cpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#include "DustMasker.h"
+#include <cassert>
+#include <cstring>
+
+/*
+ * Code of the triplet starting at seq, from bits 1 and 2 of each base, which
+ * tell apart A, C, G and T in either case. Triplets with other bases get a
+ * code too, but are only in windows of k-mers that are not used.
+ */
+static uint8_t tripletCode(const char *seq)
+{
+	const unsigned char *bases = reinterpret_cast<const unsigned char*>(seq);
+	return uint8_t((bases[0] << 3 & 0x30) | (bases[1] << 1 & 0x0c)
+			| (bases[2] >> 1 & 0x03));
+}
+
+DustMasker::DustMasker(unsigned kmerSize, double threshold) :
+		m_kmerSize(kmerSize), m_limit(threshold * (kmerSize - 3)), m_started(
+				false), m_score(0), m_triplets(kmerSize - 2), m_first(0)
+{
+	assert(kmerSize > 3);
+	memset(m_counts, 0, sizeof(m_counts));
+}
+
+bool DustMasker::isMasked(const char *kmer)
+{
+	size_t triplets = m_triplets.size();
+	if (!m_started) {
+		memset(m_counts, 0, sizeof(m_counts));
+		m_score = 0;
+		m_first = 0;
+		for (size_t i = 0; i < triplets; ++i) {
+			m_triplets[i] = tripletCode(kmer + i);
+			add(m_triplets[i]);
+		}
+		m_started = true;
+	} else {
+		//the last triplet replaces the first one of the k-mer before
+		remove(m_triplets[m_first]);
+		m_triplets[m_first] = tripletCode(kmer + triplets - 1);
+		add(m_triplets[m_first]);
+		m_first = m_first + 1 == triplets ? 0 : m_first + 1;
+	}
+	return m_score > m_limit;
+}
+
+bool DustMasker::isLowComplexity(const char *seq, size_t length)
+{
+	if (length < m_kmerSize) {
+		return false;
+	}
+	size_t kmers = length - m_kmerSize + 1;
+	size_t masked = 0;
+	reset();
+	for (size_t i = 0; i < kmers; ++i) {
+		if (isMasked(seq + i)) {
+			++masked;
+		}
+	}
+	reset();
+	return masked * 2 >= kmers;
+}
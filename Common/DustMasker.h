@@ -0,0 +1,71 @@
+/*
+ * DustMasker.h
+ *	Finds low complexity k-mers (microsatellites, poly-A tails) with the
+ *	DUST score of Morgulis et al. 2006: the triplets (3-mers) of a window
+ *	are counted and the score is the sum of c(c - 1) / 2 over the counts c,
+ *	divided by the number of triplets less one. Sequence made of repeats of
+ *	a short motif scores high, random sequence close to 0. The score of a
+ *	k-mer is updated from the one before it in constant time.
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#ifndef DUSTMASKER_H_
+#define DUSTMASKER_H_
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+class DustMasker {
+public:
+	/*
+	 * k-mers scoring above threshold are low complexity (about 2 masks
+	 * repeats of motifs of up to 4 bases in 25-mers)
+	 */
+	DustMasker(unsigned kmerSize, double threshold);
+
+	/*
+	 * Starts a new sequence, the next k-mer is scored from scratch
+	 */
+	void reset()
+	{
+		m_started = false;
+	}
+
+	/*
+	 * Whether the k-mer starting at kmer is low complexity. The k-mers given
+	 * since the last reset must be consecutive k-mers of one sequence.
+	 */
+	bool isMasked(const char *kmer);
+
+	/*
+	 * Whether at least half of the k-mers of a sequence are low complexity
+	 */
+	bool isLowComplexity(const char *seq, size_t length);
+
+private:
+	unsigned m_kmerSize;
+	double m_limit;
+	bool m_started;
+
+	//number of each triplet in the k-mer
+	unsigned m_counts[64];
+	size_t m_score;
+
+	//codes of the triplets of the k-mer, oldest at m_first
+	std::vector<uint8_t> m_triplets;
+	size_t m_first;
+
+	void add(uint8_t triplet)
+	{
+		m_score += m_counts[triplet]++;
+	}
+
+	void remove(uint8_t triplet)
+	{
+		m_score -= --m_counts[triplet];
+	}
+};
+
+#endif /* DUSTMASKER_H_ */
@@ -6,7 +6,8 @@
  */
 
 #include "Dynamicofstream.h"
-#include "gzstream.h"
+#include "BgzfStream.h"
+#include "Options.h"
 #include "StringUtil.h"
 #include <iostream>
 #include <fstream>
@@ -14,7 +15,8 @@
 Dynamicofstream::Dynamicofstream(const string &filename)
 {
 	if (endsWith(filename, ".gz")) {
-		filestream = new ogzstream(filename.c_str(), ios::out);
+		filestream = new obgzfstream(filename.c_str(), opt::gzipLevel,
+				opt::gzipThreads);
 		gz = true;
 	} else {
 		filestream = new ofstream(filename.c_str(), ios::out);
@@ -29,6 +31,14 @@ ostream& Dynamicofstream::operator <<(const string& o)
 	return *filestream;
 }
 
+/*
+ * Writes a block of formatted text in one call
+ */
+void Dynamicofstream::write(const string &input)
+{
+	filestream->write(input.data(), input.size());
+}
+
 ostream& Dynamicofstream::operator <<(unsigned o)
 {
 	*filestream << o;
@@ -41,7 +51,7 @@ void Dynamicofstream::close()
 	filestream->flush();
 	assert(filestream);
 	if (gz) {
-		ogzstream *temp = dynamic_cast<ogzstream*>(filestream);
+		obgzfstream *temp = dynamic_cast<obgzfstream*>(filestream);
 		assert(filestream->good());
 		temp->close();
 	} else {
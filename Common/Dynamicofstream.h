@@ -5,12 +5,12 @@
  *	the appropriate type depending on output filename
  *
  *	Uses normal ofstream in all cases except:
- *	Gzip (.gz) file extensions uses zlib (gzstream)
+ *	Gzip (.gz) file extensions are written as BGZF, compressed in parallel
+ *	(see opt::gzipLevel and opt::gzipThreads)
  *
  *  Created on: Jun 19, 2013
  *      Author: cjustin
  */
-//@TODO: Thread so that gzipping process does not run on main thread?
 
 #ifndef DYNAMICOFSTREAM_H_
 #define DYNAMICOFSTREAM_H_
@@ -23,7 +23,7 @@ using namespace std;
 class Dynamicofstream{
 public:
 	Dynamicofstream(const string &filename);
-//	void write(const string &input);
+	void write(const string &input);
 //	Dynamicofstream& operator <<(Dynamicofstream& out, const string& o);
 	ostream& operator <<(const string& o);
 	ostream& operator <<(unsigned o);
@@ -0,0 +1,354 @@
+/*
+ * GzipReader.cpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#include "GzipReader.h"
+#include "StringUtil.h"
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <cassert>
+#include <string>
+
+using namespace std;
+
+static const size_t BGZF_HEADER_SIZE = 18;
+static const size_t BGZF_FOOTER_SIZE = 8;
+static const size_t BGZF_MAX_BLOCK_SIZE = 0x10000;
+
+//blocks read ahead per inflating thread
+static const size_t BGZF_BLOCKS_PER_THREAD = 4;
+
+//buffer sizes for gzip files that are not BGZF
+static const size_t GZIP_INPUT_SIZE = 0x10000;
+static const size_t GZIP_OUTPUT_SIZE = 0x40000;
+
+/*
+ * Whether the length bytes at data start with the magic of a gzip member
+ */
+static bool isGzipMagic(const unsigned char *data, size_t length)
+{
+	return length >= 2 && data[0] == 31 && data[1] == 139;
+}
+
+/*
+ * Whether header is the start of a gzip member with a BGZF extra field
+ */
+static bool isBgzfHeader(const unsigned char *header)
+{
+	return header[0] == 31 && header[1] == 139 && header[2] == 8
+			&& (header[3] & 4) && header[10] == 6 && header[11] == 0
+			&& header[12] == 'B' && header[13] == 'C' && header[14] == 2
+			&& header[15] == 0;
+}
+
+static uint32_t readLE32(const unsigned char *p)
+{
+	return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16
+			| uint32_t(p[3]) << 24;
+}
+
+GzipReader::GzipReader(FILE *file, const char *path, unsigned threads) :
+		m_file(file), m_path(path), m_bgzf(false), m_eof(false), m_offset(0), m_pendingPos(
+				0), m_first(0), m_inFlight(0), m_holding(false), m_fileDone(
+				false), m_stop(false)
+{
+	pthread_mutex_init(&m_mutex, NULL);
+	pthread_cond_init(&m_jobReady, NULL);
+	pthread_cond_init(&m_jobDone, NULL);
+	memset(&m_stream, 0, sizeof(m_stream));
+
+	//check the format from the first header
+	m_pending.resize(BGZF_HEADER_SIZE);
+	m_pending.resize(fread(&m_pending[0], 1, BGZF_HEADER_SIZE, m_file));
+	m_bgzf = m_pending.size() == BGZF_HEADER_SIZE
+			&& isBgzfHeader(
+					reinterpret_cast<const unsigned char*>(&m_pending[0]));
+
+	if (m_bgzf) {
+		m_blocks = vector<Block>(threads * BGZF_BLOCKS_PER_THREAD + 2);
+		for (vector<Block>::iterator it = m_blocks.begin();
+				it != m_blocks.end(); ++it)
+		{
+			it->compressed.resize(BGZF_MAX_BLOCK_SIZE);
+			it->data.resize(BGZF_MAX_BLOCK_SIZE + 1);
+			it->compressedSize = it->size = 0;
+			it->done = false;
+		}
+		m_threads.resize(threads);
+		for (unsigned i = 0; i < threads; ++i) {
+			if (pthread_create(&m_threads[i], NULL, inflateThread, this)
+					!= 0)
+			{
+				die("could not start decompression thread");
+			}
+		}
+	} else {
+		m_input.resize(GZIP_INPUT_SIZE);
+		m_output.resize(GZIP_OUTPUT_SIZE + 1);
+		//32 + window bits detects gzip or zlib headers
+		if (inflateInit2(&m_stream, 32 + MAX_WBITS) != Z_OK) {
+			die("could not initialize decompression");
+		}
+	}
+}
+
+bool GzipReader::isGzipPath(const char *path)
+{
+	string name(path);
+	return endsWith(name, ".gz") && !endsWith(name, ".tar.gz");
+}
+
+GzipReader::~GzipReader()
+{
+	pthread_mutex_lock(&m_mutex);
+	m_stop = true;
+	pthread_cond_broadcast(&m_jobReady);
+	pthread_mutex_unlock(&m_mutex);
+	for (vector<pthread_t>::iterator it = m_threads.begin();
+			it != m_threads.end(); ++it)
+	{
+		pthread_join(*it, NULL);
+	}
+	if (!m_bgzf) {
+		inflateEnd(&m_stream);
+	}
+	pthread_mutex_destroy(&m_mutex);
+	pthread_cond_destroy(&m_jobReady);
+	pthread_cond_destroy(&m_jobDone);
+}
+
+size_t GzipReader::read(char *&data)
+{
+	if (m_eof) {
+		return 0;
+	}
+	size_t length = m_bgzf ? readBgzf(data) : readGzip(data);
+	if (length == 0) {
+		m_eof = true;
+	}
+	m_offset += length;
+	return length;
+}
+
+/*
+ * Reads from the file, starting with the bytes used to detect the format
+ */
+size_t GzipReader::readRaw(char *buffer, size_t length)
+{
+	size_t count = 0;
+	if (m_pendingPos < m_pending.size()) {
+		count = min(length, m_pending.size() - m_pendingPos);
+		memcpy(buffer, &m_pending[m_pendingPos], count);
+		m_pendingPos += count;
+	}
+	if (count < length) {
+		count += fread(buffer + count, 1, length - count, m_file);
+	}
+	return count;
+}
+
+size_t GzipReader::readBgzf(char *&data)
+{
+	for (;;) {
+		//the caller is done with the block returned last time
+		if (m_holding) {
+			m_first = (m_first + 1) % m_blocks.size();
+			--m_inFlight;
+			m_holding = false;
+		}
+
+		//read ahead as many blocks as there is room for
+		while (!m_fileDone && m_inFlight < m_blocks.size()) {
+			Block &block = m_blocks[(m_first + m_inFlight) % m_blocks.size()];
+			if (!readBlock(block)) {
+				m_fileDone = true;
+				break;
+			}
+			++m_inFlight;
+			if (m_threads.empty()) {
+				inflateBlock(block);
+				block.done = true;
+			} else {
+				pthread_mutex_lock(&m_mutex);
+				block.done = false;
+				m_jobs.push_back(&block);
+				pthread_cond_signal(&m_jobReady);
+				pthread_mutex_unlock(&m_mutex);
+			}
+		}
+		if (m_inFlight == 0) {
+			return 0;
+		}
+
+		Block &block = m_blocks[m_first];
+		pthread_mutex_lock(&m_mutex);
+		while (!block.done) {
+			pthread_cond_wait(&m_jobDone, &m_mutex);
+		}
+		pthread_mutex_unlock(&m_mutex);
+		m_holding = true;
+		//skip empty blocks, such as the end of file marker
+		if (block.size > 0) {
+			data = &block.data[0];
+			return block.size;
+		}
+	}
+}
+
+/*
+ * Reads the next compressed BGZF block, returns false at the end of the file
+ */
+bool GzipReader::readBlock(Block &block)
+{
+	char *buffer = &block.compressed[0];
+	size_t count = readRaw(buffer, BGZF_HEADER_SIZE);
+	if (count == 0) {
+		return false;
+	}
+	const unsigned char *header = reinterpret_cast<const unsigned char*>(buffer);
+	if (!isGzipMagic(header, count)) {
+		warn("ignoring trailing garbage after compressed data");
+		return false;
+	}
+	if (count != BGZF_HEADER_SIZE || !isBgzfHeader(header)) {
+		die("invalid BGZF block header");
+	}
+	block.compressedSize = (size_t(header[16]) | size_t(header[17]) << 8) + 1;
+	if (block.compressedSize < BGZF_HEADER_SIZE + BGZF_FOOTER_SIZE) {
+		die("invalid BGZF block size");
+	}
+	size_t rest = block.compressedSize - BGZF_HEADER_SIZE;
+	if (readRaw(buffer + BGZF_HEADER_SIZE, rest) != rest) {
+		die("unexpected end of compressed file");
+	}
+	return true;
+}
+
+/*
+ * Inflates a BGZF block and checks its length and CRC
+ */
+void GzipReader::inflateBlock(Block &block) const
+{
+	const unsigned char *footer =
+			reinterpret_cast<const unsigned char*>(&block.compressed[0])
+					+ block.compressedSize - BGZF_FOOTER_SIZE;
+	block.size = readLE32(footer + 4);
+	if (block.size > BGZF_MAX_BLOCK_SIZE) {
+		die("invalid BGZF block size");
+	}
+
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+	zs.next_in = reinterpret_cast<Bytef*>(&block.compressed[0]
+			+ BGZF_HEADER_SIZE);
+	zs.avail_in = block.compressedSize - BGZF_HEADER_SIZE - BGZF_FOOTER_SIZE;
+	zs.next_out = reinterpret_cast<Bytef*>(&block.data[0]);
+	zs.avail_out = BGZF_MAX_BLOCK_SIZE;
+	//raw deflate, the gzip header and footer are checked here
+	if (inflateInit2(&zs, -15) != Z_OK) {
+		die("could not initialize decompression");
+	}
+	int status = inflate(&zs, Z_FINISH);
+	inflateEnd(&zs);
+	uLong crc = crc32(0L, Z_NULL, 0);
+	crc = crc32(crc, reinterpret_cast<const Bytef*>(&block.data[0]),
+			block.size);
+	if (status != Z_STREAM_END || zs.total_out != block.size
+			|| crc != readLE32(footer))
+	{
+		die("corrupt BGZF block");
+	}
+	block.data[block.size] = '\0';
+}
+
+/*
+ * Inflates the next part of a gzip file (which may have several members)
+ */
+size_t GzipReader::readGzip(char *&data)
+{
+	if (m_fileDone) {
+		return 0;
+	}
+	m_stream.next_out = reinterpret_cast<Bytef*>(&m_output[0]);
+	m_stream.avail_out = GZIP_OUTPUT_SIZE;
+	while (m_stream.avail_out > 0) {
+		if (m_stream.avail_in == 0) {
+			m_stream.avail_in = readRaw(&m_input[0], GZIP_INPUT_SIZE);
+			m_stream.next_in = reinterpret_cast<Bytef*>(&m_input[0]);
+			if (m_stream.avail_in == 0) {
+				if (m_stream.total_in > 0) {
+					die("unexpected end of compressed file");
+				}
+				break;
+			}
+		}
+		int status = inflate(&m_stream, Z_NO_FLUSH);
+		if (status == Z_STREAM_END) {
+			//another gzip member may follow, read enough to see its magic
+			if (m_stream.avail_in < 2) {
+				memmove(&m_input[0], m_stream.next_in, m_stream.avail_in);
+				m_stream.avail_in += readRaw(&m_input[m_stream.avail_in],
+						GZIP_INPUT_SIZE - m_stream.avail_in);
+				m_stream.next_in = reinterpret_cast<Bytef*>(&m_input[0]);
+			}
+			if (m_stream.avail_in > 0 && !isGzipMagic(m_stream.next_in,
+					m_stream.avail_in)) {
+				//as gunzip does, padding after the last member is ignored
+				warn("ignoring trailing garbage after compressed data");
+				m_stream.avail_in = 0;
+				m_fileDone = true;
+			}
+			if (m_stream.avail_in == 0) {
+				//total_in is reset to mark the end of a complete member
+				m_stream.total_in = 0;
+				break;
+			}
+			inflateReset(&m_stream);
+		} else if (status != Z_OK) {
+			die("corrupt compressed file");
+		}
+	}
+	size_t length = GZIP_OUTPUT_SIZE - m_stream.avail_out;
+	m_output[length] = '\0';
+	data = &m_output[0];
+	return length;
+}
+
+void GzipReader::die(const char *message) const
+{
+	cerr << m_path << ": error: " << message << endl;
+	exit(EXIT_FAILURE);
+}
+
+void GzipReader::warn(const char *message) const
+{
+	cerr << m_path << ": warning: " << message << endl;
+}
+
+void *GzipReader::inflateThread(void *arg)
+{
+	GzipReader &reader = *static_cast<GzipReader*>(arg);
+	for (;;) {
+		pthread_mutex_lock(&reader.m_mutex);
+		while (reader.m_jobs.empty() && !reader.m_stop) {
+			pthread_cond_wait(&reader.m_jobReady, &reader.m_mutex);
+		}
+		if (reader.m_jobs.empty()) {
+			pthread_mutex_unlock(&reader.m_mutex);
+			return NULL;
+		}
+		Block &block = *reader.m_jobs.front();
+		reader.m_jobs.pop_front();
+		pthread_mutex_unlock(&reader.m_mutex);
+
+		reader.inflateBlock(block);
+
+		pthread_mutex_lock(&reader.m_mutex);
+		block.done = true;
+		pthread_cond_broadcast(&reader.m_jobDone);
+		pthread_mutex_unlock(&reader.m_mutex);
+	}
+}
@@ -0,0 +1,112 @@
+/*
+ * GzipReader.h
+ *	Reads a gzip compressed file with zlib, without going through an
+ *	external gunzip process. BGZF files (independent blocks of at most
+ *	64 KB, as written by bgzip, samtools and BgzfStream) are inflated in
+ *	parallel by a pool of threads, ahead of the reader; other gzip files
+ *	are inflated in the reading thread. Decompressed data is handed out in
+ *	the buffers it was inflated into, so callers can parse it without
+ *	another copy.
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#ifndef GZIPREADER_H_
+#define GZIPREADER_H_
+
+#include <vector>
+#include <deque>
+#include <cstdio>
+#include <stdint.h>
+#include <sys/types.h>
+#include <pthread.h>
+#include <zlib.h>
+
+class GzipReader {
+public:
+	/*
+	 * Reads the compressed stream of file (which is not closed)
+	 * threads is the number of threads inflating BGZF blocks
+	 * (0 = inflate in the reading thread)
+	 */
+	GzipReader(FILE *file, const char *path, unsigned threads);
+
+	/*
+	 * Points data to the next chunk of decompressed data and returns its
+	 * length, or 0 at the end of the file. The chunk is followed by a null
+	 * character and stays valid until the next call.
+	 */
+	size_t read(char *&data);
+
+	bool eof() const
+	{
+		return m_eof;
+	}
+
+	/*
+	 * Number of decompressed bytes returned so far
+	 */
+	off_t tell() const
+	{
+		return m_offset;
+	}
+
+	/*
+	 * Whether the file name indicates a gzip file that can be read natively
+	 */
+	static bool isGzipPath(const char *path);
+
+	~GzipReader();
+
+private:
+	struct Block {
+		std::vector<char> compressed;
+		size_t compressedSize;
+		std::vector<char> data;
+		size_t size;
+		volatile bool done;
+	};
+
+	FILE *m_file;
+	const char *m_path;
+	bool m_bgzf;
+	bool m_eof;
+	off_t m_offset;
+
+	//bytes read to detect the format, returned before the rest of the file
+	std::vector<char> m_pending;
+	size_t m_pendingPos;
+
+	//BGZF: ring of blocks, the m_inFlight blocks from m_first have been
+	//read and are being inflated; the first one may be held by the caller
+	std::vector<Block> m_blocks;
+	size_t m_first;
+	size_t m_inFlight;
+	bool m_holding;
+	//no more compressed data is read, also set for gzip files when trailing
+	//data after the last member is ignored
+	bool m_fileDone;
+
+	std::vector<pthread_t> m_threads;
+	std::deque<Block*> m_jobs;
+	bool m_stop;
+	pthread_mutex_t m_mutex;
+	pthread_cond_t m_jobReady;
+	pthread_cond_t m_jobDone;
+
+	//other gzip files: a single zlib stream
+	z_stream m_stream;
+	std::vector<char> m_input;
+	std::vector<char> m_output;
+
+	size_t readRaw(char *buffer, size_t length);
+	size_t readBgzf(char *&data);
+	bool readBlock(Block &block);
+	void inflateBlock(Block &block) const;
+	size_t readGzip(char *&data);
+	void die(const char *message) const;
+	void warn(const char *message) const;
+	static void *inflateThread(void *arg);
+};
+
+#endif /* GZIPREADER_H_ */
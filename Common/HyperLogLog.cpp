@@ -0,0 +1,53 @@
+/*
+ * HyperLogLog.cpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#include "HyperLogLog.h"
+#include <cmath>
+#include <cassert>
+#include <algorithm>
+
+using namespace std;
+
+HyperLogLog::HyperLogLog(unsigned precision) :
+		m_precision(precision), m_registers(size_t(1) << precision, 0)
+{
+	assert(precision >= 4 && precision <= 20);
+}
+
+void HyperLogLog::merge(const HyperLogLog &sketch)
+{
+	assert(sketch.m_precision == m_precision);
+	for (size_t i = 0; i < m_registers.size(); ++i) {
+		m_registers[i] = max(m_registers[i], sketch.m_registers[i]);
+	}
+}
+
+double HyperLogLog::estimate() const
+{
+	double m = double(m_registers.size());
+	double sum = 0;
+	size_t zeros = 0;
+	for (vector<uint8_t>::const_iterator it = m_registers.begin();
+			it != m_registers.end(); ++it)
+	{
+		sum += ldexp(1.0, -int(*it));
+		if (*it == 0) {
+			++zeros;
+		}
+	}
+	double alpha = 0.7213 / (1 + 1.079 / m);
+	double estimate = alpha * m * m / sum;
+	//small sets are estimated better from the number of empty registers
+	if (estimate <= 2.5 * m && zeros > 0) {
+		estimate = m * log(m / double(zeros));
+	}
+	return estimate;
+}
+
+double HyperLogLog::standardError() const
+{
+	return 1.04 / sqrt(double(m_registers.size()));
+}
@@ -0,0 +1,55 @@
+/*
+ * HyperLogLog.h
+ *	Estimates the number of distinct items in a stream from their hash
+ *	values, in 2^precision bytes of memory (Flajolet et al. 2007, with
+ *	linear counting for small sets). Sketches built by separate threads
+ *	are combined with merge().
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#ifndef HYPERLOGLOG_H_
+#define HYPERLOGLOG_H_
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+class HyperLogLog {
+public:
+	/*
+	 * precision is the number of hash bits used to pick a register, the
+	 * relative error of estimates is about 1.04 / sqrt(2^precision)
+	 */
+	explicit HyperLogLog(unsigned precision = 14);
+
+	/*
+	 * Adds an item given a 64 bit hash of it
+	 */
+	void insert(uint64_t hash)
+	{
+		std::size_t index = hash >> (64 - m_precision);
+		uint64_t rest = hash << m_precision;
+		uint8_t rank = rest == 0 ?
+				uint8_t(64 - m_precision + 1) :
+				uint8_t(__builtin_clzll(rest) + 1);
+		if (rank > m_registers[index]) {
+			m_registers[index] = rank;
+		}
+	}
+
+	/*
+	 * Adds the items of another sketch of the same precision
+	 */
+	void merge(const HyperLogLog &sketch);
+
+	double estimate() const;
+
+	double standardError() const;
+
+private:
+	unsigned m_precision;
+	std::vector<uint8_t> m_registers;
+};
+
+#endif /* HYPERLOGLOG_H_ */
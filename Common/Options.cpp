@@ -6,6 +6,13 @@ namespace opt {
 
 	unsigned streakThreshold = 3;
 
+	/** Compression of .gz output files and decompression of .gz input */
+	int gzipLevel = 6;
+	unsigned gzipThreads = 0;
+
+	/** Size of each of the two buffers read ahead of the parser (0 = off) */
+	size_t readAheadSize = 4 << 20;
+
 	/** Verbose output */
 	int verbose;
 }
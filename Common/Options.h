@@ -5,11 +5,16 @@
  * Global variables that are mostly constant for the duration of the
  * execution of the program.
  */
+#include <cstddef>
+
 namespace opt {
 	extern bool colourSpace;
 	extern int rank;
 	extern int verbose;
 	extern unsigned streakThreshold;
+	extern int gzipLevel;
+	extern unsigned gzipThreads;
+	extern size_t readAheadSize;
 }
 
 #endif
@@ -0,0 +1,132 @@
+/*
+ * ReadAhead.cpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#include "ReadAhead.h"
+#include <iostream>
+#include <cstdlib>
+#include <fcntl.h>
+
+using namespace std;
+
+ReadAhead::ReadAhead(FILE *file, const char *path, size_t bufferSize,
+		off_t end) :
+		m_file(file), m_path(path), m_bufferSize(bufferSize), m_end(end), m_current(
+				0), m_holding(
+				false), m_eof(false), m_offset(0), m_done(false), m_error(
+				false), m_stop(false)
+{
+	off_t start = ftello(m_file);
+	if (start > 0) {
+		m_offset = start;
+	}
+#ifdef POSIX_FADV_SEQUENTIAL
+	//a hint only, fails on pipes
+	posix_fadvise(fileno(m_file), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+	for (unsigned i = 0; i < 2; ++i) {
+		m_buffers[i].data.resize(m_bufferSize + 1);
+		m_buffers[i].size = 0;
+		m_buffers[i].full = false;
+	}
+	pthread_mutex_init(&m_mutex, NULL);
+	pthread_cond_init(&m_filled, NULL);
+	pthread_cond_init(&m_emptied, NULL);
+	if (pthread_create(&m_thread, NULL, readThread, this) != 0) {
+		cerr << m_path << ": error: could not start reading thread" << endl;
+		exit(EXIT_FAILURE);
+	}
+}
+
+ReadAhead::~ReadAhead()
+{
+	pthread_mutex_lock(&m_mutex);
+	m_stop = true;
+	pthread_cond_signal(&m_emptied);
+	pthread_mutex_unlock(&m_mutex);
+	pthread_join(m_thread, NULL);
+	pthread_mutex_destroy(&m_mutex);
+	pthread_cond_destroy(&m_filled);
+	pthread_cond_destroy(&m_emptied);
+}
+
+size_t ReadAhead::read(char *&data)
+{
+	if (m_eof) {
+		return 0;
+	}
+	pthread_mutex_lock(&m_mutex);
+	//the caller is done with the buffer returned last time
+	if (m_holding) {
+		m_buffers[m_current].full = false;
+		m_current ^= 1;
+		m_holding = false;
+		pthread_cond_signal(&m_emptied);
+	}
+	Buffer &buffer = m_buffers[m_current];
+	while (!buffer.full && !m_done) {
+		pthread_cond_wait(&m_filled, &m_mutex);
+	}
+	bool full = buffer.full;
+	bool error = m_error;
+	pthread_mutex_unlock(&m_mutex);
+
+	if (!full || buffer.size == 0) {
+		if (error) {
+			cerr << m_path << ": error: could not read file" << endl;
+			exit(EXIT_FAILURE);
+		}
+		m_eof = true;
+		return 0;
+	}
+	m_holding = true;
+	m_offset += buffer.size;
+	data = &buffer.data[0];
+	return buffer.size;
+}
+
+void *ReadAhead::readThread(void *arg)
+{
+	ReadAhead &reader = *static_cast<ReadAhead*>(arg);
+	unsigned next = 0;
+	off_t pos = reader.m_offset;
+	pthread_mutex_lock(&reader.m_mutex);
+	for (;;) {
+		Buffer &buffer = reader.m_buffers[next];
+		while (buffer.full && !reader.m_stop) {
+			pthread_cond_wait(&reader.m_emptied, &reader.m_mutex);
+		}
+		if (reader.m_stop) {
+			break;
+		}
+		pthread_mutex_unlock(&reader.m_mutex);
+
+		size_t length = reader.m_bufferSize;
+		if (reader.m_end - pos < off_t(length)) {
+			length = reader.m_end > pos ? reader.m_end - pos : 0;
+		}
+		size_t size = length > 0 ?
+				fread(&buffer.data[0], 1, length, reader.m_file) : 0;
+		buffer.data[size] = '\0';
+		bool error = ferror(reader.m_file) != 0;
+		pos += size;
+
+		pthread_mutex_lock(&reader.m_mutex);
+		buffer.size = size;
+		buffer.full = true;
+		if (size < reader.m_bufferSize) {
+			//end of the file (fread only returns less on error or eof) or
+			//of the part to read
+			reader.m_error = error;
+			reader.m_done = true;
+			pthread_cond_signal(&reader.m_filled);
+			break;
+		}
+		pthread_cond_signal(&reader.m_filled);
+		next ^= 1;
+	}
+	pthread_mutex_unlock(&reader.m_mutex);
+	return NULL;
+}
@@ -0,0 +1,81 @@
+/*
+ * ReadAhead.h
+ *	Reads a file in large chunks from a background thread, so the next
+ *	chunk is read while the caller parses the current one. Data is handed
+ *	out in the buffers it was read into (two, filled alternately), so
+ *	callers can parse it without another copy.
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#ifndef READAHEAD_H_
+#define READAHEAD_H_
+
+#include <vector>
+#include <cstdio>
+#include <sys/types.h>
+#include <pthread.h>
+
+class ReadAhead {
+public:
+	/*
+	 * Reads file (which is not closed) from its current position, in
+	 * chunks of bufferSize bytes, stopping at offset end or the end of the
+	 * file. The file is then left positioned where reading stopped.
+	 */
+	ReadAhead(FILE *file, const char *path, size_t bufferSize, off_t end);
+
+	/*
+	 * Points data to the next chunk of the file and returns its length, or
+	 * 0 at the end of the file (or offset end). The chunk is followed by a
+	 * null character and stays valid until the next call.
+	 */
+	size_t read(char *&data);
+
+	bool eof() const
+	{
+		return m_eof;
+	}
+
+	/*
+	 * Offset in the file of the end of the last chunk returned
+	 */
+	off_t tell() const
+	{
+		return m_offset;
+	}
+
+	~ReadAhead();
+
+private:
+	struct Buffer {
+		std::vector<char> data;
+		size_t size;
+		bool full;
+	};
+
+	FILE *m_file;
+	const char *m_path;
+	size_t m_bufferSize;
+	off_t m_end;
+	Buffer m_buffers[2];
+
+	//buffer the caller reads next, and whether it holds the other one
+	unsigned m_current;
+	bool m_holding;
+	bool m_eof;
+	off_t m_offset;
+
+	//set by the reading thread once it has read the whole file
+	bool m_done;
+	bool m_error;
+	bool m_stop;
+	pthread_t m_thread;
+	pthread_mutex_t m_mutex;
+	pthread_cond_t m_filled;
+	pthread_cond_t m_emptied;
+
+	static void *readThread(void *arg);
+};
+
+#endif /* READAHEAD_H_ */
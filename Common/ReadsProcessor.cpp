@@ -354,7 +354,7 @@ const string ReadsProcessor::getBases(const unsigned char* c)
  * - m_kmerSize must be greater than 3 otherwise undefined behavior will occur
  * requires a start position
  */
-const unsigned char* ReadsProcessor::prepSeq(string const &sequence,
+const unsigned char* ReadsProcessor::prepSeq(const char *sequence,
 		size_t position)
 {
 	size_t index = position;
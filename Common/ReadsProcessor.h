@@ -15,7 +15,11 @@ using namespace std;
 class ReadsProcessor {
 public:
 	ReadsProcessor(unsigned windowSize);
-	const unsigned char* prepSeq(string const &sequence, size_t position);
+	const unsigned char* prepSeq(const char *sequence, size_t position);
+	const unsigned char* prepSeq(string const &sequence, size_t position)
+	{
+		return prepSeq(sequence.data(), position);
+	}
 	const string getBases(const unsigned char* c); //for debuging purposes
 	virtual ~ReadsProcessor();
 private:
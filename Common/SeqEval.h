@@ -21,10 +21,38 @@ using namespace std;
 using namespace boost;
 
 namespace SeqEval {
+/*
+ * Copies the sequence of a read, replacing bases with a quality below minQual
+ * (phred+33) with N. K-mers spanning these bases are then skipped by the
+ * evaluation algorithms below the same way as k-mers with ambiguity codes.
+ * Returns false (and leaves masked untouched) if no base needed masking.
+ */
+template<typename Read>
+inline bool maskLowQuality(const Read &rec, string &masked, unsigned minQual)
+{
+	const char cutoff = static_cast<char>(33 + minQual);
+	const size_t length = rec.qual.length();
+	size_t i = 0;
+	while (i < length && rec.qual[i] >= cutoff) {
+		++i;
+	}
+	if (i == length) {
+		return false;
+	}
+	masked.assign(rec.seq.data(), rec.seq.length());
+	for (; i < length; ++i) {
+		if (rec.qual[i] < cutoff) {
+			masked[i] = 'N';
+		}
+	}
+	return true;
+}
+
 /*
  * Evaluation algorithm with no hashValue storage (optimize speed for single queries)
  */
-inline bool evalSingle(const FastqRecord &rec, unsigned kmerSize, const BloomFilter &filter,
+template<typename Read>
+inline bool evalSingle(const Read &rec, unsigned kmerSize, const BloomFilter &filter,
 		double threshold, size_t antiThreshold)
 {
 	ReadsProcessor proc(kmerSize);
@@ -33,7 +61,7 @@ inline bool evalSingle(const FastqRecord &rec, unsigned kmerSize, const BloomFil
 	unsigned antiScore = 0;
 	unsigned streak = 0;
 	while (rec.seq.length() >= currentLoc + kmerSize) {
-		const unsigned char* currentKmer = proc.prepSeq(rec.seq, currentLoc);
+		const unsigned char* currentKmer = proc.prepSeq(rec.seq.data(), currentLoc);
 		if (streak == 0) {
 			if (currentKmer != NULL) {
 				if (filter.contains(currentKmer)) {
@@ -96,7 +124,8 @@ inline bool evalSingle(const FastqRecord &rec, unsigned kmerSize, const BloomFil
 /*
  * Evaluation algorithm with hashValue storage (minimize redundant work)
  */
-inline bool evalSingle(const FastqRecord &rec, unsigned kmerSize, const BloomFilter &filter,
+template<typename Read>
+inline bool evalSingle(const Read &rec, unsigned kmerSize, const BloomFilter &filter,
 		double threshold, double antiThreshold, unsigned hashNum,
 		vector<vector<size_t> > &hashValues, const BloomFilter &subtract)
 {
@@ -106,10 +135,10 @@ inline bool evalSingle(const FastqRecord &rec, unsigned kmerSize, const BloomFil
 	unsigned antiScore = 0;
 	unsigned streak = 0;
 	while (rec.seq.length() >= currentLoc + kmerSize) {
-		const unsigned char* currentSeq = proc.prepSeq(rec.seq, currentLoc);
+		const unsigned char* currentSeq = proc.prepSeq(rec.seq.data(), currentLoc);
 		if (streak == 0) {
 			if (currentSeq != NULL) {
-				hashValues[currentLoc] = multiHash(currentSeq, hashNum, kmerSize);
+				multiHash(currentSeq, hashNum, kmerSize, hashValues[currentLoc]);
 				if (!subtract.contains(hashValues[currentLoc])
 						&& filter.contains(hashValues[currentLoc])) {
 					score += 0.5;
@@ -136,7 +165,7 @@ inline bool evalSingle(const FastqRecord &rec, unsigned kmerSize, const BloomFil
 			}
 		} else {
 			if (currentSeq != NULL) {
-				hashValues[currentLoc] = multiHash(currentSeq, hashNum, kmerSize);
+				multiHash(currentSeq, hashNum, kmerSize, hashValues[currentLoc]);
 				if (!subtract.contains(hashValues[currentLoc])
 						&& filter.contains(hashValues[currentLoc])) {
 					++streak;
@@ -173,7 +202,8 @@ inline bool evalSingle(const FastqRecord &rec, unsigned kmerSize, const BloomFil
 /*
  * Evaluation algorithm with hashValue storage (minimize redundant work)
  */
-inline bool evalSingle(const FastqRecord &rec, unsigned kmerSize, const BloomFilter &filter,
+template<typename Read>
+inline bool evalSingle(const Read &rec, unsigned kmerSize, const BloomFilter &filter,
 		double threshold, double antiThreshold, unsigned hashNum,
 		vector<vector<size_t> > &hashValues)
 {
@@ -183,10 +213,10 @@ inline bool evalSingle(const FastqRecord &rec, unsigned kmerSize, const BloomFil
 	unsigned antiScore = 0;
 	unsigned streak = 0;
 	while (rec.seq.length() >= currentLoc + kmerSize) {
-		const unsigned char* currentSeq = proc.prepSeq(rec.seq, currentLoc);
+		const unsigned char* currentSeq = proc.prepSeq(rec.seq.data(), currentLoc);
 		if (streak == 0) {
 			if (currentSeq != NULL) {
-				hashValues[currentLoc] = multiHash(currentSeq, hashNum, kmerSize);
+				multiHash(currentSeq, hashNum, kmerSize, hashValues[currentLoc]);
 				if (filter.contains(hashValues[currentLoc])) {
 					score += 0.5;
 					++streak;
@@ -212,7 +242,7 @@ inline bool evalSingle(const FastqRecord &rec, unsigned kmerSize, const BloomFil
 			}
 		} else {
 			if (currentSeq != NULL) {
-				hashValues[currentLoc] = multiHash(currentSeq, hashNum, kmerSize);
+				multiHash(currentSeq, hashNum, kmerSize, hashValues[currentLoc]);
 				if (filter.contains(hashValues[currentLoc])) {
 					++streak;
 					score += 1 - 1 / (2 * streak);
@@ -249,7 +279,8 @@ inline bool evalSingle(const FastqRecord &rec, unsigned kmerSize, const BloomFil
  * Evaluation algorithm with no hashValue storage (optimize speed for single queries)
  * Returns score and does not have a stopping threshold
  */
-inline double evalSingleExhaust(const FastqRecord &rec, unsigned kmerSize,
+template<typename Read>
+inline double evalSingleExhaust(const Read &rec, unsigned kmerSize,
 		const BloomFilter &filter)
 {
 	ReadsProcessor proc(kmerSize);
@@ -257,7 +288,7 @@ inline double evalSingleExhaust(const FastqRecord &rec, unsigned kmerSize,
 	double score = 0;
 	unsigned streak = 0;
 	while (rec.seq.length() >= currentLoc + kmerSize) {
-		const unsigned char* currentKmer = proc.prepSeq(rec.seq, currentLoc);
+		const unsigned char* currentKmer = proc.prepSeq(rec.seq.data(), currentLoc);
 		if (streak == 0) {
 			if (currentKmer != NULL) {
 				if (filter.contains(currentKmer)) {
@@ -304,7 +335,7 @@ inline double evalSingleExhaust(const FastqRecord &rec, unsigned kmerSize,
 //	unsigned antiScore = 0;
 //	unsigned streak = 0;
 //	while (rec.seq.length() >= currentLoc + kmerSize) {
-//		const unsigned char* currentKmer = proc.prepSeq(rec.seq, currentLoc);
+//		const unsigned char* currentKmer = proc.prepSeq(rec.seq.data(), currentLoc);
 //		if (streak == 0) {
 //			if (currentKmer != NULL) {
 //				if (filter.contains(currentKmer)) {
@@ -368,7 +399,8 @@ inline double evalSingleExhaust(const FastqRecord &rec, unsigned kmerSize,
  * Also stores if position has already been visited to minimize work
  * Takes in last position visited and score and updates them accordingly
  */
-inline bool eval(const FastqRecord &rec, unsigned kmerSize,
+template<typename Read>
+inline bool eval(const Read &rec, unsigned kmerSize,
 		const BloomFilter &filter, double threshold, double antiThreshold,
 		vector<bool> &visited, vector<vector<size_t> > &hashValues,
 		unsigned &currentLoc, double &score, ReadsProcessor &proc)
@@ -382,7 +414,7 @@ inline bool eval(const FastqRecord &rec, unsigned kmerSize,
 		//check if hash value is already generated
 		if (hashValues[currentLoc].size() == 0) {
 			if (!visited[currentLoc]) {
-				const unsigned char* currentSeq = proc.prepSeq(rec.seq,
+				const unsigned char* currentSeq = proc.prepSeq(rec.seq.data(),
 						currentLoc);
 				if (currentSeq != NULL) {
 					hashValues[currentLoc] = multiHash(currentSeq, filter.getHashNum(),
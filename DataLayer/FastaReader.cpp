@@ -1,5 +1,7 @@
 #include "FastaReader.h"
 #include "DataLayer/Options.h"
+#include "DataLayer/RecordRules.h"
+#include "Common/Options.h"
 #include "IOUtil.h"
 #include <algorithm>
 #include <cassert>
@@ -7,6 +9,7 @@
 #include <cstdlib>
 #include <iostream>
 #include <sstream>
+#include <stdint.h>
 #include <vector>
 
 using namespace std;
@@ -37,61 +40,268 @@ ostream& FastaReader::die()
 }
 
 FastaReader::FastaReader(const char* path, int flags, int len)
-	: m_path(path), m_blen(32768), m_bstart(0), m_bend(0),
+	: m_path(path), m_gz(NULL), m_bam(false), m_ahead(NULL), m_blen(32768),
+	m_bstart(0), m_bend(0), m_buff(NULL), m_ownBuff(NULL), m_directFill(true),
 	m_fail(false), m_flags(flags), m_line(0), m_unchaste(0),
-	m_end(numeric_limits<streamsize>::max()),
+	m_end(numeric_limits<off_t>::max()),
 	m_maxLength(len), forceBreak(false)
 {
-	m_buff = new char[m_blen];
-	if (strcmp(path, "-") != 0)
-		m_in = fopen(m_path, "r");
-	else
+	m_bam = endsWith(string(path), ".bam");
+	if (strcmp(path, "-") == 0)
 		m_in = stdin;
-	if (m_in == NULL)
+	else if (GzipReader::isGzipPath(path) || m_bam)
+		// "rb" bypasses the hook in Uncompress.cpp that pipes the file
+		// through gunzip or samtools
+		m_in = fopen(m_path, "rb");
+	else
+		m_in = fopen(m_path, "r");
+	if (m_in == NULL) {
 		perror(m_path);
+		exit(EXIT_FAILURE);
+	}
 	if (fpeek(m_in) == EOF)
 		cerr << m_path << ':' << m_line << ": warning: "
 			"file is empty\n";
+	if ((GzipReader::isGzipPath(path) || m_bam) && m_in != stdin)
+		m_gz = new GzipReader(m_in, m_path, opt::gzipThreads);
+	else
+		m_buff = m_ownBuff = new char[m_blen + 1];
 	fill_buff();
+	if (m_bam)
+		readBamHeader();
+}
+
+/** Copy the next n bytes of the stream to dest.
+ * @return false at end-of-file
+ */
+bool FastaReader::readBytes(char* dest, size_t n)
+{
+	size_t count = 0;
+	while (count < n && fill_buff()) {
+		size_t len = min(n - count, m_bend - m_bstart);
+		memcpy(dest + count, m_buff + m_bstart, len);
+		m_bstart += len;
+		count += len;
+	}
+	if (count > 0 && count < n) {
+		die() << "unexpected end of BAM file\n";
+		exit(EXIT_FAILURE);
+	}
+	return count == n;
+}
+
+/** Return the little-endian integer at p. */
+static inline uint32_t getLE32(const char* p)
+{
+	const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+	return uint32_t(u[0]) | uint32_t(u[1]) << 8 | uint32_t(u[2]) << 16
+		| uint32_t(u[3]) << 24;
+}
+
+static inline uint16_t getLE16(const char* p)
+{
+	const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+	return uint16_t(u[0] | u[1] << 8);
 }
 
-#if 0
-/** Split the fasta file into nsections and seek to the start
- * of section. */
-void FastaReader::split(unsigned section, unsigned nsections)
+/** Skip the BAM header: the SAM text and the reference sequences. */
+void FastaReader::readBamHeader()
+{
+	char buf[4];
+	if (!readBytes(buf, 4) || memcmp(buf, "BAM\1", 4) != 0) {
+		die() << "not a BAM file\n";
+		exit(EXIT_FAILURE);
+	}
+	readBytes(buf, 4);
+	m_record.resize(getLE32(buf) + 1);
+	readBytes(&m_record[0], m_record.size() - 1);
+	readBytes(buf, 4);
+	for (uint32_t nref = getLE32(buf); nref > 0; --nref) {
+		readBytes(buf, 4);
+		m_record.resize(getLE32(buf) + 4);
+		readBytes(&m_record[0], m_record.size());
+	}
+}
+
+/** Read the next primary BAM record, skipping secondary,
+ * supplementary and (with the chastity filter) QC failed records.
+ * @return false at end-of-file
+ */
+bool FastaReader::readBamRecord(string& id, string& comment,
+		Sequence& s, string& q)
+{
+	static const char BASES[] = "=ACMGRSVTWYHKDBN";
+	static const size_t FIXED_SIZE = 32;
+	for (;;) {
+		char buf[4];
+		if (!readBytes(buf, 4)) {
+			m_fail = true;
+			return false;
+		}
+		m_record.resize(getLE32(buf));
+		if (m_record.size() < FIXED_SIZE) {
+			die() << "invalid BAM record\n";
+			exit(EXIT_FAILURE);
+		}
+		readBytes(&m_record[0], m_record.size());
+		m_line++;
+
+		const char* r = &m_record[0];
+		size_t nameLength = (unsigned char)r[8];
+		size_t cigarLength = getLE16(r + 12) * 4;
+		unsigned flags = getLE16(r + 14);
+		size_t seqLength = getLE32(r + 16);
+		const char* name = r + FIXED_SIZE;
+		const char* seq = name + nameLength + cigarLength;
+		const char* qual = seq + (seqLength + 1) / 2;
+		if (nameLength == 0 || qual + seqLength > r + m_record.size()) {
+			die() << "invalid BAM record\n";
+			exit(EXIT_FAILURE);
+		}
+
+		id.assign(name, nameLength - 1);
+		if (!samFlagsToId(flags, id, comment))
+			continue;
+
+		s.resize(seqLength);
+		for (size_t i = 0; i < seqLength; ++i) {
+			unsigned char b = seq[i / 2];
+			s[i] = BASES[i % 2 == 0 ? b >> 4 : b & 0xf];
+		}
+		// A missing quality string is stored as 0xff.
+		if (seqLength > 0 && (unsigned char)qual[0] != 0xff) {
+			q.resize(seqLength);
+			for (size_t i = 0; i < seqLength; ++i)
+				q[i] = char(qual[i] + 33);
+		} else
+			q.clear();
+		if (flags & 0x10) { // FREVERSE
+			s = reverseComplement(s);
+			reverse(q.begin(), q.end());
+		}
+		return true;
+	}
+}
+
+/** Name a SAM or BAM record after its flags, adding the read number
+ * to the ID of paired reads.
+ * @return false if the record should be skipped
+ */
+bool FastaReader::samFlagsToId(unsigned flags, string& id,
+		string& comment)
+{
+	if (flags & 0x900) // FSECONDARY|FSUPPLEMENTARY
+		return false;
+	if (opt::chastityFilter && (flags & 0x200)) { // FQCFAIL
+		m_unchaste++;
+		return false;
+	}
+	switch (flags & 0xc1) { // FPAIRED|FREAD1|FREAD2
+	  case 0: case 1: // FPAIRED
+		comment = "0:";
+		break;
+	  case 0x41: // FPAIRED|FREAD1
+		id += "/1";
+		comment = "1:";
+		break;
+	  case 0x81: // FPAIRED|FREAD2
+		id += "/2";
+		comment = "2:";
+		break;
+	  default:
+		die() << "invalid flags: `" << id << "'" << endl;
+		exit(EXIT_FAILURE);
+	}
+	comment += flags & 0x200 ? "Y:0:" : "N:0:"; // FQCFAIL
+	return true;
+}
+
+/** Read a line directly from a stream, without the newline. */
+static bool readRawLine(FILE* in, string& line)
+{
+	line.clear();
+	int c;
+	while ((c = getc(in)) != EOF && c != '\n')
+		line += c;
+	return c != EOF || !line.empty();
+}
+
+/** Return whether a record starts at pos, which must be the start of a
+ * line. A FASTA record starts with '>'. A FASTQ record starts with '@',
+ * its third line starts with '+' and its second and fourth lines are the
+ * same length, which a quality line that starts with '@' cannot satisfy.
+ */
+bool FastaReader::isRecordStart(off_t pos, char recordType)
+{
+	fseeko(m_in, pos, SEEK_SET);
+	string line;
+	if (!readRawLine(m_in, line) || line.empty() || line[0] != recordType)
+		return false;
+	if (recordType == '>')
+		return true;
+	string seq, plus, qual;
+	return readRawLine(m_in, seq) && readRawLine(m_in, plus)
+		&& readRawLine(m_in, qual) && !plus.empty() && plus[0] == '+'
+		&& seq.length() == qual.length();
+}
+
+/** Return the offset of the first record that starts at or after pos.
+ * Every section boundary is found with this same test, so each record
+ * is read by exactly one section.
+ */
+off_t FastaReader::findRecordStart(off_t pos, off_t length,
+		char recordType)
+{
+	if (pos <= 0)
+		return 0;
+	// Move to the start of the next line.
+	string line;
+	fseeko(m_in, pos - 1, SEEK_SET);
+	readRawLine(m_in, line);
+	pos += line.length();
+	while (pos < length) {
+		if (isRecordStart(pos, recordType))
+			return pos;
+		fseeko(m_in, pos, SEEK_SET);
+		readRawLine(m_in, line);
+		pos += line.length() + 1;
+	}
+	return length;
+}
+
+/** Split the file into nsections and limit this reader to the records
+ * that start within section. Only uncompressed FASTA and FASTQ files
+ * can be split; otherwise section 1 reads the whole file, the other
+ * sections read nothing and false is returned.
+ */
+bool FastaReader::split(unsigned section, unsigned nsections)
 {
 	assert(nsections >= section);
 	assert(section > 0);
-	assert(strcmp(m_path, "-") != 0);
 	if (nsections == 1)
-		return;
-	// Move the get pointer to the first entry in this section and
-	// update the m_end if there is more than one section.
-	m_in.seekg(0, ios::end);
-	streampos length = m_in.tellg();
-	assert(length > 0);
-	streampos start = length * (section - 1) / nsections;
-	streampos end = length * section / nsections;
-	assert(end > 0);
-	if (end < length) {
-		m_in.seekg(end);
-		if (m_in.peek() == '>')
-			end += 1;
-	}
-	m_end = end;
-	m_in.seekg(start);
-	if (start > 0) {
-		m_in.ignore(numeric_limits<streamsize>::max(), '\n');
-		m_in.ignore(numeric_limits<streamsize>::max(), '>');
-		if (m_in.peek() == EOF)
-			cerr << m_path << ':' << section << ": warning: "
-				"there are no contigs in this section\n";
-		m_in.putback('>');
+		return true;
+	char recordType = peek();
+	bool seekable = strcmp(m_path, "-") != 0 && m_gz == NULL
+		&& fseeko(m_in, 0, SEEK_END) == 0;
+	off_t length = seekable ? ftello(m_in) : -1;
+	if (length <= 0 || (recordType != '>' && recordType != '@')
+			|| !isRecordStart(0, recordType)) {
+		if (section > 1)
+			breakClose();
+		else if (seekable)
+			seek(0);
+		return false;
 	}
-	assert(m_end > 0);
-	assert(m_in.good());
+	off_t start = findRecordStart(length * (section - 1) / nsections,
+			length, recordType);
+	m_end = section == nsections ? length
+		: findRecordStart(length * section / nsections, length,
+				recordType);
+	seek(start);
+	if (start >= m_end)
+		breakClose();
+	return true;
 }
-#endif
 
 /** Return whether this read passed the chastity filter. */
 bool FastaReader::isChaste(const string& s, const string& line)
@@ -117,14 +327,6 @@ void FastaReader::checkSeqQual(const string& s, const string& q)
 	}
 }
 
-/** Return whether the read seq is in colour space. */
-static bool isColourSpace(const string& seq)
-{
-	assert(!seq.empty());
-	size_t i = seq.find_first_of("ACGTacgt0123", 1);
-	return i != string::npos && isdigit(seq[i]);
-}
-
 /** Read a single record. */
 Sequence FastaReader::read(string& id, string& comment,
 		char& anchor, string& q)
@@ -135,6 +337,16 @@ next_record:
 	anchor = 0;
 	q.clear();
 
+	if (m_bam) {
+		Sequence s;
+		if (readBamRecord(id, comment, s, q)) {
+			if (!q.empty())
+				checkSeqQual(s, q);
+			finishRecord(s, q, 33);
+		}
+		return s;
+	}
+
 	// Discard comments.
 	while (peek() == '#')
 		ignoreLines(1);
@@ -143,44 +355,49 @@ next_record:
 	Sequence s;
 
 	unsigned qualityOffset = 0;
-	if (eof() || recordType == EOF || ftell(m_in) >= m_end) {
+	if (eof() || recordType == EOF) {
 		string header;
 		getline(header);
 
+		return s;
+	} else if (position() >= m_end) {
+		// End of this section of the file.
+		m_fail = true;
+		breakClose();
+		// Nothing more is read, so stop reading ahead.
+		delete m_ahead;
+		m_ahead = NULL;
+		m_buff = m_ownBuff;
+		m_bstart = m_bend = 0;
 		return s;
 	} else if (recordType == '>' || recordType == '@') {
 		// Read the header.
 		string header;
 		getline(header);
-		istringstream headerStream(header);
-		headerStream >> recordType >> id >> ws;
-		std::getline(headerStream, comment);
+		RecordHeader parsed;
+		parseRecordHeader(header.data(), header.length(), parsed);
+		id.assign(parsed.id, parsed.idLength);
+		comment.assign(parsed.comment, parsed.commentLength);
 
 		// Ignore SAM headers.
-		if (id.length() == 2 && isupper(id[0]) && isupper(id[1])
-				&& comment.length() > 2 && comment[2] == ':')
+		if (parsed.samHeader)
 			goto next_record;
 
-		// Casava FASTQ format
-		if (comment.size() > 3
-				&& comment[1] == ':' && comment[3] == ':') {
-			// read, chastity, flags, index: 1:Y:0:AAAAAA
-			if (opt::chastityFilter && comment[2] == 'Y') {
-				m_unchaste++;
-				if (recordType == '@') {
-					ignoreLines(3);
-				} else {
-					while (peek() != '>' && peek() != '#'
-							&& ignoreLines(1))
-						;
-				}
-				goto next_record;
-			}
-			if (id.size() > 2 && id.rbegin()[1] != '/') {
-				// Add the read number to the ID.
-				id += '/';
-				id += comment[0];
+		if (parsed.unchaste) {
+			m_unchaste++;
+			if (recordType == '@') {
+				ignoreLines(3);
+			} else {
+				while (peek() != '>' && peek() != '#'
+						&& ignoreLines(1))
+					;
 			}
+			goto next_record;
+		}
+		if (parsed.readNumber != 0) {
+			// Add the read number to the ID.
+			id += '/';
+			id += parsed.readNumber;
 		}
 
 		getline(s);
@@ -218,12 +435,12 @@ next_record:
 			exit(EXIT_FAILURE);
 		}
 
-		if (s.length() < opt::minLength) {
+		if (isTooShort(s.length())) {
 			goto next_record;
 		}
 
-		bool colourSpace = isColourSpace(s);
-		if (colourSpace && !isdigit(s[0])) {
+		bool colourSpace = isColourSpace(s.data(), s.length());
+		if (hasPrimerBase(s.data(), s.length())) {
 			// The first character is the primer base. The second
 			// character is the dibase read of the primer and the
 			// first base of the sample, which is not part of the
@@ -272,31 +489,9 @@ next_record:
 					|| fields[10] == "*")) {
 			// SAM
 			unsigned flags = strtoul(fields[1].c_str(), NULL, 0);
-			if (flags & 0x100) // FSECONDARY
-				goto next_record;
-			if (opt::chastityFilter && (flags & 0x200)) { // FQCFAIL
-				m_unchaste++;
-				goto next_record;
-			}
 			id = fields[0];
-			switch (flags & 0xc1) { // FPAIRED|FREAD1|FREAD2
-			  case 0: case 1: // FPAIRED
-				comment = "0:";
-				break;
-			  case 0x41: // FPAIRED|FREAD1
-				id += "/1";
-				comment = "1:";
-				break;
-			  case 0x81: // FPAIRED|FREAD2
-				id += "/2";
-				comment = "2:";
-				break;
-			  default:
-				die() << "invalid flags: `" << id << "' near"
-					<< line << endl;
-				exit(EXIT_FAILURE);
-			}
-			comment += flags & 0x200 ? "Y:0:" : "N:0:"; // FQCFAIL
+			if (!samFlagsToId(flags, id, comment))
+				goto next_record;
 
 			s = fields[9];
 			q = fields[10];
@@ -346,6 +541,14 @@ next_record:
 		}
 	}
 
+	finishRecord(s, q, qualityOffset);
+	return s;
+}
+
+/** Trim a record and convert its quality to standard quality. */
+void FastaReader::finishRecord(Sequence& s, string& q,
+		unsigned qualityOffset)
+{
 	if (opt::qualityOffset > 0)
 		qualityOffset = opt::qualityOffset;
 
@@ -395,6 +598,4 @@ next_record:
 			*it = 33 + max(0, x);
 		}
 	}
-
-	return s;
 }
@@ -3,6 +3,9 @@
 
 #include "Sequence.h"
 #include "StringUtil.h" // for chomp
+#include "GzipReader.h"
+#include "ReadAhead.h"
+#include "Common/Options.h"
 #include <cassert>
 #include <cstdlib> // for exit
 #include <fstream>
@@ -11,9 +14,11 @@
 #include <limits> // for numeric_limits
 #include <ostream>
 #include <algorithm>
+#include <vector>
 
 #include <cstdio>
 #include <cstring>
+#include <sys/types.h>
 
 static inline int fpeek(FILE * stream)
 {
@@ -23,7 +28,7 @@ static inline int fpeek(FILE * stream)
 	return c;
 }
 
-/** Read a FASTA, FASTQ, export, qseq or SAM file. */
+/** Read a FASTA, FASTQ, export, qseq, SAM or BAM file. */
 class FastaReader {
 public:
 	enum {
@@ -51,8 +56,11 @@ public:
 			die() << "expected end-of-file near\n" << line << '\n';
 			exit(EXIT_FAILURE);
 		}
+		if (m_gz != NULL)
+			delete m_gz;
+		delete m_ahead;
+		delete[] m_ownBuff;
 		fclose(m_in);
-		delete m_buff;
 	}
 
 	Sequence read(std::string& id, std::string& comment, char& anchor,
@@ -61,13 +69,25 @@ public:
 	/** Return whether this stream is at end-of-file. */
 	bool eof() const
 	{
-		return (m_bstart >= m_bend && feof(m_in)) || forceBreak;
+		return (m_bstart >= m_bend && (m_gz != NULL ? m_gz->eof()
+					: m_ahead != NULL ? m_ahead->eof()
+					: feof(m_in))) || forceBreak;
 	}
 
 	void breakClose(){
 		forceBreak = true;
 	}
 
+	bool split(unsigned section, unsigned nsections);
+
+	/** Return the offset of the next unread byte of this stream. */
+	off_t position() const
+	{
+		return (m_gz != NULL ? m_gz->tell()
+				: m_ahead != NULL ? m_ahead->tell() : ftello(m_in))
+			- off_t(m_bend - m_bstart);
+	}
+
 	/** Return whether this stream is good. */
 	operator bool() const
 	{
@@ -106,8 +126,36 @@ private:
 	bool fill_buff()
 	{
 		if (m_bstart >= m_bend) {
+			if (forceBreak)
+				return false;
 			m_bstart = 0;
-			m_bend = fread(m_buff, sizeof(char), m_blen, m_in);
+			// gzip input is parsed in place in the decompressed blocks
+			if (m_gz != NULL)
+				m_bend = m_gz->read(m_buff);
+			else if (m_ahead != NULL) {
+				m_bend = m_ahead->read(m_buff);
+				if (m_bend == 0) {
+					// Stopped at the end of the file or of the
+					// section; the rest of the last record of a
+					// section is read directly.
+					delete m_ahead;
+					m_ahead = NULL;
+					return fill_buff();
+				}
+			} else if (m_directFill || opt::readAheadSize == 0
+					|| ftello(m_in) >= m_end) {
+				// The first fill after opening or seeking is read
+				// directly, so split() can still use m_in and unread
+				// sections do not start reading ahead.
+				m_buff = m_ownBuff;
+				m_bend = fread(m_buff, sizeof(char), m_blen, m_in);
+				m_buff[m_bend] = '\0';
+				m_directFill = false;
+			} else {
+				m_ahead = new ReadAhead(m_in, m_path,
+						opt::readAheadSize, m_end);
+				m_bend = m_ahead->read(m_buff);
+			}
 		}
 		return m_bend != 0;
 	}
@@ -153,6 +201,28 @@ private:
 		return good;
 	}
 
+	void seek(off_t pos)
+	{
+		delete m_ahead;
+		m_ahead = NULL;
+		fseeko(m_in, pos, SEEK_SET);
+		m_bstart = m_bend = 0;
+		m_directFill = true;
+		fill_buff();
+	}
+
+	bool readBytes(char* dest, size_t n);
+	void readBamHeader();
+	bool readBamRecord(std::string& id, std::string& comment,
+			Sequence& s, std::string& q);
+	bool samFlagsToId(unsigned flags, std::string& id,
+			std::string& comment);
+	void finishRecord(Sequence& s, std::string& q,
+			unsigned qualityOffset);
+
+	bool isRecordStart(off_t pos, char recordType);
+	off_t findRecordStart(off_t pos, off_t length, char recordType);
+
 	std::ostream& die();
 	bool isChaste(const std::string& s, const std::string& line);
 	void checkSeqQual(const std::string& s, const std::string& q);
@@ -162,8 +232,24 @@ private:
 	//std::istream& m_in;
 	FILE * m_in;
 
+	/** Native decompression of gzip and BAM input, NULL otherwise. */
+	GzipReader * m_gz;
+
+	/** Whether the input is BAM, which is decoded directly. */
+	bool m_bam;
+
+	/** The current BAM record. */
+	std::vector<char> m_record;
+
+	/** Background reading of other files, NULL until started. */
+	ReadAhead * m_ahead;
+
 	size_t m_blen, m_bstart, m_bend;
 	char * m_buff;
+	/** Buffer for direct reads, m_buff points to it or to the data of
+	 * m_gz or m_ahead. */
+	char * m_ownBuff;
+	bool m_directFill;
 	bool m_fail;
 
 	/** Flags indicating parsing options. */
@@ -176,7 +262,7 @@ private:
 	unsigned m_unchaste;
 
 	/** Position of the end of the current section. */
-	std::streampos m_end;
+	off_t m_end;
 
 	/** Trim sequences to this length. 0 is unlimited. */
 	const int m_maxLength;
@@ -222,6 +308,15 @@ struct FastaRecord {
 		return seq.size();
 	}
 
+	/** Exchange the contents of two records without copying. */
+	void swap(FastaRecord& o)
+	{
+		id.swap(o.id);
+		comment.swap(o.comment);
+		std::swap(anchor, o.anchor);
+		seq.swap(o.seq);
+	}
+
 	friend FastaReader& operator >>(FastaReader& in, FastaRecord& o)
 	{
 		std::string q;
@@ -253,6 +348,13 @@ struct FastqRecord: FastaRecord {
 		assert(seq.length() == qual.length());
 	}
 
+	/** Exchange the contents of two records without copying. */
+	void swap(FastqRecord& o)
+	{
+		FastaRecord::swap(o);
+		qual.swap(o.qual);
+	}
+
 	friend FastaReader& operator >>(FastaReader& in, FastqRecord& o)
 	{
 		o.seq = in.read(o.id, o.comment, o.anchor, o.qual);
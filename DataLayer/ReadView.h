@@ -0,0 +1,101 @@
+/*
+ * ReadView.h
+ *	Read records that point into memory owned by someone else (a memory
+ *	mapped file or the strings of a FastqRecord) instead of holding copies
+ *	of their fields. A view is only valid as long as the memory it points
+ *	to, which for the categorizer is until its batch is refilled.
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#ifndef READVIEW_H_
+#define READVIEW_H_
+
+#include <string>
+#include <cstddef>
+#include "FastaReader.h"
+
+/*
+ * A read only range of characters
+ */
+class StringView {
+public:
+	StringView() :
+			m_data(""), m_length(0)
+	{
+	}
+
+	StringView(const char *data, size_t length) :
+			m_data(data), m_length(length)
+	{
+	}
+
+	StringView(const std::string &str) :
+			m_data(str.data()), m_length(str.length())
+	{
+	}
+
+	const char *data() const
+	{
+		return m_data;
+	}
+
+	size_t length() const
+	{
+		return m_length;
+	}
+
+	size_t size() const
+	{
+		return m_length;
+	}
+
+	bool empty() const
+	{
+		return m_length == 0;
+	}
+
+	const char &operator[](size_t i) const
+	{
+		return m_data[i];
+	}
+
+	std::string str() const
+	{
+		return std::string(m_data, m_length);
+	}
+
+	void appendTo(std::string &buffer) const
+	{
+		buffer.append(m_data, m_length);
+	}
+
+private:
+	const char *m_data;
+	size_t m_length;
+};
+
+/*
+ * The fields of a FASTA or FASTQ record
+ */
+struct ReadView {
+	StringView id;
+	StringView comment;
+	StringView seq;
+	StringView qual;
+
+	//the whole input record, if it is exactly "@id\nseq\n+\nqual\n" (or
+	//">id\nseq\n"), so it can be written out as is; empty otherwise
+	StringView text;
+
+	ReadView()
+	{
+	}
+
+	explicit ReadView(const FastqRecord &rec) :
+			id(rec.id), comment(rec.comment), seq(rec.seq), qual(rec.qual)
+	{
+	}
+};
+
+#endif /* READVIEW_H_ */
@@ -0,0 +1,120 @@
+/*
+ * RecordRules.h
+ *	The rules FASTA and FASTQ records are read by: splitting the header,
+ *	skipping SAM headers and unchaste Casava reads, adding Casava read
+ *	numbers to IDs, colour space reads and the minimum length. They work on
+ *	ranges of characters, so FastaReader and parsers of mapped files read
+ *	records the same way.
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#ifndef RECORDRULES_H_
+#define RECORDRULES_H_
+
+#include "DataLayer/Options.h"
+#include <cctype>
+#include <cstddef>
+#include <cstring>
+
+/*
+ * The fields of a record header and what to do with the record
+ */
+struct RecordHeader {
+	const char *id;
+	size_t idLength;
+	const char *comment;
+	size_t commentLength;
+
+	//SAM header lines, which are skipped
+	bool samHeader;
+
+	//Casava reads failing the chastity filter (when it is on), skipped
+	bool unchaste;
+
+	//Casava read number to add to the ID as /N, 0 if there is none
+	char readNumber;
+};
+
+/*
+ * Parses a header line, from its '>' or '@' to the end of the line without
+ * its newline
+ */
+static inline void parseRecordHeader(const char *header, size_t length,
+		RecordHeader &parsed)
+{
+	size_t i = 0;
+	while (i < length && isspace(header[i])) {
+		++i;
+	}
+	//the record type
+	++i;
+	while (i < length && isspace(header[i])) {
+		++i;
+	}
+	size_t idStart = i;
+	while (i < length && !isspace(header[i])) {
+		++i;
+	}
+	size_t idEnd = i;
+	while (i < length && isspace(header[i])) {
+		++i;
+	}
+	const char *id = header + idStart;
+	const char *comment = header + i;
+	size_t idLength = idEnd - idStart;
+	size_t commentLength = i < length ? length - i : 0;
+	parsed.id = id;
+	parsed.idLength = idLength;
+	parsed.comment = comment;
+	parsed.commentLength = commentLength;
+	parsed.samHeader = idLength == 2 && isupper(id[0]) && isupper(id[1])
+			&& commentLength > 2 && comment[2] == ':';
+	parsed.unchaste = false;
+	parsed.readNumber = 0;
+
+	// Casava FASTQ format
+	// read, chastity, flags, index: 1:Y:0:AAAAAA
+	if (!parsed.samHeader && commentLength > 3 && comment[1] == ':'
+			&& comment[3] == ':')
+	{
+		parsed.unchaste = opt::chastityFilter && comment[2] == 'Y';
+		if (idLength > 2 && id[idLength - 2] != '/') {
+			parsed.readNumber = comment[0];
+		}
+	}
+}
+
+/*
+ * Reads shorter than the minimum length are skipped
+ */
+static inline bool isTooShort(size_t length)
+{
+	return length < opt::minLength;
+}
+
+/*
+ * Whether a read is in colour space: its first base or colour after the
+ * first character is a colour
+ */
+static inline bool isColourSpace(const char *seq, size_t length)
+{
+	for (size_t i = 1; i < length; ++i) {
+		if (strchr("ACGTacgt0123", seq[i]) != NULL && seq[i] != '\0') {
+			return isdigit(seq[i]);
+		}
+	}
+	return false;
+}
+
+/*
+ * Whether a colour space read starts with its primer base. The second
+ * character is then the dibase read of the primer and the first base of
+ * the sample, and both are dropped.
+ */
+static inline bool hasPrimerBase(const char *seq, size_t length)
+{
+	return length > 0 && !isdigit(seq[0]) && isColourSpace(seq, length);
+}
+
+#endif /* RECORDRULES_H_ */
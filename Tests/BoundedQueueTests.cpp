@@ -0,0 +1,117 @@
+/*
+ * BoundedQueueTests.cpp
+ *	Unit tests for BoundedQueue: order, capacity, close and concurrent use
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#include "Common/BoundedQueue.h"
+#include <assert.h>
+#include <pthread.h>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+static const size_t s_itemsPerProducer = 100000;
+static const unsigned s_producers = 4;
+static const unsigned s_consumers = 4;
+
+static BoundedQueue<size_t> *s_queue;
+
+static void *produce(void *arg)
+{
+	size_t first = *static_cast<size_t*>(arg);
+	for (size_t i = 0; i < s_itemsPerProducer; ++i) {
+		s_queue->push(first + i);
+	}
+	return NULL;
+}
+
+static void *consume(void *arg)
+{
+	vector<size_t> &seen = *static_cast<vector<size_t>*>(arg);
+	size_t item;
+	while (s_queue->pop(item)) {
+		seen.push_back(item);
+	}
+	return NULL;
+}
+
+int main()
+{
+	//capacity is rounded up to a power of 2
+	BoundedQueue<int> small(5);
+	assert(small.capacity() == 8);
+
+	//items come out in order, and tryPush fails when full
+	for (int i = 0; i < 8; ++i) {
+		assert(small.tryPush(i));
+	}
+	assert(!small.tryPush(8));
+	assert(small.size() == 8);
+	assert(small.getMaxDepth() == 8);
+	int item;
+	for (int i = 0; i < 8; ++i) {
+		assert(small.tryPop(item));
+		assert(item == i);
+	}
+	assert(!small.tryPop(item));
+
+	//the ring wraps around
+	for (int i = 0; i < 20; ++i) {
+		small.push(i);
+		assert(small.pop(item));
+		assert(item == i);
+	}
+
+	//items pushed before close are still popped, then pop returns false
+	small.push(1);
+	small.push(2);
+	small.close();
+	assert(small.pop(item) && item == 1);
+	assert(small.pop(item) && item == 2);
+	assert(!small.pop(item));
+
+	//every item of several producers is popped exactly once by several
+	//consumers through a queue small enough to fill up
+	BoundedQueue<size_t> queue(16);
+	s_queue = &queue;
+	vector<pthread_t> producers(s_producers);
+	vector<size_t> firsts(s_producers);
+	for (unsigned i = 0; i < s_producers; ++i) {
+		firsts[i] = i * s_itemsPerProducer;
+		pthread_create(&producers[i], NULL, produce, &firsts[i]);
+	}
+	vector<pthread_t> consumers(s_consumers);
+	vector<vector<size_t> > seen(s_consumers);
+	for (unsigned i = 0; i < s_consumers; ++i) {
+		pthread_create(&consumers[i], NULL, consume, &seen[i]);
+	}
+	for (unsigned i = 0; i < s_producers; ++i) {
+		pthread_join(producers[i], NULL);
+	}
+	queue.close();
+	for (unsigned i = 0; i < s_consumers; ++i) {
+		pthread_join(consumers[i], NULL);
+	}
+	vector<unsigned> counts(s_producers * s_itemsPerProducer, 0);
+	for (unsigned i = 0; i < s_consumers; ++i) {
+		//each consumer sees the items of one producer in order
+		vector<size_t> last(s_producers, 0);
+		for (vector<size_t>::const_iterator it = seen[i].begin();
+				it != seen[i].end(); ++it)
+		{
+			size_t producer = *it / s_itemsPerProducer;
+			assert(last[producer] <= *it + 1);
+			last[producer] = *it + 1;
+			++counts[*it];
+		}
+	}
+	for (size_t i = 0; i < counts.size(); ++i) {
+		assert(counts[i] == 1);
+	}
+
+	cout << "BoundedQueue tests done" << endl;
+	return 0;
+}
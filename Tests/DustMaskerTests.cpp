@@ -0,0 +1,99 @@
+/*
+ * DustMaskerTests.cpp
+ *	Unit tests for DustMasker: repeats of short motifs score high, random
+ *	sequence low, and sliding scores match scores from scratch
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#include "Common/DustMasker.h"
+#include <assert.h>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+static const unsigned s_kmerSize = 25;
+static const double s_threshold = 2;
+
+static string repeat(const string &motif, size_t length)
+{
+	string seq;
+	while (seq.length() < length) {
+		seq += motif;
+	}
+	return seq.substr(0, length);
+}
+
+static string randomSequence(size_t length)
+{
+	static const char bases[] = "ACGT";
+	string seq(length, 'A');
+	for (size_t i = 0; i < length; ++i) {
+		seq[i] = bases[rand() % 4];
+	}
+	return seq;
+}
+
+/*
+ * Number of k-mers of seq that are masked
+ */
+static size_t maskedKmers(DustMasker &dust, const string &seq)
+{
+	size_t masked = 0;
+	dust.reset();
+	for (size_t i = 0; i + s_kmerSize <= seq.length(); ++i) {
+		if (dust.isMasked(seq.c_str() + i)) {
+			++masked;
+		}
+	}
+	return masked;
+}
+
+int main()
+{
+	srand(1);
+	DustMasker dust(s_kmerSize, s_threshold);
+	const size_t length = 200;
+	const size_t kmers = length - s_kmerSize + 1;
+
+	//poly-A, microsatellites and motifs of up to 4 bases are masked
+	const char *motifs[] = { "A", "T", "CA", "AGC", "GATA", "acgt" };
+	for (size_t i = 0; i < sizeof(motifs) / sizeof(motifs[0]); ++i) {
+		string seq = repeat(motifs[i], length);
+		assert(maskedKmers(dust, seq) == kmers);
+		assert(dust.isLowComplexity(seq.c_str(), seq.length()));
+	}
+
+	//random sequence is not
+	size_t masked = 0;
+	for (unsigned i = 0; i < 100; ++i) {
+		string seq = randomSequence(length);
+		masked += maskedKmers(dust, seq);
+		assert(!dust.isLowComplexity(seq.c_str(), seq.length()));
+	}
+	assert(masked * 100 < 100 * kmers);
+
+	//a higher threshold masks less
+	DustMasker strict(s_kmerSize, 10);
+	assert(maskedKmers(strict, repeat("GATA", length)) == 0);
+	assert(maskedKmers(strict, repeat("A", length)) == kmers);
+
+	//sequences shorter than a k-mer are never low complexity
+	assert(!dust.isLowComplexity("AAAAAAAAAA", 10));
+
+	//the score updated from the k-mer before matches the score from
+	//scratch, across a random sequence with repeats in it
+	string mixed = randomSequence(300) + repeat("CA", 60)
+			+ randomSequence(100) + repeat("A", 40) + randomSequence(100);
+	dust.reset();
+	for (size_t i = 0; i + s_kmerSize <= mixed.length(); ++i) {
+		bool sliding = dust.isMasked(mixed.c_str() + i);
+		DustMasker fresh(s_kmerSize, s_threshold);
+		assert(sliding == fresh.isMasked(mixed.c_str() + i));
+	}
+
+	cout << "DustMasker tests done" << endl;
+	return 0;
+}
@@ -0,0 +1,77 @@
+/*
+ * HyperLogLogTests.cpp
+ *	Unit tests for HyperLogLog: estimates are within the error bound and
+ *	merging sketches estimates the union
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#include "Common/HyperLogLog.h"
+#include "Common/city.h"
+#include <assert.h>
+#include <cmath>
+#include <iostream>
+
+using namespace std;
+
+static uint64_t hashOf(uint64_t item)
+{
+	return CityHash64(reinterpret_cast<const char*>(&item), sizeof(item));
+}
+
+/*
+ * Whether the estimate of count distinct items is within 4 standard errors
+ */
+static bool withinBound(const HyperLogLog &sketch, size_t count)
+{
+	double error = fabs(sketch.estimate() - double(count)) / double(count);
+	cout << count << " items estimated as " << sketch.estimate()
+			<< " (relative error " << error << ")" << endl;
+	return error <= 4 * sketch.standardError();
+}
+
+int main()
+{
+	HyperLogLog empty;
+	assert(empty.estimate() == 0);
+
+	const size_t counts[] = { 10, 1000, 20000, 100000, 1000000 };
+	for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i) {
+		HyperLogLog sketch;
+		for (size_t item = 0; item < counts[i]; ++item) {
+			sketch.insert(hashOf(item));
+		}
+		assert(withinBound(sketch, counts[i]));
+
+		//repeated items are not counted again
+		for (size_t item = 0; item < counts[i]; ++item) {
+			sketch.insert(hashOf(item));
+		}
+		assert(withinBound(sketch, counts[i]));
+	}
+
+	//a lower precision has a larger bound it still keeps to
+	HyperLogLog coarse(10);
+	assert(coarse.standardError() > empty.standardError());
+	for (size_t item = 0; item < 500000; ++item) {
+		coarse.insert(hashOf(item));
+	}
+	assert(withinBound(coarse, 500000));
+
+	//sketches of overlapping sets merge to the sketch of their union
+	HyperLogLog first, second, both;
+	for (size_t item = 0; item < 300000; ++item) {
+		first.insert(hashOf(item));
+		both.insert(hashOf(item));
+	}
+	for (size_t item = 200000; item < 600000; ++item) {
+		second.insert(hashOf(item));
+		both.insert(hashOf(item));
+	}
+	first.merge(second);
+	assert(first.estimate() == both.estimate());
+	assert(withinBound(first, 600000));
+
+	cout << "HyperLogLog tests done" << endl;
+	return 0;
+}
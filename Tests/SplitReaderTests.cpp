@@ -0,0 +1,109 @@
+/*
+ * SplitReaderTests.cpp
+ *	Unit tests for FastaReader::split: the sections of a FASTA or FASTQ file
+ *	read every record of the file exactly once, in order
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#include "DataLayer/FastaReader.h"
+#include "Common/Options.h"
+#include <assert.h>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+using namespace std;
+
+static string randomSequence(size_t length)
+{
+	static const char bases[] = "ACGT";
+	string seq(length, 'A');
+	for (size_t i = 0; i < length; ++i) {
+		seq[i] = bases[rand() % 4];
+	}
+	return seq;
+}
+
+/*
+ * Writes records of varied lengths, wrapping fasta sequences and starting
+ * some fastq quality lines with @ so record starts are ambiguous
+ */
+static string writeFile(const string &dir, bool fastq, size_t records)
+{
+	string path = dir + (fastq ? "/reads.fq" : "/reads.fa");
+	FILE *out = fopen(path.c_str(), "w");
+	assert(out != NULL);
+	for (size_t i = 0; i < records; ++i) {
+		string seq = randomSequence(30 + rand() % 300);
+		if (fastq) {
+			string qual(seq.length(), 'I');
+			qual[0] = '@';
+			fprintf(out, "@read%zu comment\n%s\n+\n%s\n", i, seq.c_str(),
+					qual.c_str());
+		} else {
+			fprintf(out, ">read%zu comment\n", i);
+			for (size_t j = 0; j < seq.length(); j += 60) {
+				fprintf(out, "%s\n", seq.substr(j, 60).c_str());
+			}
+		}
+	}
+	fclose(out);
+	return path;
+}
+
+/*
+ * Reads the records of all sections of path split nsections ways
+ */
+static vector<string> readSections(const string &path, unsigned nsections)
+{
+	vector<string> records;
+	for (unsigned section = 1; section <= nsections; ++section) {
+		FastaReader reader(path.c_str(), FastaReader::NO_FOLD_CASE);
+		bool split = reader.split(section, nsections);
+		assert(split || nsections == 1);
+		FastqRecord rec;
+		while (reader >> rec) {
+			records.push_back(rec.id + " " + rec.seq + " " + rec.qual);
+		}
+		assert(reader.eof());
+	}
+	return records;
+}
+
+int main()
+{
+	srand(1);
+	char dirTemplate[] = "/tmp/SplitReaderTests.XXXXXX";
+	char *dir = mkdtemp(dirTemplate);
+	assert(dir != NULL);
+
+	//read ahead buffers smaller than a section, larger than a section and
+	//none at all
+	const size_t readAheadSizes[] = { 1024, 4 << 20, 0 };
+	for (int fastq = 0; fastq < 2; ++fastq) {
+		string path = writeFile(dir, fastq, 2000);
+		for (size_t i = 0;
+				i < sizeof(readAheadSizes) / sizeof(readAheadSizes[0]); ++i)
+		{
+			opt::readAheadSize = readAheadSizes[i];
+			vector<string> expected = readSections(path, 1);
+			assert(expected.size() == 2000);
+			const unsigned nsections[] = { 2, 3, 7, 16, 64, 5000 };
+			for (size_t j = 0; j < sizeof(nsections) / sizeof(nsections[0]);
+					++j)
+			{
+				assert(readSections(path, nsections[j]) == expected);
+			}
+		}
+		unlink(path.c_str());
+	}
+	rmdir(dir);
+
+	cout << "FastaReader split tests done" << endl;
+	return 0;
+}
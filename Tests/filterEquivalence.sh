@@ -0,0 +1,114 @@
+#!/bin/sh
+# filterEquivalence.sh
+#	Checks that the ways biobloommaker can build a filter make the same
+#	filter: -t 1 and -t N, --shard parts joined with --merge, --max_mem
+#	stripes, --deterministic progressive filters, --map against a
+#	separate build of each filter, and --update against a build of all of
+#	the sequences.
+#
+#  Created on: Oct 18, 2026
+
+maker=${BIOBLOOMMAKER:-../BioBloomMaker/biobloommaker}
+dir=$(mktemp -d "${TMPDIR:-/tmp}/filterEquivalence.XXXXXX") || exit 1
+trap 'rm -rf "$dir"' 0
+
+fail() {
+	echo "FAIL: $*" >&2
+	exit 1
+}
+
+build() {
+	"$maker" -o "$dir" "$@" > "$dir/log" 2>&1 \
+		|| { cat "$dir/log" >&2; fail "biobloommaker $*"; }
+}
+
+# four sequences of random bases, with a repeat shared by two of them
+awk 'BEGIN {
+	seed = 1
+	split("A C G T", bases, " ")
+	for (i = 0; i < 4; i++) {
+		printf(">seq%d\n", i)
+		for (j = 0; j < 40000; j++) {
+			seed = seed * 16807 % 2147483647
+			printf("%s", bases[int(seed / 256) % 4 + 1])
+			if (j % 60 == 59)
+				printf("\n")
+		}
+		if (i % 2 == 0)
+			printf("ACGTTGCAACGTTGCAACGTTGCAACGTTGCA")
+		printf("\n")
+	}
+}' > "$dir/all.fa"
+
+# -t 1 and -t 4
+build -p t1 -t 1 "$dir/all.fa"
+build -p t4 -t 4 "$dir/all.fa"
+cmp "$dir/t1.bf" "$dir/t4.bf" || fail "-t 4 differs from -t 1"
+
+# --shard and --merge, given the -n of the whole build
+n=$(sed -n 's/^expected_num_entries=//p' "$dir/t1.txt")
+build -p shard1 -n "$n" --shard=1/2 "$dir/all.fa"
+build -p shard2 -n "$n" --shard=2/2 -t 2 "$dir/all.fa"
+build -p merged --merge "$dir/shard1.bf" "$dir/shard2.bf"
+cmp "$dir/t1.bf" "$dir/merged.bf" || fail "--shard and --merge differ from -t 1"
+
+# --max_mem, with a filter several times larger than the budget
+build -p large -n 3000000 "$dir/all.fa"
+build -p striped -n 3000000 --max_mem=1 -t 2 "$dir/all.fa"
+cmp "$dir/large.bf" "$dir/striped.bf" || fail "--max_mem differs"
+
+# --deterministic progressive filters, from pairs of reads that each
+# differ from the sequences at one base, until the filter is full
+awk '/^>/ { if (seq != "") print seq; seq = ""; next } { seq = seq $0 }
+END { print seq }' "$dir/all.fa" | awk -v dir="$dir" '{
+	seed = NR
+	for (i = 0; i < 400; i++) {
+		seed = seed * 16807 % 2147483647
+		p = 1 + int(seed / 256) % (length($0) - 400)
+		for (mate = 1; mate <= 2; mate++) {
+			read = substr($0, p + (mate - 1) * 300, 100)
+			base = substr(read, 50, 1)
+			base = base == "A" ? "C" : base == "C" ? "G" : base == "G" ? "T" : "A"
+			read = substr(read, 1, 49) base substr(read, 51)
+			qual = read
+			gsub(/./, "I", qual)
+			print "@pair" NR "_" i "/" mate "\n" read "\n+\n" qual \
+				> (dir "/reads" mate ".fq")
+		}
+	}
+}'
+build -p det1 -n 170000 -r 0.5 --deterministic -t 1 "$dir/all.fa" \
+	"$dir/reads1.fq" "$dir/reads2.fq"
+grep -q "^num_entries=170000$" "$dir/det1.txt" \
+	|| fail "--deterministic did not fill the filter"
+for run in 1 2 3; do
+	build -p det4 -n 170000 -r 0.5 --deterministic -t 4 "$dir/all.fa" \
+		"$dir/reads1.fq" "$dir/reads2.fq"
+	cmp "$dir/det1.bf" "$dir/det4.bf" \
+		|| fail "--deterministic -t 4 differs from -t 1"
+done
+
+# --map, against a build of each filter from its own sequences
+awk '/^>/ { out = dir "/" substr($1, 2) ".fa" } { print > out }' \
+	dir="$dir" "$dir/all.fa"
+printf 'seq0 A\nseq1 A\nseq2 B\nseq3 C\n' > "$dir/map.txt"
+mkdir "$dir/map" "$dir/sep"
+"$maker" -o "$dir/map" --map="$dir/map.txt" -t 2 "$dir/all.fa" \
+	> "$dir/log" 2>&1 || { cat "$dir/log" >&2; fail "--map"; }
+cat "$dir/seq0.fa" "$dir/seq1.fa" > "$dir/A.fa"
+cp "$dir/seq2.fa" "$dir/B.fa"
+cp "$dir/seq3.fa" "$dir/C.fa"
+for id in A B C; do
+	n=$(sed -n 's/^expected_num_entries=//p' "$dir/map/$id.txt")
+	"$maker" -o "$dir/sep" -p $id -n "$n" "$dir/$id.fa" > "$dir/log" 2>&1 \
+		|| { cat "$dir/log" >&2; fail "build of $id"; }
+	cmp "$dir/map/$id.bf" "$dir/sep/$id.bf" || fail "--map filter $id differs"
+done
+
+# --update, against a build of all of the sequences with the same -n
+build -p base -n 170000 "$dir/seq0.fa" "$dir/seq1.fa"
+build -p updated --update="$dir/base.bf" "$dir/seq2.fa" "$dir/seq3.fa"
+build -p whole -n 170000 "$dir/all.fa"
+cmp "$dir/whole.bf" "$dir/updated.bf" || fail "--update differs"
+
+echo "filter equivalence tests done"
@@ -0,0 +1,115 @@
+#!/bin/sh
+# readParserEquivalence.sh
+#	Checks that biobloomcategorizer reads a FASTQ file the same way when
+#	it maps the file as when it parses it as a stream with FastaReader:
+#	Casava read numbers and chastity, SAM header lines, colour space reads
+#	and the minimum length. Also checks that zero padding after a gzip
+#	compressed copy is ignored.
+#
+#  Created on: Oct 18, 2026
+
+maker=${BIOBLOOMMAKER:-../BioBloomMaker/biobloommaker}
+categorizer=${BIOBLOOMCATEGORIZER:-../BioBloomCategorizer/biobloomcategorizer}
+dir=$(mktemp -d "${TMPDIR:-/tmp}/readParserEquivalence.XXXXXX") || exit 1
+trap 'rm -rf "$dir"' 0
+
+fail() {
+	echo "FAIL: $*" >&2
+	exit 1
+}
+
+# a reference, and reads from it and of random bases in every form the
+# record rules deal with
+awk -v dir="$dir" 'BEGIN {
+	seed = 7
+	split("A C G T", bases, " ")
+	ref = ""
+	for (j = 0; j < 20000; j++)
+		ref = ref base()
+	print ">ref\n" ref > (dir "/ref.fa")
+	for (i = 0; i < 400; i++) {
+		len = 20 + rand16() % 130
+		if (i % 2 == 0) {
+			seq = substr(ref, 1 + rand16() % (20000 - len), len)
+		} else {
+			seq = ""
+			for (j = 0; j < len; j++)
+				seq = seq base()
+		}
+		if (i % 37 == 5) {
+			# colour space, with and without the primer base
+			seq = ""
+			for (j = 0; j < len; j++)
+				seq = seq (rand16() % 4)
+			if (i % 2 == 0)
+				seq = "T" seq
+		}
+		# the primer base has no quality
+		qual = ""
+		for (j = seq ~ /^T[0-3]/; j < length(seq); j++)
+			qual = qual "I"
+		kind = i % 6
+		if (kind == 0)
+			header = "read" i
+		else if (kind == 1)
+			header = "read" i " 1:N:0:ACGTAC"
+		else if (kind == 2)
+			header = "read" i " 2:Y:0:ACGTAC"
+		else if (kind == 3)
+			header = "read" i "/1 1:N:0:ACGTAC"
+		else if (kind == 4)
+			header = "read" i " some comment"
+		else
+			header = "read" i "\t2:N:0:1"
+		print "@" header "\n" seq "\n+\n" qual > (dir "/reads.fq")
+		if (i % 97 == 50)
+			print "@SQ\tSN:ref\tLN:20000" > (dir "/reads.fq")
+		if (i % 89 == 40)
+			print "# comment line" > (dir "/reads.fq")
+	}
+}
+function rand16() {
+	seed = seed * 16807 % 2147483647
+	return int(seed / 256)
+}
+function base() {
+	return bases[rand16() % 4 + 1]
+}'
+
+"$maker" -o "$dir" -p ref "$dir/ref.fa" > "$dir/log" 2>&1 \
+	|| { cat "$dir/log" >&2; fail "biobloommaker"; }
+
+# classifies the reads from the file (mapped) and from stdin (FastaReader)
+# and compares the outputs
+compare() {
+	name=$1
+	shift
+	"$categorizer" -f "$dir/ref.bf" --fq -p "$dir/$name.mapped" "$@" \
+		"$dir/reads.fq" > "$dir/log" 2>&1 \
+		|| { cat "$dir/log" >&2; fail "$name mapped"; }
+	"$categorizer" -f "$dir/ref.bf" --fq -p "$dir/$name.stream" "$@" - \
+		< "$dir/reads.fq" > "$dir/log" 2>&1 \
+		|| { cat "$dir/log" >&2; fail "$name stream"; }
+	for mapped in "$dir/$name.mapped"*; do
+		stream=$(echo "$mapped" | sed "s/$name\.mapped/$name.stream/")
+		cmp "$mapped" "$stream" || fail "$name: $mapped differs"
+	done
+	test -s "$dir/${name}.mapped_ref.fq" || fail "$name: no reads matched"
+}
+
+compare plain
+compare chastity --chastity
+compare length -l 60
+compare threads -t 3 --chastity -l 40
+
+# padding after the last gzip member only warns, as gunzip does
+gzip -c "$dir/reads.fq" > "$dir/padded.fq.gz"
+head -c 1000 /dev/zero >> "$dir/padded.fq.gz"
+"$categorizer" -f "$dir/ref.bf" --fq -p "$dir/padded" "$dir/padded.fq.gz" \
+	> "$dir/log" 2>&1 || { cat "$dir/log" >&2; fail "padded gzip"; }
+grep -q "warning: ignoring trailing garbage" "$dir/log" \
+	|| fail "padded gzip: no warning"
+cmp "$dir/plain.mapped_ref.fq" "$dir/padded_ref.fq" \
+	|| fail "padded gzip: reads differ"
+
+echo "read parser equivalence tests done"